@@ -0,0 +1,305 @@
+// Compiler and runtime benchmarks. Prints one JSON object so results can be diffed between
+// commits:
+//
+//   tuz_bench [--functions=N] [--depth=N] [--nesting=N] [--iterations=N]
+//             [--kernel-dir=<dir>] [--kernels=a.tz,b.tz] [--input=N] [--output=<file>]
+//
+// Every measurement is the fastest of --iterations runs. Kernels get --input as their first
+// argument, so their work is done at run time rather than folded by the compiler.
+
+#include "tuz/codegen.h"
+#include "tuz/lexer.h"
+#include "tuz/parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <llvm/Support/FileSystem.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef TUZ_BENCH_KERNELS_DIR
+#define TUZ_BENCH_KERNELS_DIR "bench/kernels"
+#endif
+
+using namespace tuz;
+
+namespace {
+
+struct BenchConfig {
+  int functions = 100;
+  int depth = 8;
+  int nesting = 2;
+  int iterations = 5;
+  std::string kernel_dir = TUZ_BENCH_KERNELS_DIR;
+  std::vector<std::string> kernels = {"fib.tz", "lcg.tz"};
+  int input = 27;
+  std::string output;
+};
+
+// =============================================================================
+// Synthetic programs
+// =============================================================================
+
+// Left-deep expression over the parameters and loop variables, `depth` operators deep
+std::string generate_expr(int depth, int nesting, int seed) {
+  static const char* ops[] = {"+", "-", "*", "+", "%"};
+  std::string expr = "a";
+  for (int d = 0; d < depth; ++d) {
+    int pick = (seed + d) % 5;
+    std::string operand;
+    if (d % 3 == 0) {
+      operand = "b";
+    } else if (nesting > 0 && d % 3 == 1) {
+      operand = "i" + std::to_string(d % nesting);
+    } else {
+      operand = std::to_string(d + 1);
+    }
+    // Keep the right-hand side of % non-zero
+    if (pick == 4) {
+      operand = std::to_string(d + 2);
+    }
+    expr = "(" + expr + " " + ops[pick] + " " + operand + ")";
+  }
+  return expr;
+}
+
+// `functions` functions, each running an expression of the given depth inside loops nested
+// `nesting` deep; every function calls its predecessor so nothing is trivially dead
+std::string generate_program(const BenchConfig& config) {
+  std::ostringstream out;
+  for (int f = 0; f < config.functions; ++f) {
+    // Named func<N>: f32 and f64 are type keywords
+    out << "fn func" << f << "(a: int, b: int) -> int {\n";
+    out << "  let mut acc = " << (f > 0 ? "func" + std::to_string(f - 1) + "(b, a)" : "a")
+        << ";\n";
+    std::string indent = "  ";
+    for (int n = 0; n < config.nesting; ++n) {
+      out << indent << "for i" << n << " = 0, 4 {\n";
+      indent += "  ";
+    }
+    out << indent << "acc = acc + " << generate_expr(config.depth, config.nesting, f) << ";\n";
+    for (int n = config.nesting - 1; n >= 0; --n) {
+      indent.resize(indent.size() - 2);
+      out << indent << "}\n";
+    }
+    out << "  return acc;\n}\n\n";
+  }
+  out << "fn main() -> int {\n  return func" << std::max(config.functions - 1, 0)
+      << "(1, 2) % 256;\n}\n";
+  return out.str();
+}
+
+// =============================================================================
+// Measurement
+// =============================================================================
+
+// Fastest wall time of body over the iterations, in milliseconds; setup runs untimed before
+// each iteration
+double time_best(int iterations, const std::function<void()>& body,
+                 const std::function<void()>& setup = {}) {
+  double best = 0;
+  for (int i = 0; i < iterations; ++i) {
+    if (setup)
+      setup();
+    auto start = std::chrono::steady_clock::now();
+    body();
+    double ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+    best = i == 0 ? ms : std::min(best, ms);
+  }
+  return best;
+}
+
+// Lex, parse, generate, optimize and emit an object file
+void compile_to_object(const std::string& source, int opt_level, const std::string& obj_file) {
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  CodeGenOptions options;
+  options.opt_level = opt_level;
+  CodeGenerator codegen(options);
+  codegen.generate(program);
+  codegen.optimize();
+  codegen.compile_to_object(obj_file);
+}
+
+bool read_file(const std::string& path, std::string& content) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::ostringstream buffer;
+  buffer << in.rdbuf();
+  content = buffer.str();
+  return true;
+}
+
+bool parse_args(int argc, char** argv, BenchConfig& config) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&](const char* prefix) -> const char* {
+      size_t length = std::char_traits<char>::length(prefix);
+      return arg.compare(0, length, prefix) == 0 ? arg.c_str() + length : nullptr;
+    };
+
+    if (auto v = value("--functions=")) {
+      config.functions = std::max(1, std::stoi(v));
+    } else if (auto v = value("--depth=")) {
+      config.depth = std::max(0, std::stoi(v));
+    } else if (auto v = value("--nesting=")) {
+      config.nesting = std::max(0, std::stoi(v));
+    } else if (auto v = value("--iterations=")) {
+      config.iterations = std::max(1, std::stoi(v));
+    } else if (auto v = value("--kernel-dir=")) {
+      config.kernel_dir = v;
+    } else if (auto v = value("--kernels=")) {
+      config.kernels.clear();
+      std::stringstream list(v);
+      for (std::string kernel; std::getline(list, kernel, ',');) {
+        if (!kernel.empty())
+          config.kernels.push_back(kernel);
+      }
+    } else if (auto v = value("--input=")) {
+      config.input = std::stoi(v);
+    } else if (auto v = value("--output=")) {
+      config.output = v;
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  BenchConfig config;
+  if (!parse_args(argc, argv, config)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--functions=N] [--depth=N] [--nesting=N] [--iterations=N]"
+                 " [--kernel-dir=<dir>] [--kernels=a.tz,b.tz] [--input=N] [--output=<file>]"
+              << std::endl;
+    return 1;
+  }
+
+  std::string source = generate_program(config);
+  std::ostringstream json;
+  json << std::fixed << std::setprecision(3);
+
+  try {
+    // Front end throughput, one phase at a time
+    size_t token_count = 0;
+    double lex_ms = time_best(config.iterations, [&] {
+      Lexer lexer(source);
+      token_count = lexer.tokenize().size();
+    });
+
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    // The parser takes its tokens by value, so each iteration gets a fresh copy outside the timer
+    std::vector<Token> parser_tokens;
+    size_t node_count = 0;
+    double parse_ms = time_best(
+        config.iterations,
+        [&] {
+          Parser parser(std::move(parser_tokens));
+          node_count = parser.parse_program().context->node_count();
+        },
+        [&] { parser_tokens = tokens; });
+
+    Program program;
+    std::unique_ptr<CodeGenerator> codegen;
+    double codegen_ms = time_best(
+        config.iterations, [&] { codegen->generate(program); },
+        [&] {
+          Parser parser(tokens);
+          program = parser.parse_program();
+          codegen = std::make_unique<CodeGenerator>();
+        });
+    int function_count = config.functions + 1; // Including main
+
+    json << "{\"config\":{\"functions\":" << config.functions << ",\"depth\":" << config.depth
+         << ",\"nesting\":" << config.nesting << ",\"iterations\":" << config.iterations
+         << ",\"input\":" << config.input
+         << ",\"source_bytes\":" << source.size() << ",\"tokens\":" << token_count
+         << ",\"ast_nodes\":" << node_count << "}";
+
+    json << ",\"frontend\":{\"lex_ms\":" << lex_ms
+         << ",\"lexer_mb_per_s\":" << (source.size() / 1e6) / (lex_ms / 1e3)
+         << ",\"parse_ms\":" << parse_ms
+         << ",\"parser_nodes_per_s\":" << node_count / (parse_ms / 1e3)
+         << ",\"codegen_ms\":" << codegen_ms
+         << ",\"codegen_functions_per_s\":" << function_count / (codegen_ms / 1e3) << "}";
+
+    // End to end: source text to object file
+    llvm::SmallString<128> obj_file;
+    if (llvm::sys::fs::createTemporaryFile("tuz_bench", "o", obj_file)) {
+      std::cerr << "Error: Could not create temporary file" << std::endl;
+      return 1;
+    }
+    json << ",\"compile\":[";
+    for (int opt_level = 0; opt_level <= 3; ++opt_level) {
+      double ms = time_best(config.iterations,
+                            [&] { compile_to_object(source, opt_level, obj_file.str().str()); });
+      uint64_t size = 0;
+      llvm::sys::fs::file_size(obj_file, size);
+      json << (opt_level ? "," : "") << "{\"opt_level\":" << opt_level << ",\"ms\":" << ms
+           << ",\"object_bytes\":" << size << "}";
+    }
+    json << "]";
+    llvm::sys::fs::remove(obj_file);
+
+    // Runtime kernels in the JIT; the time includes JIT compilation of the module
+    json << ",\"runtime\":[";
+    bool first = true;
+    for (const auto& kernel : config.kernels) {
+      std::string kernel_source;
+      if (!read_file(config.kernel_dir + "/" + kernel, kernel_source)) {
+        std::cerr << "Error: Could not open kernel: " << config.kernel_dir << "/" << kernel
+                  << std::endl;
+        return 1;
+      }
+      for (int opt_level = 0; opt_level <= 3; ++opt_level) {
+        int32_t result = 0;
+        double ms = time_best(config.iterations, [&] {
+          Lexer kernel_lexer(kernel_source);
+          Parser parser(kernel_lexer);
+          auto program = parser.parse_program();
+          CodeGenOptions options;
+          options.opt_level = opt_level;
+          CodeGenerator codegen(options);
+          codegen.generate(program);
+          codegen.optimize();
+          result = codegen.execute_jit("main", {kernel, std::to_string(config.input)});
+        });
+        json << (first ? "" : ",") << "{\"kernel\":\"" << kernel << "\",\"opt_level\":" << opt_level
+             << ",\"jit_run_ms\":" << ms << ",\"result\":" << result << "}";
+        first = false;
+      }
+    }
+    json << "]}\n";
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if (config.output.empty()) {
+    std::cout << json.str();
+  } else {
+    std::ofstream out(config.output);
+    out << json.str();
+    if (!out) {
+      std::cerr << "Error: Could not write " << config.output << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace tuz {
+
+// Bump-pointer arena: allocations are carved out of large blocks and released all at once
+// when the arena is destroyed. Individual allocations are never freed.
+class BumpAllocator {
+public:
+  explicit BumpAllocator(size_t block_size = 4096);
+
+  BumpAllocator(const BumpAllocator&) = delete;
+  BumpAllocator& operator=(const BumpAllocator&) = delete;
+  BumpAllocator(BumpAllocator&& other) noexcept;
+  BumpAllocator& operator=(BumpAllocator&& other) noexcept;
+
+  // Allocate uninitialized memory
+  void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+  // Copy a string into the arena and return a view of the copy
+  std::string_view copy_string(std::string_view text);
+
+  // Total bytes handed out (excluding block slack)
+  size_t bytes_allocated() const { return bytes_allocated_; }
+
+private:
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* current_ = nullptr;
+  char* end_ = nullptr;
+  size_t block_size_;
+  size_t bytes_allocated_ = 0;
+
+  void new_block(size_t min_size);
+};
+
+} // namespace tuz
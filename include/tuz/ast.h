@@ -1,13 +1,22 @@
 #pragma once
 
+#include "arena.h"
+#include "symbol.h"
+
 #include <memory>
+#include <new>
+#include <optional>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace tuz {
 
 // Forward declarations
 class Type;
+class StructType;
 using TypePtr = std::shared_ptr<Type>;
 
 // Forward declarations for AST nodes
@@ -15,9 +24,76 @@ struct Expr;
 struct Stmt;
 struct Decl;
 
-using ExprPtr = std::shared_ptr<Expr>;
-using StmtPtr = std::shared_ptr<Stmt>;
-using DeclPtr = std::shared_ptr<Decl>;
+// Nodes are owned by their ASTContext; links between them are non-owning
+using ExprPtr = Expr*;
+using StmtPtr = Stmt*;
+using DeclPtr = Decl*;
+
+// =============================================================================
+// AST Context
+// =============================================================================
+
+// Owns every node of a program. Nodes are bump-allocated and destroyed together with the
+// context in a single flat pass, so teardown never recurses through the tree.
+class ASTContext {
+public:
+  ASTContext() = default;
+  ASTContext(const ASTContext&) = delete;
+  ASTContext& operator=(const ASTContext&) = delete;
+  ~ASTContext();
+
+  template <typename T, typename... Args> T* create(Args&&... args) {
+    void* memory = arena_.allocate(sizeof(T), alignof(T));
+    T* node = new (memory) T(std::forward<Args>(args)...);
+    node_count_++;
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      destructors_.push_back({[](void* object) { static_cast<T*>(object)->~T(); }, node});
+    }
+    return node;
+  }
+
+  // Identifiers of this program
+  SymbolTable& symbols() { return symbols_; }
+
+  // The struct type this program means by a name; created without fields on first use, so
+  // types can be named before their declaration
+  std::shared_ptr<StructType> struct_type(const std::string& name);
+
+  // Bytes used by the nodes themselves
+  size_t bytes_allocated() const { return arena_.bytes_allocated(); }
+
+  size_t node_count() const { return node_count_; }
+
+private:
+  struct Destructor {
+    void (*destroy)(void*);
+    void* object;
+  };
+
+  BumpAllocator arena_{64 * 1024};
+  std::vector<Destructor> destructors_;
+  SymbolTable symbols_;
+  std::unordered_map<std::string, std::shared_ptr<StructType>> struct_types_;
+  size_t node_count_ = 0;
+};
+
+// =============================================================================
+// Name bindings
+// =============================================================================
+
+// What a name refers to, filled during resolution. The index is a local slot of the enclosing
+// function, or a position in the program's list of globals or functions.
+enum class BindingKind : uint8_t {
+  Unresolved,
+  Local,
+  Global,
+  Function,
+};
+
+struct Binding {
+  BindingKind kind = BindingKind::Unresolved;
+  uint32_t index = 0;
+};
 
 // =============================================================================
 // Expressions
@@ -73,6 +149,8 @@ struct StringLiteralExpr : Expr {
 
 struct VariableExpr : Expr {
   std::string name;
+  Symbol symbol = InvalidSymbol; // Filled by the parser
+  Binding binding;               // Filled during resolution
   VariableExpr(std::string n, uint32_t ln, uint32_t col)
       : Expr(ExprKind::Variable, ln, col), name(std::move(n)) {}
 };
@@ -118,9 +196,24 @@ struct UnaryOpExpr : Expr {
       : Expr(ExprKind::UnaryOp, ln, col), op(o), operand(std::move(expr)) {}
 };
 
+// Operations that look like calls but are lowered inline, resolved when no function of the
+// name exists
+enum class Builtin : uint8_t {
+  None,
+  VectorConstruct, // f32x4(a, b, c, d) builds the lanes, f32x4(x) splats x
+  Shuffle,         // shuffle(a, b, i0, i1, ...) picks lanes of a then b by constant index
+  Select,          // select(mask, a, b) picks lanes of a where mask is true, else of b
+  ReduceAdd,       // reduce_add(v) and friends combine the lanes of v
+  ReduceMul,
+  ReduceMin,
+  ReduceMax,
+  StructConstruct, // Point(x, y) sets the fields in order, Point() zeroes them
+};
+
 struct CallExpr : Expr {
   ExprPtr callee;
   std::vector<ExprPtr> arguments;
+  Builtin builtin = Builtin::None; // Filled during resolution
   CallExpr(ExprPtr c, std::vector<ExprPtr> args, uint32_t ln, uint32_t col)
       : Expr(ExprKind::Call, ln, col), callee(std::move(c)), arguments(std::move(args)) {}
 };
@@ -133,8 +226,9 @@ struct IndexExpr : Expr {
 };
 
 struct FieldAccessExpr : Expr {
-  ExprPtr object;
+  ExprPtr object; // A struct, or a pointer to one
   std::string field;
+  uint32_t field_index = 0; // Filled during resolution
   FieldAccessExpr(ExprPtr obj, std::string f, uint32_t ln, uint32_t col)
       : Expr(ExprKind::FieldAccess, ln, col), object(std::move(obj)), field(std::move(f)) {}
 };
@@ -146,6 +240,38 @@ struct CastExpr : Expr {
       : Expr(ExprKind::Cast, ln, col), target_type(std::move(t)), expr(std::move(e)) {}
 };
 
+// =============================================================================
+// Attributes
+// =============================================================================
+
+// `@name` or `@name(arg, key=value, ...)`; positional arguments have an empty key
+struct Attribute {
+  struct Argument {
+    std::string key;
+    std::string value;
+  };
+  std::string name;
+  std::vector<Argument> arguments;
+  uint32_t line;
+  uint32_t column;
+};
+
+// Loop attributes, lowered to llvm.loop metadata on the loop's back edge
+struct LoopHints {
+  std::optional<bool> vectorize; // @vectorize, @vectorize(disable)
+  uint32_t vectorize_width = 0;  // @vectorize(width=N)
+  uint32_t interleave_count = 0; // @vectorize(interleave=N)
+  std::optional<bool> unroll;    // @unroll, @unroll(disable)
+  uint32_t unroll_count = 0;     // @unroll(N)
+  bool unroll_full = false;      // @unroll(full)
+  bool parallel = false;         // @parallel: no memory dependences between iterations
+
+  bool empty() const {
+    return !vectorize && !vectorize_width && !interleave_count && !unroll && !unroll_count &&
+           !unroll_full && !parallel;
+  }
+};
+
 // =============================================================================
 // Statements
 // =============================================================================
@@ -181,6 +307,8 @@ struct LetStmt : Stmt {
   TypePtr declared_type;
   ExprPtr initializer;
   bool is_mutable;
+  Symbol symbol = InvalidSymbol; // Filled by the parser
+  uint32_t slot = 0;             // Local slot, filled during resolution
   LetStmt(std::string n, TypePtr t, ExprPtr init, bool mut, uint32_t ln, uint32_t col)
       : Stmt(StmtKind::Let, ln, col), name(std::move(n)), declared_type(std::move(t)),
         initializer(std::move(init)), is_mutable(mut) {}
@@ -211,6 +339,7 @@ struct IfStmt : Stmt {
 struct WhileStmt : Stmt {
   ExprPtr condition;
   StmtPtr body;
+  LoopHints hints;
   WhileStmt(ExprPtr cond, StmtPtr b, uint32_t ln, uint32_t col)
       : Stmt(StmtKind::While, ln, col), condition(std::move(cond)), body(std::move(b)) {}
 };
@@ -220,13 +349,19 @@ struct ForStmt : Stmt {
   ExprPtr range_start;
   ExprPtr range_end;
   StmtPtr body;
+  LoopHints hints;
+  Symbol var_symbol = InvalidSymbol; // Filled by the parser
+  uint32_t slot = 0;                 // Local slot, filled during resolution
+  TypePtr var_type; // Common integer type of the range, filled during resolution
+  bool var_address_taken = false; // The body applies '&' to the variable, filled likewise
   ForStmt(std::string var, ExprPtr start, ExprPtr end, StmtPtr b, uint32_t ln, uint32_t col)
       : Stmt(StmtKind::For, ln, col), var_name(std::move(var)), range_start(std::move(start)),
         range_end(std::move(end)), body(std::move(b)) {}
 };
 
 struct ReturnStmt : Stmt {
-  ExprPtr value; // Can be nullptr for void return
+  ExprPtr value;             // Can be nullptr for void return
+  bool is_tail_call = false; // 'become f(...)': the call must reuse the caller's frame
   ReturnStmt(ExprPtr val, uint32_t ln, uint32_t col)
       : Stmt(StmtKind::Return, ln, col), value(std::move(val)) {}
 };
@@ -246,6 +381,7 @@ struct Decl {
   std::string name;
   uint32_t line;
   uint32_t column;
+  Symbol symbol = InvalidSymbol; // Filled by the parser
 
   Decl(DeclKind k, std::string n, uint32_t ln, uint32_t col)
       : kind(k), name(std::move(n)), line(ln), column(col) {}
@@ -255,14 +391,22 @@ struct Decl {
 struct Param {
   std::string name;
   TypePtr type;
+  Symbol symbol = InvalidSymbol; // Filled by the parser; parameter i uses local slot i
   Param(std::string n, TypePtr t) : name(std::move(n)), type(std::move(t)) {}
 };
 
+// Inlining requested by 'inline' or '@noinline'
+enum class InlineHint { None, Inline, NoInline };
+
 struct FunctionDecl : Decl {
   std::vector<Param> params;
   TypePtr return_type;
   StmtPtr body; // BlockStmt, can be nullptr for extern
   bool is_extern;
+  bool is_export = false; // 'export fn': visible outside its module, like main and externs
+  InlineHint inline_hint = InlineHint::None;
+  uint32_t index = 0;       // Position among the program's functions, filled during resolution
+  uint32_t local_count = 0; // Parameters plus locals, filled during resolution
 
   FunctionDecl(std::string n, std::vector<Param> p, TypePtr ret, StmtPtr b, bool ext, uint32_t ln,
                uint32_t col)
@@ -278,6 +422,8 @@ struct Field {
 
 struct StructDecl : Decl {
   std::vector<Field> fields;
+  std::shared_ptr<StructType> type; // Defined from the fields during resolution
+  bool soa = false;                 // @soa
   StructDecl(std::string n, std::vector<Field> f, uint32_t ln, uint32_t col)
       : Decl(DeclKind::Struct, std::move(n), ln, col), fields(std::move(f)) {}
 };
@@ -286,6 +432,7 @@ struct GlobalDecl : Decl {
   TypePtr type;
   ExprPtr initializer;
   bool is_mutable;
+  uint32_t index = 0; // Position among the program's globals, filled during resolution
   GlobalDecl(std::string n, TypePtr t, ExprPtr init, bool mut, uint32_t ln, uint32_t col)
       : Decl(DeclKind::Global, std::move(n), ln, col), type(std::move(t)),
         initializer(std::move(init)), is_mutable(mut) {}
@@ -297,6 +444,8 @@ struct GlobalDecl : Decl {
 
 struct Program {
   std::vector<DeclPtr> declarations;
+  std::shared_ptr<ASTContext> context; // Owns the declarations and everything below them
+  bool is_resolved = false;            // Names bound and types filled in by the Resolver
 };
 
 // =============================================================================
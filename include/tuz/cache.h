@@ -0,0 +1,45 @@
+#pragma once
+
+#include "codegen.h"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tuz {
+
+// Content-addressed store of emitted object files. An entry is keyed on everything that
+// affects the generated code: the source text, the codegen options, the resolved target and
+// the compiler version, so a hit can skip the whole pipeline for an input.
+class ObjectCache {
+public:
+  explicit ObjectCache(std::string directory);
+
+  // $XDG_CACHE_HOME/tuz, falling back to ~/.cache/tuz
+  static std::string default_directory();
+
+  // Hex SHA-256 key for compiling source with options, either to a single object or split
+  // into codegen units. Throws CodeGenError when the target or the profile to use is invalid.
+  static std::string compute_key(std::string_view source, const CodeGenOptions& options,
+                                 bool split_units);
+
+  // Objects stored under key, in link order; counts a hit or a miss
+  std::optional<std::vector<std::string>> lookup(const std::string& key);
+
+  // Copy objects into the cache under key; returns false if the entry could not be written
+  bool store(const std::string& key, const std::vector<std::string>& objects);
+
+  const std::string& directory() const { return directory_; }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+private:
+  std::string directory_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+
+  std::string entry_path(const std::string& key, const std::string& suffix) const;
+};
+
+} // namespace tuz
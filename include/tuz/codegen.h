@@ -3,39 +3,137 @@
 #include "ast.h"
 #include "type.h"
 
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
+#include <llvm/Target/TargetMachine.h>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+namespace llvm {
+class raw_pwrite_stream;
+}
+
+namespace llvm::orc {
+class LLJIT;
+class LLJITBuilderState;
+} // namespace llvm::orc
+
 namespace tuz {
 
+class CompileStats;
+class ConstEvaluator;
+struct ConstValue;
+
+// Code generation options
+struct CodeGenOptions {
+  int opt_level = 0;         // 0-3
+  std::string target_triple; // Empty for the host triple
+  std::string cpu;           // Target CPU name, "native" for the host CPU; empty for generic
+  std::string features;      // Extra target features, e.g. "+avx2,-fma"
+
+  // Codegen unit this generator emits when a program is split across several modules. Each
+  // unit declares everything but defines only its share of the function bodies; globals are
+  // defined in unit 0.
+  unsigned unit_index = 0;
+  unsigned unit_count = 1;
+
+  // Incremental compilation (the REPL): the declarations before first_new_declaration were
+  // generated into earlier modules of the same JIT, so they are only declared here. Functions
+  // all stay external, for later modules to call.
+  bool incremental = false;
+  size_t first_new_declaration = 0;
+
+  // Profile-guided optimization. With profile_generate the module is instrumented to write a
+  // raw profile to profile_output when the program exits; profile_use names an indexed profile
+  // (llvm-profdata merge output) that steers inlining, block layout and branch weights.
+  bool profile_generate = false;
+  std::string profile_output; // Raw profile path, may contain %m/%p; empty for default.profraw
+  std::string profile_use;
+
+  // Optimize for a ThinLTO link (the pre-link pipeline) and write bitcode with a module summary
+  bool thin_lto = false;
+
+  // Check array indexes at run time, trapping when out of bounds; indexes proven in range at
+  // compile time are not checked
+  bool bounds_check = false;
+
+  // Emit DWARF: a compile unit for source_file, subprograms and source locations
+  bool debug_info = false;
+  std::string source_file; // Path of the source; empty for a program compiled from memory
+
+  // Receives per-pass timings from optimize() when set
+  CompileStats* stats = nullptr;
+};
+
+// Target selection resolved from the options
+struct TargetSelection {
+  std::string triple;
+  std::string cpu;      // "native" expanded to the host CPU
+  std::string features; // Host features for "native", then the explicit ones
+};
+
+// Throws CodeGenError when -mcpu=native is used for a different architecture
+TargetSelection select_target(const CodeGenOptions& options);
+
+// Backend optimization level for an -O level
+llvm::CodeGenOptLevel get_codegen_opt_level(int opt_level);
+
+// Set up a JIT for code generated with the given options. With debug_info the jitted code is
+// registered with gdb and, when LLVM is built with perf support, written to a perf jitdump.
+void configure_jit(llvm::orc::LLJITBuilderState& builder, const CodeGenOptions& options);
+
 class CodeGenerator : public ASTVisitor {
 public:
-  CodeGenerator();
+  explicit CodeGenerator(CodeGenOptions options = {});
+  // Generate into a context owned by the caller, which must outlive the generator and the
+  // module; such a generator cannot execute_jit
+  CodeGenerator(CodeGenOptions options, llvm::LLVMContext& context);
+  ~CodeGenerator() override;
 
-  // Generate LLVM IR for a complete program
+  // Resolve names (unless already resolved) and generate LLVM IR for a complete program, or for
+  // this generator's codegen unit of it. A resolved program can be shared by generators running
+  // on different threads.
   void generate(Program& program);
 
+  // Fold constants with an evaluator kept across the modules of an incremental program, so the
+  // values of earlier globals and calls are not computed again. Call before generate.
+  void share_constants(std::shared_ptr<ConstEvaluator> constants);
+
+  // Run the LLVM optimization pipeline selected by opt_level on the module
+  void optimize();
+
   // Get the generated module (ownership transferred to caller)
   std::unique_ptr<llvm::Module> get_module();
 
-  // Compile and execute JIT (for REPL)
-  int32_t execute_jit(const std::string& entry_function = "main");
+  // Compile the module in memory and run the entry function (for REPL/--run).
+  // If the entry function takes (argc, argv), args supplies argv; args[0] is the program name.
+  // The module is handed over to the JIT, so this can be called only once.
+  int32_t execute_jit(const std::string& entry_function = "main",
+                      const std::vector<std::string>& args = {});
 
-  // Write LLVM IR to file
+  // Write LLVM IR to file; throws CodeGenError if it cannot be opened
   void dump_ir(const std::string& filename);
 
-  // Compile to object file
+  // Compile to object file; throws CodeGenError if it cannot be opened or emitted
   void compile_to_object(const std::string& filename);
 
+  // Compile to an object in memory, appended to object
+  void compile_to_buffer(llvm::SmallVectorImpl<char>& object);
+
+  // Write the module as bitcode, with a ThinLTO summary when thin_lto is set; throws
+  // CodeGenError if the file cannot be opened
+  void compile_to_bitcode(const std::string& filename);
+
   // Expressions
   void visit(IntegerLiteralExpr& expr) override;
   void visit(FloatLiteralExpr& expr) override;
@@ -65,29 +163,72 @@ public:
   void visit(GlobalDecl& decl) override;
 
 private:
-  // LLVM context and module
-  std::unique_ptr<llvm::LLVMContext> context_;
+  CodeGenerator(CodeGenOptions options, std::unique_ptr<llvm::LLVMContext> owned,
+                llvm::LLVMContext* context = nullptr);
+
+  CodeGenOptions options_;
+
+  // LLVM context (owned unless supplied by the caller) and module
+  std::unique_ptr<llvm::LLVMContext> owned_context_;
+  llvm::LLVMContext* context_;
   std::unique_ptr<llvm::Module> module_;
   std::unique_ptr<llvm::IRBuilder<>> builder_;
 
+  // Target selection resolved from the options ("native" expanded to the host CPU)
+  std::string target_triple_;
+  std::string target_cpu_;
+  std::string target_features_;
+
+  // Target machine, taken from a process-wide pool (or created) on first use and returned to
+  // the pool by the destructor
+  std::unique_ptr<llvm::TargetMachine> target_machine_;
+  std::string target_machine_key() const;
+
+  // JIT that owns the module after execute_jit
+  std::unique_ptr<llvm::orc::LLJIT> jit_;
+
   // Value stack for expression results
   std::vector<llvm::Value*> value_stack_;
 
-  // Variable info including mutability
-  struct VariableInfo {
-    llvm::Value* value;
-    bool is_mutable;
-  };
+  // Storage of the current function's parameters and locals, indexed by resolved slot
+  std::vector<llvm::AllocaInst*> locals_;
+
+  // Globals and functions, indexed as numbered by the resolver
+  std::vector<llvm::GlobalVariable*> globals_;
+  std::vector<llvm::Function*> functions_;
 
-  // Named values (variables) - maps name to variable info
-  std::vector<std::unordered_map<std::string, VariableInfo>> named_values_;
+  // Globals numbered below this are defined by an earlier module (incremental compilation)
+  uint32_t first_new_global_ = 0;
 
-  // Function and struct definitions
-  std::unordered_map<std::string, llvm::Function*> functions_;
-  std::unordered_map<std::string, llvm::StructType*> struct_types_;
+  // LLVM types are tied to context_, so the cache lives here rather than on the shared Type
+  std::unordered_map<const Type*, llvm::Type*> llvm_types_;
 
-  // Current function (for return statements)
+  // Compile-time values of constant expressions, immutable globals and pure calls
+  std::shared_ptr<ConstEvaluator> constants_;
+
+  // Current function and its declared return type (for return statements)
   llvm::Function* current_function_;
+  TypePtr current_return_type_;
+
+  // Declarations of the functions in functions_, for the parameter types of calls
+  std::vector<FunctionDecl*> function_decls_;
+
+  // Inclusive bounds of the values an integer expression can take
+  struct IndexRange {
+    int64_t low;
+    int64_t high;
+  };
+
+  // Ranges of the for-loop variables in scope, by local slot, and the block the current
+  // function's failed bounds checks branch to (with bounds_check)
+  std::unordered_map<uint32_t, IndexRange> loop_ranges_;
+  llvm::BasicBlock* bounds_trap_ = nullptr;
+
+  // Debug info (with debug_info): the compile unit's builder and file, and the subprogram of
+  // the current function
+  std::unique_ptr<llvm::DIBuilder> di_builder_;
+  llvm::DIFile* di_file_ = nullptr;
+  llvm::DISubprogram* di_subprogram_ = nullptr;
 
   // Break/continue target blocks (for loops)
   struct LoopTargets {
@@ -100,24 +241,53 @@ private:
   llvm::Value* pop_value();
   void push_value(llvm::Value* val);
 
-  // Type conversion
-  llvm::Type* convert_type(TypePtr type);
+  // Create the target machine and set the module triple and data layout
+  llvm::TargetMachine* get_target_machine();
+
+  // Run the backend over the module, writing an object file to dest
+  void emit_object(llvm::raw_pwrite_stream& dest);
+
+  // Type conversion, memoized per interned type
+  llvm::Type* convert_type(const TypePtr& type);
+  llvm::Type* convert_type_uncached(const Type& type);
+
+  // Storage of a resolved variable and the type stored there
+  llvm::Value* get_variable(const VariableExpr& expr, llvm::Type*& type);
+
+  // Storage designated by a variable, field, element or dereference. An element of a @soa array
+  // has no address of its own: its fields sit at soa_index in each field array of the array at
+  // address.
+  struct Place {
+    llvm::Value* address = nullptr;
+    llvm::Type* type = nullptr; // Type stored at address
+    llvm::Value* soa_index = nullptr;
+  };
+  Place codegen_place(Expr& expr);
+  llvm::Value* load_place(const Place& place, llvm::Type* type);
+
+  // Trap unless position, the 64-bit value of index's subscript, is below size. Emits nothing
+  // when the subscript's range is known to be in bounds.
+  void check_index(const IndexExpr& index, llvm::Value* position, size_t size);
+  std::optional<IndexRange> index_range(const Expr& expr);
+  void store_place(const Place& place, llvm::Value* value);
 
-  // Variable management
-  llvm::Value* get_variable(const std::string& name);
-  bool is_variable_mutable(const std::string& name);
-  void set_variable(const std::string& name, llvm::Value* alloca, bool is_mutable = false);
-  void enter_scope();
-  void exit_scope();
+  // Convert a value of the given source type to another type (integer widths, int/float).
+  // Integers widen and convert to floats by the source's signedness; floats convert to
+  // integers by the target's, and targets given only as an LLVM type count as signed.
+  llvm::Value* coerce(llvm::Value* value, const TypePtr& from, const TypePtr& to);
+  llvm::Value* coerce(llvm::Value* value, const TypePtr& from, llvm::Type* to,
+                      bool to_unsigned = false);
 
-  // Expression code generation (returns Value*)
+  // Expression code generation (returns Value*); constant expressions fold to an llvm::Constant
   llvm::Value* codegen_expr(Expr& expr);
+  llvm::Constant* codegen_constant(const ConstValue& value);
   llvm::Value* codegen_integer_literal(int64_t value, TypePtr type);
   llvm::Value* codegen_float_literal(double value, TypePtr type);
   llvm::Value* codegen_bool_literal(bool value);
   llvm::Value* codegen_binary_op(BinaryOp op, llvm::Value* left, llvm::Value* right,
-                                 TypePtr result_type);
+                                 bool is_signed);
   llvm::Value* codegen_unary_op(UnaryOp op, llvm::Value* operand, TypePtr result_type);
+  llvm::Value* codegen_builtin(CallExpr& expr);
 
   // Statement code generation
   void codegen_stmt(Stmt& stmt);
@@ -125,16 +295,20 @@ private:
   // Declaration code generation
   void codegen_decl(Decl& decl);
 
-  // Function two-phase generation (for forward references)
+  // Function two-phase generation (for forward references); expects resolved declarations
   void declare_function(FunctionDecl& decl);
   void generate_function_body(FunctionDecl& decl);
 
+  // Lower loop hints to llvm.loop metadata on the back edge of the loop entered at header
+  void attach_loop_hints(const LoopHints& hints, llvm::BranchInst* back_edge,
+                         llvm::BasicBlock* header, llvm::BasicBlock* body);
+
+  // Debug info type of a tuz type, and the location of instructions generated from here on
+  llvm::DIType* debug_type(const TypePtr& type);
+  void set_debug_location(uint32_t line, uint32_t column);
+
   // Create entry block alloca
   llvm::AllocaInst* create_alloca(llvm::Type* type, const std::string& name);
-
-  // Get pointer to element (for array/struct access)
-  llvm::Value* get_element_ptr(llvm::Value* ptr, const std::vector<llvm::Value*>& indices,
-                               llvm::Type* elem_type);
 };
 
 } // namespace tuz
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "ast.h"
+#include "type.h"
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace tuz {
+
+// A compile-time scalar: an integer, boolean or floating-point value of a resolved type
+struct ConstValue {
+  TypePtr type;
+  int64_t integer = 0; // Integers and booleans, sign- or zero-extended from the type's width
+  double real = 0;     // Floating point; f32 values are kept rounded to float
+
+  bool is_floating_point() const { return type->is_floating_point(); }
+
+  // Wraps value to the width of an integer or boolean type
+  static ConstValue of_integer(const TypePtr& type, int64_t value);
+  // Rounds value to the precision of a floating-point type
+  static ConstValue of_real(const TypePtr& type, double value);
+  static ConstValue of_bool(bool value);
+};
+
+// Evaluates expressions of a resolved program at compile time, with the same semantics as the
+// generated code: arithmetic wraps to the operand width, conversions follow codegen's implicit
+// coercions and explicit casts. Immutable globals are constants, and calls to functions that
+// only compute on their arguments and locals are interpreted. Anything that would read memory,
+// call an extern, write a global, trap or take too long is not constant. Interpreted calls
+// share one step budget per module, so a module costs a bounded amount of folding however
+// many call sites it has, and each distinct call is interpreted once.
+class ConstEvaluator {
+public:
+  // Globals and functions indexed as numbered by the resolver
+  ConstEvaluator(std::vector<GlobalDecl*> globals, std::vector<FunctionDecl*> functions);
+
+  // Take on the declarations of the next module of an incremental program (the REPL): the
+  // globals and functions from the given indexes on replace any this evaluator had there, and
+  // the values of the earlier ones are kept. The new module gets a step budget of its own.
+  void add_declarations(const std::vector<GlobalDecl*>& globals,
+                        const std::vector<FunctionDecl*>& functions, uint32_t first_global,
+                        uint32_t first_function);
+
+  // Value of an expression outside any function, or nullopt if it is not a constant.
+  // Results are memoized per expression, so evaluating a tree top-down stays linear.
+  std::optional<ConstValue> evaluate(const Expr& expr);
+
+  // Value of a global's initializer converted to the global's type; zero without initializer
+  std::optional<ConstValue> global_value(uint32_t index);
+
+  // Type a global is stored as: declared, else inferred from the initializer, else i32
+  static TypePtr global_type(const GlobalDecl& decl);
+
+private:
+  // Locals of one interpreted call, indexed by resolved slot
+  struct Frame {
+    struct Local {
+      TypePtr type;
+      std::optional<ConstValue> value; // Unset until initialized
+    };
+    std::vector<Local> locals;
+    TypePtr return_type;
+    std::optional<ConstValue> return_value;
+  };
+
+  enum class Flow : uint8_t {
+    Normal,
+    Return,
+    Fail,
+  };
+
+  enum class GlobalState : uint8_t {
+    Pending,
+    InProgress, // Evaluating; a reference back to it is a cycle
+    Done,
+  };
+
+  std::vector<GlobalDecl*> globals_;
+  std::vector<FunctionDecl*> functions_;
+  std::vector<GlobalState> global_states_;
+  std::vector<std::optional<ConstValue>> global_values_;
+
+  // Results of expressions evaluated outside any function
+  std::unordered_map<const Expr*, std::optional<ConstValue>> memo_;
+
+  // A call by callee and the bits of its converted arguments
+  struct CallKey {
+    const FunctionDecl* function;
+    std::vector<uint64_t> arguments;
+    bool operator==(const CallKey& other) const = default;
+  };
+  struct CallKeyHash {
+    size_t operator()(const CallKey& key) const;
+  };
+
+  // Results of interpreted calls, failures included
+  std::unordered_map<CallKey, std::optional<ConstValue>, CallKeyHash> calls_;
+
+  uint64_t steps_ = 0; // Spent interpreting the module's calls; bounded by MaxSteps
+  unsigned call_depth_ = 0;
+
+  std::optional<ConstValue> eval(const Expr& expr, Frame* frame);
+  std::optional<ConstValue> eval_uncached(const Expr& expr, Frame* frame);
+  std::optional<ConstValue> eval_binary(const BinaryOpExpr& expr, Frame* frame);
+  std::optional<ConstValue> eval_unary(const UnaryOpExpr& expr, Frame* frame);
+  std::optional<ConstValue> eval_call(const CallExpr& expr, Frame* frame);
+  std::optional<ConstValue> eval_cast(const CastExpr& expr, Frame* frame);
+  std::optional<ConstValue> eval_variable(const VariableExpr& expr, Frame* frame);
+
+  std::optional<ConstValue> eval_global(uint32_t index);
+  Flow exec(const Stmt& stmt, Frame& frame);
+  bool step();
+};
+
+} // namespace tuz
@@ -3,8 +3,10 @@
 #include <cstdint>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -32,22 +34,37 @@ struct SourceLocation {
 class SourceFile {
 public:
   SourceFile(std::string path, std::string content);
+  ~SourceFile();
+
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+
+  // Map a file read-only (small or special files are read instead); nullptr if it cannot be read
+  static std::shared_ptr<SourceFile> open(const std::string& path);
 
   const std::string& path() const { return path_; }
-  const std::string& content() const { return content_; }
+  std::string_view content() const { return content_; }
 
-  // Get a specific line (1-indexed)
-  std::string get_line(uint32_t line_num) const;
+  // Get a specific line (1-indexed), without its line ending; a view into content()
+  std::string_view get_line(uint32_t line_num) const;
 
   // Get line count
-  uint32_t line_count() const { return static_cast<uint32_t>(line_offsets_.size()); }
+  uint32_t line_count() const { return static_cast<uint32_t>(line_offsets().size()); }
 
 private:
+  SourceFile() = default;
+
   std::string path_;
-  std::string content_;
-  std::vector<size_t> line_offsets_; // Offset of each line start
+  std::string owned_;           // Content read into memory
+  void* mapping_ = nullptr;     // Content mapped from the file
+  size_t mapping_size_ = 0;
+  std::string_view content_;    // Either of the above
 
-  void compute_line_offsets();
+  // Offset of each line start, computed when first needed (only diagnostics ask for lines)
+  mutable std::once_flag line_offsets_once_;
+  mutable std::vector<size_t> line_offsets_;
+
+  const std::vector<size_t>& line_offsets() const;
 };
 
 // =============================================================================
@@ -116,7 +133,8 @@ public:
 
 class ConsoleDiagnosticConsumer : public DiagnosticConsumer {
 public:
-  ConsoleDiagnosticConsumer(bool use_colors = true, bool show_source_context = true);
+  ConsoleDiagnosticConsumer(bool use_colors = true, bool show_source_context = true,
+                            std::ostream& out = std::cerr);
 
   void consume(const DiagnosticMessage& diagnostic) override;
   bool has_errors() const override { return error_count_ > 0; }
@@ -126,6 +144,7 @@ public:
   uint32_t warning_count() const { return warning_count_; }
 
 private:
+  std::ostream& out_;
   bool use_colors_;
   bool show_source_context_;
   uint32_t error_count_ = 0;
@@ -139,6 +158,50 @@ private:
   void print_message(const DiagnosticMessage& msg, bool is_note = false);
 };
 
+// =============================================================================
+// Buffered Diagnostic Consumer
+// =============================================================================
+
+// Collects diagnostics instead of printing them, so a worker thread can report without
+// touching shared state; flush_diagnostics hands them on once the workers are done
+class BufferedDiagnosticConsumer : public DiagnosticConsumer {
+public:
+  void consume(const DiagnosticMessage& diagnostic) override;
+  bool has_errors() const override { return error_count_ > 0; }
+  void reset() override;
+
+  const std::vector<DiagnosticMessage>& diagnostics() const { return diagnostics_; }
+
+private:
+  std::vector<DiagnosticMessage> diagnostics_;
+  uint32_t error_count_ = 0;
+};
+
+// Pass the diagnostics of several buffers to target ordered by file, then line. Diagnostics on
+// the same line keep the order of the buffers and then of their reports, so the output does not
+// depend on which thread finished first. The buffers are cleared.
+void flush_diagnostics(const std::vector<BufferedDiagnosticConsumer*>& buffers,
+                       DiagnosticConsumer& target);
+
+// =============================================================================
+// JSON Diagnostic Consumer
+// =============================================================================
+
+// Writes one JSON object per diagnostic and line, for tools:
+// {"level":"error","file":"a.tz","line":2,"column":10,"length":1,"message":"...","notes":[...]}
+class JsonDiagnosticConsumer : public DiagnosticConsumer {
+public:
+  explicit JsonDiagnosticConsumer(std::ostream& out) : out_(out) {}
+
+  void consume(const DiagnosticMessage& diagnostic) override;
+  bool has_errors() const override { return error_count_ > 0; }
+  void reset() override { error_count_ = 0; }
+
+private:
+  std::ostream& out_;
+  uint32_t error_count_ = 0;
+};
+
 // =============================================================================
 // Diagnostic Engine
 // =============================================================================
@@ -206,6 +269,21 @@ private:
 // Global diagnostic instance (for convenience)
 // =============================================================================
 
+// The engine of the innermost DiagnosticScope on this thread, or the process-wide one
 DiagnosticEngine& get_global_diagnostics();
 
+// Routes get_global_diagnostics() on the current thread to engine while in scope, e.g. to a
+// per-worker engine with a BufferedDiagnosticConsumer
+class DiagnosticScope {
+public:
+  explicit DiagnosticScope(DiagnosticEngine& engine);
+  ~DiagnosticScope();
+
+  DiagnosticScope(const DiagnosticScope&) = delete;
+  DiagnosticScope& operator=(const DiagnosticScope&) = delete;
+
+private:
+  DiagnosticEngine* previous_;
+};
+
 } // namespace tuz
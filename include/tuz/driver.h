@@ -1,35 +1,119 @@
 #pragma once
 
+#include <iosfwd>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 namespace tuz {
 
+class CodeGenerator;
+class CompileStats;
+
 // Compiler options
 struct CompileOptions {
-  std::string input_file;
+  std::vector<std::string> input_files; // Compiled separately and linked together
   std::string output_file = "a.out";
   bool emit_llvm = false;
   bool emit_object = false;
+  bool emit_bitcode = false; // -emit-bc
+  bool thin_lto = false;     // -flto=thin: bitcode objects, optimized again across files at link
   bool optimize = false;
   int opt_level = 0; // 0-3
   bool verbose = false;
+  bool debug_info = false; // -g: DWARF for the program, gdb and perf see code jitted by --run
+  bool bounds_check = false; // -fbounds-check: trap on array indexes out of bounds
   std::vector<std::string> library_paths;
   std::vector<std::string> libraries;
-  std::string target_triple;
+  std::string linker; // "lld" (in process) or "clang"; empty picks lld when available
+  std::string target_triple;   // --target=<triple>
+  std::string target_cpu;      // -mcpu=<name>, "native" for the host CPU
+  std::string target_features; // -mattr=<+feature,-feature,...>
+  bool run_jit = false;                  // --run: execute main in the JIT
+  std::vector<std::string> program_args; // Arguments passed to main with --run
+  bool repl = false; // --repl: evaluate inputs from stdin, after loading the input files
+  int jobs = 0; // -j <n>: codegen threads when linking; 0 or 1 builds a single module
+  std::string cache_dir; // --cache/--cache-dir: object cache directory; empty disables it
+  std::string stats_format; // -ftime-report ("text") or --stats=<text|json>; empty disables it
+  bool diagnostics_json = false; // -fdiagnostics-format=json: one JSON object per line on stderr
+  bool profile_generate = false; // -fprofile-generate[=<dir>]: instrument and link the runtime
+  std::string profile_dir;       // Where instrumented programs write their raw profiles
+  std::string profile_use;       // -fprofile-use=<file.profdata>
+  std::string serve_socket;  // --serve=<socket>: run a compile server listening on the socket
+  std::string server_socket; // --server=<socket>: compile on the server there, if it is running
 };
 
 class Driver {
 public:
-  // Compile a source file to an executable
+  // Compile source files to an executable, or each to IR or an object file with -S/-c
   static bool compile(const CompileOptions& options);
 
+  // Compile the first source file in memory and run its main function; returns main's exit code
+  static int execute(const CompileOptions& options);
+
   // Run the compiler with command line arguments
   static int run(int argc, char** argv);
 
+  // Parse command line arguments (without the program name); returns an exit code when there
+  // is nothing left to do (--help, or an error that has been reported)
+  static std::optional<int> parse_args(const std::vector<std::string>& args,
+                                       CompileOptions& options);
+
+  // Serve, run in the JIT or compile, as the options say
+  static int run(const CompileOptions& options);
+
+  // Handle a compile server request: parse args as tuzc would, resolve relative paths against
+  // cwd and compile, writing what tuzc would print to output and errors. Requests may run
+  // concurrently on different threads.
+  static int run_request(const std::vector<std::string>& args, const std::string& cwd,
+                         std::ostream& output, std::ostream& errors);
+
 private:
-  // Helper to link object files
-  static bool link_object(const std::string& obj_file, const CompileOptions& options);
+  // Run a compile server until the process is stopped
+  static int serve(const CompileOptions& options);
+
+  // Load the input files into a REPL and evaluate inputs from stdin until it ends
+  static int repl(const CompileOptions& options);
+
+  // Upper bound on the codegen units a program is split into by emit_parallel
+  static constexpr size_t MaxCodeGenUnits = 16;
+
+  // Compile every input; phases are recorded in stats when it is not null
+  static bool compile_inputs(const CompileOptions& options, CompileStats* stats);
+
+  // Lex, parse, generate and optimize one input; returns nullptr after reporting errors
+  static std::unique_ptr<CodeGenerator> build(const CompileOptions& options,
+                                              const std::string& input, CompileStats* stats);
+
+  // Whether inputs are split into codegen units (-j when linking)
+  static bool splits_units(const CompileOptions& options);
+
+  // Emit the object files for one input to temporary files appended to obj_files; returns
+  // false after reporting errors. Files already appended are left for the caller to remove.
+  static bool emit_objects(const CompileOptions& options, const std::string& input,
+                           std::vector<std::string>& obj_files, CompileStats* stats);
+
+  // Generate, optimize and emit the codegen units of one input on options.jobs threads
+  static bool emit_parallel(const CompileOptions& options, const std::string& input,
+                            std::vector<std::string>& obj_files, CompileStats* stats);
+
+  enum class LinkResult { Success, Failed, Unavailable };
+
+  // Run the ThinLTO backends over bitcode objects, appending the native objects to
+  // native_files; returns false after reporting errors
+  static bool thin_link(const std::vector<std::string>& bitcode_files,
+                        const CompileOptions& options, std::vector<std::string>& native_files);
+
+  // Helper to link object files; tries lld in process, then the clang driver
+  static bool link_object(const std::vector<std::string>& obj_files,
+                          const CompileOptions& options);
+#ifdef TUZ_HAVE_LLD
+  static LinkResult link_with_lld(const std::vector<std::string>& obj_files,
+                                  const CompileOptions& options);
+#endif
+  static LinkResult link_with_clang(const std::vector<std::string>& obj_files,
+                                    const CompileOptions& options);
 };
 
 } // namespace tuz
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "arena.h"
 #include "token.h"
 
 #include <functional>
@@ -9,7 +10,14 @@
 
 namespace tuz {
 
-using LexPredicate = bool (*)(char);
+// Character classes of the ASCII lookup table, combined as bit masks
+enum CharClass : uint8_t {
+  CHAR_ALPHA = 1 << 0,
+  CHAR_DIGIT = 1 << 1,
+  CHAR_IDENTIFIER_START = 1 << 2,
+  CHAR_IDENTIFIER = 1 << 3,
+  CHAR_WHITESPACE = 1 << 4,
+};
 
 class Lexer {
 public:
@@ -32,8 +40,12 @@ public:
     return '\0';
   }
 
+  // Bytes used by decoded string literals
+  size_t bytes_allocated() const { return string_arena_.bytes_allocated(); }
+
 private:
   std::string_view source_;
+  BumpAllocator string_arena_; // Decoded payloads of escaped string literals
   size_t position_;
   uint32_t line_;
   uint32_t column_;
@@ -50,18 +62,15 @@ private:
   Token string();
 
   bool try_consume(std::string_view value);
-  void advance_while(LexPredicate predicate);
+  void advance_while(uint8_t char_class);
   bool advance_if(std::string_view chars);
   bool is_at_end();
 
   Location current_location() const;
 
-  static bool is_alpha(char c);
+  static bool has_class(char c, uint8_t char_class);
   static bool is_digit(char c);
-  static bool is_alphanumeric(char c);
   static bool is_identifier_start(char c);
-  static bool is_identifier(char c);
-  static bool is_whitespace(char c);
   static bool is_string_start(char c);
 };
 
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "codegen.h"
+
+#include <string>
+#include <vector>
+
+namespace tuz {
+
+struct ThinLinkOptions {
+  unsigned threads = 0;  // Parallel ThinLTO backends; 0 uses every core
+  std::string cache_dir; // Backend outputs are cached here when set
+};
+
+// Link bitcode objects written with thin_lto: the thin link imports functions across modules
+// from their summaries, then each module is optimized and compiled by its own backend. The
+// native objects are written to temporary files appended to objects, in module order; files
+// already appended are left for the caller to remove when this throws CodeGenError.
+void run_thin_lto(const std::vector<std::string>& inputs, const CodeGenOptions& options,
+                  const ThinLinkOptions& link_options, std::vector<std::string>& objects);
+
+} // namespace tuz
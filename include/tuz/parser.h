@@ -1,9 +1,11 @@
 #pragma once
 
 #include "ast.h"
+#include "lexer.h"
 #include "token.h"
 #include "type.h"
 
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -21,7 +23,12 @@ public:
 
 class Parser {
 public:
-  explicit Parser(std::vector<Token> tokens);
+  // Nodes are allocated in the given context, or in a fresh one owned by the parser
+  explicit Parser(std::vector<Token> tokens, std::shared_ptr<ASTContext> context = nullptr);
+
+  // Pull tokens from the lexer on demand, keeping only a small lookahead window in memory.
+  // The lexer must outlive the parser.
+  explicit Parser(Lexer& lexer, std::shared_ptr<ASTContext> context = nullptr);
 
   // Parse a complete program
   Program parse_program();
@@ -32,11 +39,30 @@ public:
   ExprPtr parse_expression();
   TypePtr parse_type_annotation();
 
+  // Parse statements up to the end of the input (for the REPL)
+  std::vector<StmtPtr> parse_statements();
+
+  // Context owning the nodes produced by this parser
+  const std::shared_ptr<ASTContext>& context() const { return context_; }
+
+  // Number of tokens read so far (all of them once parsing has finished)
+  size_t token_count() const { return lexer_ ? filled_ : tokens_.size(); }
+
 private:
+  // Streaming window size; must be a power of two and cover previous() plus the deepest peek()
+  static constexpr size_t LookaheadCapacity = 8;
+
+  // Either the complete token list, or a ring buffer over the lexer's output addressed by
+  // absolute token index
   std::vector<Token> tokens_;
+  Lexer* lexer_ = nullptr;
+  std::shared_ptr<ASTContext> context_;
   size_t position_;
+  size_t filled_ = 0;
+  bool lexed_eof_ = false;
 
   // Token access
+  Token& token_at(size_t index);
   Token& current();
   Token& peek(size_t offset = 0);
   Token& previous();
@@ -49,6 +75,9 @@ private:
   bool match(std::initializer_list<TokenType> types);
   bool check(TokenType type);
 
+  // Intern an identifier in the context's symbol table
+  Symbol intern(std::string_view name);
+
   // Error handling
   ParseError error(const std::string& message);
   ParseError error(const Token& token, const std::string& message);
@@ -59,8 +88,10 @@ private:
   // Declarations
   DeclPtr parse_extern_decl();
   DeclPtr parse_function_decl();
+  DeclPtr parse_qualified_function_decl();
   DeclPtr parse_struct_decl();
   DeclPtr parse_global_decl();
+  DeclPtr parse_attributed_decl();
 
   // Statements
   StmtPtr parse_stmt();
@@ -72,6 +103,12 @@ private:
   StmtPtr parse_while_stmt();
   StmtPtr parse_for_stmt();
   StmtPtr parse_return_stmt();
+  StmtPtr parse_become_stmt();
+  StmtPtr parse_attributed_stmt();
+
+  // Attributes
+  std::vector<Attribute> parse_attributes();
+  static LoopHints loop_hints(const std::vector<Attribute>& attributes);
 
   // Expressions - using Pratt parser / precedence climbing
   ExprPtr parse_expr();
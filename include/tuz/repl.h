@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ast.h"
+#include "codegen.h"
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace llvm::orc {
+class LLLazyJIT;
+class ThreadSafeContext;
+} // namespace llvm::orc
+
+namespace tuz {
+
+class Resolver;
+
+// Interactive session behind tuzc --repl. Each input becomes a small module of its own in one
+// persistent JIT: declarations stay callable from later inputs without being compiled again,
+// and functions are compiled lazily, on their first call.
+class Repl {
+public:
+  explicit Repl(CodeGenOptions options = {});
+  ~Repl();
+
+  Repl(const Repl&) = delete;
+  Repl& operator=(const Repl&) = delete;
+
+  // Evaluate one input: declarations (fn, struct, extern, a let on its own, which defines a
+  // global with a constant initializer) are added to the session; anything else runs as
+  // statements, and the value of a trailing expression is returned as text. Throws ParseError
+  // or CodeGenError, leaving the session as it was.
+  std::string evaluate(std::string_view input);
+
+  // Read inputs from in until it ends or ':quit', printing values to out and errors to err.
+  // An input continues over several lines while its brackets are open. Returns 0.
+  int run(std::istream& in, std::ostream& out, std::ostream& err);
+
+private:
+  CodeGenOptions options_;
+
+  // Every declaration so far, in one AST context
+  std::shared_ptr<ASTContext> ast_;
+  Program program_;
+
+  // Top-level names bound so far, so each input resolves only its own declarations, and the
+  // compile-time values of the session's globals and calls
+  std::unique_ptr<Resolver> resolver_;
+  std::shared_ptr<ConstEvaluator> constants_;
+
+  std::unique_ptr<llvm::orc::ThreadSafeContext> context_;
+  std::unique_ptr<llvm::orc::LLLazyJIT> jit_; // Created by the first input
+  unsigned evaluated_ = 0;
+
+  // Generate the declarations from first_new on and hand them to the JIT
+  void add_module(size_t first_new);
+
+  // Address of a function the JIT has been given
+  void* lookup(const std::string& name);
+};
+
+} // namespace tuz
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "ast.h"
+#include "type.h"
+
+#include <vector>
+
+namespace tuz {
+
+// Binds every name in a program to a local slot, global or function, and fills in the type
+// of each expression. Scopes are a flat per-symbol binding array plus an undo log, so a
+// lookup is one array access and leaving a scope only restores what it shadowed.
+// Throws CodeGenError for names that do not resolve.
+class Resolver : public ASTVisitor {
+public:
+  explicit Resolver(SymbolTable& symbols);
+
+  // Functions and globals are numbered in declaration order
+  void resolve(Program& program);
+
+  // Resolve the declarations from first_new on against the top-level names of the earlier ones,
+  // which earlier calls on this resolver bound (an incremental program, the REPL). On error the
+  // new declarations are forgotten again before it is thrown.
+  void resolve(Program& program, size_t first_new);
+
+  // Unbind the top-level names of the declarations from first on, which the program is about
+  // to drop
+  void forget(const Program& program, size_t first);
+
+  // Expressions
+  void visit(IntegerLiteralExpr& expr) override;
+  void visit(FloatLiteralExpr& expr) override;
+  void visit(BoolLiteralExpr& expr) override;
+  void visit(StringLiteralExpr& expr) override;
+  void visit(VariableExpr& expr) override;
+  void visit(BinaryOpExpr& expr) override;
+  void visit(UnaryOpExpr& expr) override;
+  void visit(CallExpr& expr) override;
+  void visit(IndexExpr& expr) override;
+  void visit(FieldAccessExpr& expr) override;
+  void visit(CastExpr& expr) override;
+
+  // Statements
+  void visit(ExprStmt& stmt) override;
+  void visit(LetStmt& stmt) override;
+  void visit(AssignStmt& stmt) override;
+  void visit(BlockStmt& stmt) override;
+  void visit(IfStmt& stmt) override;
+  void visit(WhileStmt& stmt) override;
+  void visit(ForStmt& stmt) override;
+  void visit(ReturnStmt& stmt) override;
+
+  // Declarations
+  void visit(FunctionDecl& decl) override;
+  void visit(StructDecl& decl) override;
+  void visit(GlobalDecl& decl) override;
+
+private:
+  // A variable binding together with what codegen needs to know about it
+  struct VariableBinding {
+    Binding binding;
+    TypePtr type;
+    bool is_mutable = false;
+  };
+
+  struct UndoEntry {
+    Symbol symbol;
+    VariableBinding previous;
+  };
+
+  SymbolTable& symbols_;
+
+  // Innermost variable binding of each symbol, and the function each symbol names
+  std::vector<VariableBinding> variables_;
+  std::vector<FunctionDecl*> function_symbols_;
+  std::vector<StructDecl*> struct_symbols_;
+
+  // Bindings shadowed by the open scopes, and where each scope starts in the log
+  std::vector<UndoEntry> undo_log_;
+  std::vector<size_t> scope_marks_;
+
+  std::vector<FunctionDecl*> functions_;
+  std::vector<GlobalDecl*> globals_;
+
+  // Function being resolved
+  FunctionDecl* current_function_ = nullptr;
+
+  // become statements of the current function, checked once its whole body is resolved: a
+  // guaranteed tail call releases the frame, so no local may have its address taken
+  std::vector<const ReturnStmt*> tail_calls_;
+  bool local_address_taken_ = false;
+
+  // Slots of the current function's locals that '&' is applied to directly
+  std::vector<bool> slot_address_taken_;
+
+  void enter_scope();
+  void exit_scope();
+  uint32_t bind_local(Symbol symbol, TypePtr type, bool is_mutable);
+  const VariableBinding& lookup_variable(const VariableExpr& expr);
+
+  // Resolve a call to a builtin (struct and vector construction, shuffle, select, reductions);
+  // false if the callee names none
+  bool resolve_builtin(CallExpr& expr, const VariableExpr& callee);
+
+  // Type checks for structs, arrays and vectors, which convert only to themselves
+  void require_defined(const TypePtr& type, uint32_t line, uint32_t column);
+  void check_conversion(const TypePtr& from, const TypePtr& to, uint32_t line, uint32_t column);
+  void check_recursion(const Type& type, const StructDecl& decl,
+                       std::vector<const StructType*>& open);
+
+  // Throws unless the call of a become statement can reuse the current function's frame
+  void check_tail_call(const ReturnStmt& stmt);
+
+  // Throws unless target names storage the statement may write
+  void check_assignable(const Expr& target, const Stmt& stmt);
+
+  void resolve_expr(Expr& expr);
+  void resolve_stmt(Stmt& stmt);
+
+  // Resolve the condition of an if or while, which must be a bool
+  void resolve_condition(Expr& condition);
+};
+
+} // namespace tuz
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iosfwd>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace tuz {
+
+// Compile server behind tuzc --serve. LLVM's targets, the target machines and the process stay
+// warm across compiles. A client sends the working directory and command line of a tuzc
+// invocation over a Unix socket; a pool of workers runs the requests concurrently and sends
+// back the exit code and everything tuzc would have printed.
+class CompileServer {
+public:
+  // A connection whose whole request has not arrived within request_timeout is closed
+  CompileServer(std::string socket_path, unsigned workers,
+                std::chrono::milliseconds request_timeout = std::chrono::seconds(10));
+  ~CompileServer();
+
+  CompileServer(const CompileServer&) = delete;
+  CompileServer& operator=(const CompileServer&) = delete;
+
+  // Listen on the socket, replacing a stale socket file left by a server that is gone; returns
+  // false after writing an error to err
+  bool listen(std::ostream& err);
+
+  // Accept and answer requests until stop() is called
+  void serve();
+
+  // Stop accepting requests; serve() returns once those already accepted are answered. May be
+  // called from any thread.
+  void stop();
+
+  const std::string& socket_path() const { return socket_path_; }
+
+private:
+  std::string socket_path_;
+  unsigned workers_;
+  std::chrono::milliseconds request_timeout_;
+  int listen_fd_ = -1;
+  std::atomic<bool> stopping_{false};
+
+  // Accepted connections waiting for a worker
+  std::mutex mutex_;
+  std::condition_variable pending_ready_;
+  std::deque<int> pending_;
+
+  void handle(int fd);
+};
+
+// Run a tuzc command line (without the program name) on the server listening at socket_path,
+// as if from cwd. Writes the compile's output to out and err and returns its exit code, or
+// nullopt when no server answers.
+std::optional<int> send_compile_request(const std::string& socket_path, const std::string& cwd,
+                                        const std::vector<std::string>& args, std::ostream& out,
+                                        std::ostream& err);
+
+} // namespace tuz
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "codegen.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace llvm::orc {
+class JITDylib;
+class ThreadSafeContext;
+} // namespace llvm::orc
+
+namespace tuz {
+
+// A program a CompilationSession loaded into its JIT. Its functions stay callable until it is
+// destroyed, which must happen before the session is.
+class JitModule {
+public:
+  JitModule(JitModule&& other) noexcept;
+  JitModule& operator=(JitModule&& other) noexcept;
+  ~JitModule();
+
+  // Address of main or an exported function of the program; throws CodeGenError if there is
+  // none (other functions are internal and may have been inlined away)
+  void* lookup(const std::string& name) const;
+
+  template <typename Fn> Fn* function(const std::string& name) const {
+    return reinterpret_cast<Fn*>(lookup(name));
+  }
+
+private:
+  friend class CompilationSession;
+  JitModule(llvm::orc::LLJIT& jit, llvm::orc::JITDylib& dylib) : jit_(&jit), dylib_(&dylib) {}
+
+  llvm::orc::LLJIT* jit_;
+  llvm::orc::JITDylib* dylib_; // Null once moved from
+};
+
+// Compiles many small programs from memory, for embedding tuz as a rules or scripting language.
+// The compiles share one LLVMContext, the pooled target machine and one JIT, and never touch
+// the filesystem. A session is used from one thread at a time.
+class CompilationSession {
+public:
+  explicit CompilationSession(CodeGenOptions options = {});
+  ~CompilationSession();
+
+  CompilationSession(const CompilationSession&) = delete;
+  CompilationSession& operator=(const CompilationSession&) = delete;
+
+  // Compile a program to a relocatable object for the session's target. Throws ParseError or
+  // CodeGenError.
+  std::vector<char> compile_object(std::string_view source);
+
+  // Compile a program into the JIT. Each program gets a symbol table of its own, so programs
+  // may reuse function names; extern functions resolve against the host process. Throws
+  // ParseError or CodeGenError.
+  JitModule load(std::string_view source);
+
+private:
+  CodeGenOptions options_;
+  std::unique_ptr<llvm::orc::ThreadSafeContext> context_;
+  std::unique_ptr<llvm::orc::LLJIT> jit_; // Created by the first load
+  unsigned loaded_ = 0;
+
+  // Parse, resolve, generate and optimize source into codegen
+  void generate(std::string_view source, CodeGenerator& codegen);
+};
+
+} // namespace tuz
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tuz {
+
+// Compile statistics behind -ftime-report and --stats=<text|json>: wall time, peak RSS and
+// phase-specific counters (tokens, AST nodes, bytes) for each compiler phase, plus the
+// exclusive wall time of every LLVM pass. Phases may be recorded from several threads; those
+// that run concurrently are nested in a section phase, which alone counts toward the total.
+class CompileStats {
+public:
+  struct PhaseRecord {
+    std::string name;
+    std::string input;
+    std::string parent; // Enclosing section phase; empty at the top level
+    double wall_ms = 0;
+    uint64_t peak_rss_kb = 0; // Process peak RSS when the phase ended
+    std::vector<std::pair<std::string, uint64_t>> counters;
+  };
+
+  struct PassRecord {
+    std::string name;
+    double wall_ms = 0;
+    uint64_t runs = 0;
+  };
+
+  // Measures one phase from construction to destruction; does nothing when stats is null
+  class Phase {
+  public:
+    Phase(CompileStats* stats, std::string name, std::string input = {});
+    // A phase nested in section, whose wall time already includes this one
+    Phase(const Phase& section, std::string name, std::string input = {});
+    ~Phase();
+    Phase(const Phase&) = delete;
+    Phase& operator=(const Phase&) = delete;
+
+    void set(std::string name, uint64_t value);
+
+  private:
+    CompileStats* stats_;
+    PhaseRecord record_;
+    size_t index_ = 0; // Phases are listed in the order they started
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  // Add one run of an LLVM pass, excluding the time spent in passes nested inside it
+  void record_pass(std::string_view name, double wall_ms);
+
+  // Append LLVM's own pass timing report (TimePassesHandler output)
+  void add_llvm_report(const std::string& report);
+
+  void print_text(std::ostream& out) const;
+  void print_json(std::ostream& out) const;
+
+  std::vector<PhaseRecord> phases() const;
+  std::vector<PassRecord> passes() const;
+
+  // Peak resident set size of this process so far
+  static uint64_t peak_rss_kb();
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<PhaseRecord> phases_;
+  std::vector<PassRecord> passes_;
+  std::string llvm_report_;
+
+  size_t phase_count() const;
+  void add_phase(PhaseRecord record, size_t index);
+};
+
+} // namespace tuz
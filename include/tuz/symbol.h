@@ -0,0 +1,38 @@
+#pragma once
+
+#include "arena.h"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tuz {
+
+// Interned identifier. Within one SymbolTable equal names have equal IDs, and IDs are dense so
+// they can index flat per-symbol arrays.
+using Symbol = uint32_t;
+constexpr Symbol InvalidSymbol = UINT32_MAX;
+
+class SymbolTable {
+public:
+  SymbolTable() = default;
+  SymbolTable(const SymbolTable&) = delete;
+  SymbolTable& operator=(const SymbolTable&) = delete;
+
+  // Return the ID of the name, adding it on first use
+  Symbol intern(std::string_view name);
+
+  // Return the ID of the name, or InvalidSymbol if it was never interned
+  Symbol lookup(std::string_view name) const;
+
+  std::string_view name(Symbol symbol) const { return names_[symbol]; }
+  size_t size() const { return names_.size(); }
+
+private:
+  BumpAllocator storage_;
+  std::vector<std::string_view> names_;
+  std::unordered_map<std::string_view, Symbol> ids_; // Keys point into storage_
+};
+
+} // namespace tuz
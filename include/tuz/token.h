@@ -39,6 +39,9 @@ enum class TokenType {
   TRUE,   // true
   FALSE,  // false
   EXTERN, // extern
+  EXPORT, // export
+  INLINE, // inline
+  BECOME, // become
 
   // Types
   INT,   // int
@@ -86,6 +89,7 @@ enum class TokenType {
   COMMA,     // ,
   ARROW,     // ->
   DOT,       // .
+  AT,        // @
 };
 
 struct Location {
@@ -93,9 +97,12 @@ struct Location {
   uint32_t column;
 };
 
+// Tokens do not own their text: it is a slice of the source buffer, of the static token
+// tables, or (for string literals with escapes) of the lexer's arena. The source and the
+// lexer must outlive the tokens.
 struct Token {
   TokenType type;
-  std::string text;
+  std::string_view text;
   uint32_t line;
   uint32_t column;
 
@@ -114,7 +121,57 @@ struct Token {
 
 struct TokenDefinition {
   TokenType type;
-  std::string value;
+  std::string_view value;
+};
+
+// Spellings of keywords and built-in type names
+inline constexpr TokenDefinition KeywordDefinitions[] = {
+    {TokenType::FN, "fn"},         {TokenType::LET, "let"},       {TokenType::MUT, "mut"},
+    {TokenType::IF, "if"},         {TokenType::ELSE, "else"},     {TokenType::WHILE, "while"},
+    {TokenType::FOR, "for"},       {TokenType::RETURN, "return"}, {TokenType::STRUCT, "struct"},
+    {TokenType::EXTERN, "extern"}, {TokenType::TRUE, "true"},     {TokenType::FALSE, "false"},
+    {TokenType::EXPORT, "export"}, {TokenType::INLINE, "inline"}, {TokenType::BECOME, "become"},
+    {TokenType::INT, "int"},       {TokenType::FLOAT, "float"},   {TokenType::BOOL, "bool"},
+    {TokenType::VOID, "void"},     {TokenType::I8, "i8"},         {TokenType::I16, "i16"},
+    {TokenType::I32, "i32"},       {TokenType::I64, "i64"},       {TokenType::U8, "u8"},
+    {TokenType::U16, "u16"},       {TokenType::U32, "u32"},       {TokenType::U64, "u64"},
+    {TokenType::F32, "f32"},       {TokenType::F64, "f64"},
+};
+
+// Spellings of operators and delimiters. The lexer dispatches on the first character, so at
+// most one two-character operator may start with a given character.
+inline constexpr TokenDefinition OperatorDefinitions[] = {
+    // Double char
+    {TokenType::EQ, "=="},
+    {TokenType::NEQ, "!="},
+    {TokenType::LEQ, "<="},
+    {TokenType::GEQ, ">="},
+    {TokenType::AND, "&&"},
+    {TokenType::OR, "||"},
+    {TokenType::ARROW, "->"},
+
+    // Single char
+    {TokenType::NOT, "!"},
+    {TokenType::AMPERSAND, "&"},
+    {TokenType::LT, "<"},
+    {TokenType::GT, ">"},
+    {TokenType::PLUS, "+"},
+    {TokenType::MINUS, "-"},
+    {TokenType::STAR, "*"},
+    {TokenType::SLASH, "/"},
+    {TokenType::PERCENT, "%"},
+    {TokenType::ASSIGN, "="},
+    {TokenType::LPAREN, "("},
+    {TokenType::RPAREN, ")"},
+    {TokenType::LBRACE, "{"},
+    {TokenType::RBRACE, "}"},
+    {TokenType::LBRACKET, "["},
+    {TokenType::RBRACKET, "]"},
+    {TokenType::SEMICOLON, ";"},
+    {TokenType::COLON, ":"},
+    {TokenType::COMMA, ","},
+    {TokenType::DOT, "."},
+    {TokenType::AT, "@"},
 };
 
 const char* token_type_to_string(TokenType type);
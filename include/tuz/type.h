@@ -1,8 +1,14 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace tuz {
@@ -26,6 +32,7 @@ enum class TypeKind {
   Bool,
   Pointer,
   Array,
+  Vector,
   Function,
   Struct,
   Reference,
@@ -47,6 +54,7 @@ public:
   bool is_void() const;
   bool is_pointer() const;
   bool is_array() const;
+  bool is_vector() const;
   bool is_function() const;
   bool is_struct() const;
   bool is_reference() const;
@@ -85,6 +93,28 @@ public:
   bool equals(const Type& other) const override;
   size_t size() const override;
   size_t alignment() const override { return element_type->alignment(); }
+
+  // Elements are a @soa struct, so the array is stored as one array per field
+  bool is_soa() const;
+
+  static TypePtr get(TypePtr element, size_t size);
+};
+
+// Fixed-width SIMD vector of numeric or boolean lanes, spelled <element>x<lanes> (f32x4)
+class VectorType : public Type {
+public:
+  TypePtr element_type;
+  size_t lanes;
+
+  VectorType(TypePtr elem, size_t n)
+      : Type(TypeKind::Vector), element_type(std::move(elem)), lanes(n) {}
+
+  std::string to_string() const override;
+  bool equals(const Type& other) const override;
+  size_t size() const override { return element_type->size() * lanes; }
+  size_t alignment() const override { return size(); }
+
+  static TypePtr get(TypePtr element, size_t lanes);
 };
 
 // Function type
@@ -100,13 +130,18 @@ public:
   bool equals(const Type& other) const override;
   size_t size() const override { return 8; } // Function pointer size
   size_t alignment() const override { return 8; }
+
+  static TypePtr get(std::vector<TypePtr> params, TypePtr ret);
 };
 
-// Struct type
+// Struct type. Types named in a program start out empty and get their fields when the
+// struct's declaration is resolved.
 class StructType : public Type {
 public:
   std::string name;
   std::vector<std::pair<std::string, TypePtr>> fields;
+  bool is_defined = false;
+  bool soa = false; // @soa: fixed-size arrays of it are stored as one array per field
   mutable std::optional<size_t> cached_size;
   mutable std::optional<size_t> cached_alignment;
 
@@ -118,7 +153,11 @@ public:
   size_t size() const override;
   size_t alignment() const override;
   std::optional<size_t> get_field_offset(const std::string& field_name) const;
+  std::optional<size_t> get_field_index(const std::string& field_name) const;
   TypePtr get_field_type(const std::string& field_name) const;
+
+  // Give the struct its fields, dropping any cached layout
+  void define(std::vector<std::pair<std::string, TypePtr>> new_fields, bool is_soa);
 };
 
 // Reference type (for mutable references)
@@ -134,8 +173,49 @@ public:
   bool equals(const Type& other) const override;
   size_t size() const override { return 8; } // Pointer size
   size_t alignment() const override { return 8; }
+
+  static TypePtr get(TypePtr referent, bool is_mutable);
 };
 
+// =============================================================================
+// Type interning
+// =============================================================================
+
+// Hash-conses composite types so that structurally equal types share one instance and
+// equality is a pointer comparison. Entries hold their types weakly: a type lives only while
+// something uses it, so the types a program derives from its structs die with it. Struct
+// types are nominal and owned by the program's ASTContext. Lookups are thread-safe.
+class TypeContext {
+public:
+  TypePtr get_pointer_type(const TypePtr& pointee);
+  TypePtr get_array_type(const TypePtr& element, size_t size);
+  TypePtr get_vector_type(const TypePtr& element, size_t lanes);
+  TypePtr get_function_type(const std::vector<TypePtr>& params, const TypePtr& ret);
+  TypePtr get_reference_type(const TypePtr& referent, bool is_mutable);
+
+private:
+  struct KeyHash {
+    size_t operator()(const Type* key) const;
+    size_t operator()(const std::pair<const Type*, size_t>& key) const;
+    size_t operator()(const std::vector<const Type*>& key) const;
+  };
+
+  template <typename Key> using Map = std::unordered_map<Key, std::weak_ptr<Type>, KeyHash>;
+
+  // The live type in map under key, or make's, which is entered
+  template <typename Key, typename Make>
+  TypePtr intern(Map<Key>& map, std::type_identity_t<Key> key, Make make);
+
+  std::mutex mutex_;
+  Map<const Type*> pointers_;
+  Map<std::pair<const Type*, size_t>> arrays_;
+  Map<std::pair<const Type*, size_t>> vectors_;
+  Map<std::pair<const Type*, size_t>> references_;
+  Map<std::vector<const Type*>> functions_; // Return type first
+};
+
+TypeContext& get_type_context();
+
 // Type factory - singleton types
 TypePtr get_void_type();
 TypePtr get_int8_type();
@@ -150,11 +230,11 @@ TypePtr get_float32_type();
 TypePtr get_float64_type();
 TypePtr get_bool_type();
 
-// Type parsing from string
+// Type parsing from string; vector types are spelled like f32x4 or i32x8
 TypePtr parse_type(std::string_view name);
 
 // Type checking helpers
-bool is_implicitly_convertible(TypePtr from, TypePtr to);
-TypePtr common_type(TypePtr a, TypePtr b);
+bool is_implicitly_convertible(const TypePtr& from, const TypePtr& to);
+TypePtr common_type(const TypePtr& a, const TypePtr& b);
 
 } // namespace tuz
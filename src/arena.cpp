@@ -0,0 +1,63 @@
+#include "tuz/arena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace tuz {
+
+BumpAllocator::BumpAllocator(size_t block_size) : block_size_(block_size) {
+}
+
+BumpAllocator::BumpAllocator(BumpAllocator&& other) noexcept
+    : blocks_(std::move(other.blocks_)), current_(std::exchange(other.current_, nullptr)),
+      end_(std::exchange(other.end_, nullptr)), block_size_(other.block_size_),
+      bytes_allocated_(std::exchange(other.bytes_allocated_, 0)) {
+}
+
+BumpAllocator& BumpAllocator::operator=(BumpAllocator&& other) noexcept {
+  if (this != &other) {
+    blocks_ = std::move(other.blocks_);
+    current_ = std::exchange(other.current_, nullptr);
+    end_ = std::exchange(other.end_, nullptr);
+    block_size_ = other.block_size_;
+    bytes_allocated_ = std::exchange(other.bytes_allocated_, 0);
+  }
+  return *this;
+}
+
+void BumpAllocator::new_block(size_t min_size) {
+  // Oversized requests get a dedicated block so the regular block size stays small
+  size_t size = min_size > block_size_ ? min_size : block_size_;
+  blocks_.push_back(std::make_unique<char[]>(size));
+  current_ = blocks_.back().get();
+  end_ = current_ + size;
+}
+
+void* BumpAllocator::allocate(size_t size, size_t alignment) {
+  auto align_up = [alignment](char* ptr) {
+    auto addr = reinterpret_cast<uintptr_t>(ptr);
+    return reinterpret_cast<char*>((addr + alignment - 1) & ~(uintptr_t(alignment) - 1));
+  };
+
+  char* ptr = current_ ? align_up(current_) : nullptr;
+  if (!ptr || ptr + size > end_) {
+    new_block(size + alignment);
+    ptr = align_up(current_);
+  }
+
+  current_ = ptr + size;
+  bytes_allocated_ += size;
+  return ptr;
+}
+
+std::string_view BumpAllocator::copy_string(std::string_view text) {
+  if (text.empty()) {
+    return {};
+  }
+  auto* data = static_cast<char*>(allocate(text.size(), 1));
+  std::memcpy(data, text.data(), text.size());
+  return {data, text.size()};
+}
+
+} // namespace tuz
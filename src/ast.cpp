@@ -1,7 +1,27 @@
 #include "tuz/ast.h"
 
+#include "tuz/type.h"
+
 namespace tuz {
 
+ASTContext::~ASTContext() {
+  for (auto& destructor : destructors_) {
+    destructor.destroy(destructor.object);
+  }
+  // A struct refers to itself through pointers to it in its fields; dropping the fields breaks
+  // the cycle, so the types of the program are freed with it
+  for (auto& [name, type] : struct_types_) {
+    type->fields.clear();
+  }
+}
+
+std::shared_ptr<StructType> ASTContext::struct_type(const std::string& name) {
+  auto& slot = struct_types_[name];
+  if (!slot)
+    slot = std::make_shared<StructType>(name, std::vector<std::pair<std::string, TypePtr>>{});
+  return slot;
+}
+
 // Expression visitor dispatch
 void visit_expr(ASTVisitor& visitor, Expr& expr) {
   switch (expr.kind) {
@@ -0,0 +1,143 @@
+#include "tuz/cache.h"
+
+#include "tuz/codegen.h"
+#include "tuz/diagnostic.h"
+
+#include <fstream>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA256.h>
+
+#ifndef TUZ_VERSION
+#define TUZ_VERSION "unknown"
+#endif
+
+namespace tuz {
+
+ObjectCache::ObjectCache(std::string directory) : directory_(std::move(directory)) {
+}
+
+std::string ObjectCache::default_directory() {
+  llvm::SmallString<128> path;
+  if (!llvm::sys::path::cache_directory(path)) {
+    return ".tuz-cache";
+  }
+  llvm::sys::path::append(path, "tuz");
+  return path.str().str();
+}
+
+std::string ObjectCache::compute_key(std::string_view source, const CodeGenOptions& options,
+                                     bool split_units) {
+  TargetSelection target = select_target(options);
+
+  // Objects built with a profile depend on its contents, not on its path
+  std::string profile;
+  if (!options.profile_use.empty()) {
+    auto buffer = llvm::MemoryBuffer::getFile(options.profile_use);
+    if (!buffer) {
+      throw CodeGenError("could not read profile '" + options.profile_use + "'");
+    }
+    auto digest = llvm::SHA256::hash(llvm::arrayRefFromStringRef((*buffer)->getBuffer()));
+    profile = "use " + llvm::toHex(digest, true);
+  }
+  if (options.profile_generate) {
+    profile = "generate " + options.profile_output;
+  }
+
+  // Debug info names the source by its absolute path
+  std::string debug = "no-debug";
+  if (options.debug_info) {
+    llvm::SmallString<256> path(options.source_file);
+    llvm::sys::fs::make_absolute(path);
+    debug = "debug " + path.str().str();
+  }
+
+  // Fields are NUL-separated so no two option sets produce the same byte string
+  std::string data;
+  for (const std::string& field :
+       {std::string("tuz " TUZ_VERSION), std::string("llvm " LLVM_VERSION_STRING), target.triple,
+        target.cpu, target.features, std::to_string(options.opt_level),
+        std::string(split_units ? "units" : "module"),
+        std::string(options.thin_lto ? "thin-lto" : "native"), profile, debug,
+        std::string(options.bounds_check ? "bounds-check" : "unchecked")}) {
+    data += field;
+    data += '\0';
+  }
+  data += source;
+
+  auto digest = llvm::SHA256::hash(
+      llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(data.data()), data.size()));
+  return llvm::toHex(digest, true);
+}
+
+std::string ObjectCache::entry_path(const std::string& key, const std::string& suffix) const {
+  llvm::SmallString<128> path(directory_);
+  llvm::sys::path::append(path, key + suffix);
+  return path.str().str();
+}
+
+std::optional<std::vector<std::string>> ObjectCache::lookup(const std::string& key) {
+  // The manifest holds the object count and is written last, so it marks a complete entry
+  std::ifstream manifest(entry_path(key, ".manifest"));
+  size_t count = 0;
+  if (!(manifest >> count) || count == 0) {
+    ++misses_;
+    return std::nullopt;
+  }
+
+  std::vector<std::string> objects;
+  for (size_t i = 0; i < count; ++i) {
+    objects.push_back(entry_path(key, "." + std::to_string(i) + ".o"));
+    if (!llvm::sys::fs::exists(objects.back())) {
+      ++misses_;
+      return std::nullopt;
+    }
+  }
+  ++hits_;
+  return objects;
+}
+
+// Write to a temporary name in the cache directory, then rename into place, so concurrent
+// builds never observe a partially written file
+static bool install_file(const std::string& from, const std::string& to) {
+  llvm::SmallString<128> temp;
+  if (llvm::sys::fs::createUniqueFile(to + ".tmp-%%%%%%", temp)) {
+    return false;
+  }
+  if (llvm::sys::fs::copy_file(from, temp) || llvm::sys::fs::rename(temp, to)) {
+    llvm::sys::fs::remove(temp);
+    return false;
+  }
+  return true;
+}
+
+bool ObjectCache::store(const std::string& key, const std::vector<std::string>& objects) {
+  if (llvm::sys::fs::create_directories(directory_)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < objects.size(); ++i) {
+    if (!install_file(objects[i], entry_path(key, "." + std::to_string(i) + ".o"))) {
+      return false;
+    }
+  }
+
+  llvm::SmallString<128> manifest;
+  if (llvm::sys::fs::createTemporaryFile("tuz", "manifest", manifest)) {
+    return false;
+  }
+  {
+    std::ofstream out(manifest.str().str());
+    out << objects.size() << "\n";
+  }
+  bool installed = install_file(manifest.str().str(), entry_path(key, ".manifest"));
+  llvm::sys::fs::remove(manifest);
+  return installed;
+}
+
+} // namespace tuz
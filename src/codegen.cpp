@@ -1,76 +1,451 @@
 #include "tuz/codegen.h"
 
+#include "tuz/consteval.h"
 #include "tuz/diagnostic.h"
-
-#include <iostream>
+#include "tuz/resolver.h"
+#include "tuz/stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <llvm/Analysis/CaptureTracking.h>
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/Analysis/VectorUtils.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/IR/PassTimingInfo.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/VirtualFileSystem.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
 #include <llvm/TargetParser/Host.h>
+#include <llvm/TargetParser/Triple.h>
 #include <llvm/Transforms/InstCombine/InstCombine.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Scalar/GVN.h>
 
 namespace tuz {
 
-CodeGenerator::CodeGenerator()
-    : context_(std::make_unique<llvm::LLVMContext>()),
+CodeGenerator::CodeGenerator(CodeGenOptions options)
+    : CodeGenerator(options, std::make_unique<llvm::LLVMContext>()) {
+}
+
+CodeGenerator::CodeGenerator(CodeGenOptions options, llvm::LLVMContext& context)
+    : CodeGenerator(options, nullptr, &context) {
+}
+
+CodeGenerator::CodeGenerator(CodeGenOptions options, std::unique_ptr<llvm::LLVMContext> owned,
+                             llvm::LLVMContext* context)
+    : options_(options), owned_context_(std::move(owned)),
+      context_(context ? context : owned_context_.get()),
       module_(std::make_unique<llvm::Module>("tuz_module", *context_)),
       builder_(std::make_unique<llvm::IRBuilder<>>(*context_)), current_function_(nullptr) {
 
-  // Initialize LLVM
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmPrinter();
-  llvm::InitializeNativeTargetAsmParser();
+  // Initialize LLVM once per process; all targets are registered so --target can cross-compile
+  static std::once_flag targets_initialized;
+  std::call_once(targets_initialized, [] {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+    llvm::InitializeAllAsmParsers();
+  });
+
+  TargetSelection target = select_target(options_);
+  target_triple_ = std::move(target.triple);
+  target_cpu_ = std::move(target.cpu);
+  target_features_ = std::move(target.features);
 }
 
-void CodeGenerator::generate(Program& program) {
-  // First pass: declare all structs
-  for (auto& decl : program.declarations) {
-    if (decl->kind == DeclKind::Struct) {
-      codegen_decl(*decl);
+// Target machines are slow to create and may not be shared between threads, so generators
+// check one out for their lifetime and hand it back when they are destroyed. A long-running
+// process such as the compile server then creates at most one per thread and configuration.
+namespace {
+class TargetMachinePool {
+public:
+  std::unique_ptr<llvm::TargetMachine> acquire(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = idle_.find(key);
+    if (it == idle_.end() || it->second.empty()) {
+      return nullptr;
     }
+    auto machine = std::move(it->second.back());
+    it->second.pop_back();
+    return machine;
   }
 
-  // Second pass: declare all functions (without bodies - just prototypes)
-  for (auto& decl : program.declarations) {
-    if (decl->kind == DeclKind::Function) {
-      auto& fn = static_cast<FunctionDecl&>(*decl);
-      // Only declare the function prototype, don't generate body yet
-      declare_function(fn);
+  void release(const std::string& key, std::unique_ptr<llvm::TargetMachine> machine) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_[key].push_back(std::move(machine));
+  }
+
+private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<std::unique_ptr<llvm::TargetMachine>>> idle_;
+};
+} // namespace
+
+static TargetMachinePool& target_machine_pool() {
+  static TargetMachinePool pool;
+  return pool;
+}
+
+CodeGenerator::~CodeGenerator() {
+  if (target_machine_) {
+    target_machine_pool().release(target_machine_key(), std::move(target_machine_));
+  }
+}
+
+std::string CodeGenerator::target_machine_key() const {
+  return target_triple_ + "|" + target_cpu_ + "|" + target_features_ + "|" +
+         std::to_string(options_.opt_level);
+}
+
+void CodeGenerator::generate(Program& program) {
+  if (!program.is_resolved) {
+    if (!program.context) {
+      throw CodeGenError("program has no AST context");
     }
+    // Bind names to slots, globals and functions, and fill in expression types
+    Resolver resolver(program.context->symbols());
+    resolver.resolve(program);
   }
 
-  // Third pass: generate function bodies and globals
-  for (auto& decl : program.declarations) {
+  // The resolver numbers functions and globals in declaration order
+  std::vector<FunctionDecl*> functions;
+  std::vector<GlobalDecl*> globals;
+  std::vector<FunctionDecl*> bodies;
+  first_new_global_ = 0;
+  uint32_t first_new_function = 0;
+  for (size_t i = 0; i < program.declarations.size(); ++i) {
+    Decl* decl = program.declarations[i];
+    bool is_new = i >= options_.first_new_declaration;
     if (decl->kind == DeclKind::Function) {
       auto& fn = static_cast<FunctionDecl&>(*decl);
-      if (fn.body) {
-        generate_function_body(fn);
+      functions.push_back(&fn);
+      if (!is_new) {
+        first_new_function = static_cast<uint32_t>(functions.size());
+      }
+      if (fn.body && is_new) {
+        bodies.push_back(&fn);
       }
     } else if (decl->kind == DeclKind::Global) {
+      globals.push_back(static_cast<GlobalDecl*>(decl));
+      if (!is_new) {
+        first_new_global_ = static_cast<uint32_t>(globals.size());
+      }
+    }
+  }
+
+  if (constants_) {
+    constants_->add_declarations(globals, functions, first_new_global_, first_new_function);
+  } else {
+    constants_ = std::make_shared<ConstEvaluator>(globals, functions);
+  }
+
+  if (options_.debug_info) {
+    // Debug types are sized by the target's data layout
+    get_target_machine();
+    llvm::SmallString<256> path(options_.source_file.empty() ? "<memory>" : options_.source_file);
+    llvm::sys::fs::make_absolute(path);
+    di_builder_ = std::make_unique<llvm::DIBuilder>(*module_);
+    di_file_ = di_builder_->createFile(llvm::sys::path::filename(path),
+                                       llvm::sys::path::parent_path(path));
+    di_builder_->createCompileUnit(llvm::dwarf::DW_LANG_C, di_file_, "tuzc",
+                                   options_.opt_level > 0, "", 0);
+    module_->addModuleFlag(llvm::Module::Warning, "Debug Info Version",
+                           llvm::DEBUG_METADATA_VERSION);
+    module_->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 5);
+  }
+
+  // First pass: declare all structs
+  for (auto& decl : program.declarations) {
+    if (decl->kind == DeclKind::Struct) {
       codegen_decl(*decl);
     }
   }
+
+  // Second pass: globals, so function bodies can refer to them by index
+  globals_.assign(globals.size(), nullptr);
+  for (auto* global : globals) {
+    codegen_decl(*global);
+  }
+
+  // Third pass: declare all functions (without bodies - just prototypes)
+  functions_.assign(functions.size(), nullptr);
+  function_decls_ = functions;
+  for (auto* fn : functions) {
+    declare_function(*fn);
+  }
+
+  // Fourth pass: generate the bodies of this unit, a contiguous share of the definitions
+  size_t unit_count = std::max(options_.unit_count, 1u);
+  size_t first = bodies.size() * options_.unit_index / unit_count;
+  size_t last = bodies.size() * (options_.unit_index + 1) / unit_count;
+  for (size_t i = first; i < last; ++i) {
+    generate_function_body(*bodies[i]);
+  }
+
+  if (di_builder_) {
+    di_builder_->finalize();
+  }
+}
+
+void CodeGenerator::share_constants(std::shared_ptr<ConstEvaluator> constants) {
+  constants_ = std::move(constants);
 }
 
 std::unique_ptr<llvm::Module> CodeGenerator::get_module() {
   return std::move(module_);
 }
 
+// =============================================================================
+// Target and optimization
+// =============================================================================
+
+llvm::CodeGenOptLevel get_codegen_opt_level(int opt_level) {
+  switch (opt_level) {
+  case 0:
+    return llvm::CodeGenOptLevel::None;
+  case 1:
+    return llvm::CodeGenOptLevel::Less;
+  case 2:
+    return llvm::CodeGenOptLevel::Default;
+  default:
+    return llvm::CodeGenOptLevel::Aggressive;
+  }
+}
+
+void configure_jit(llvm::orc::LLJITBuilderState& builder, const CodeGenOptions& options) {
+  if (!options.debug_info) {
+    return;
+  }
+  // Event listeners hook into RuntimeDyld, so the JIT links with it. gdb reads jitted DWARF
+  // through its JIT interface; perf (record -k 1, then inject --jit) reads the jitdump.
+  builder.CreateObjectLinkingLayer = [](llvm::orc::ExecutionSession& session, const llvm::Triple&)
+      -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>> {
+    auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+        session, [] { return std::make_unique<llvm::SectionMemoryManager>(); });
+    layer->registerJITEventListener(*llvm::JITEventListener::createGDBRegistrationListener());
+    if (auto* perf = llvm::JITEventListener::createPerfJITEventListener()) {
+      layer->registerJITEventListener(*perf);
+    }
+    return std::unique_ptr<llvm::orc::ObjectLayer>(std::move(layer));
+  };
+}
+
+static llvm::OptimizationLevel get_optimization_level(int opt_level) {
+  switch (opt_level) {
+  case 0:
+    return llvm::OptimizationLevel::O0;
+  case 1:
+    return llvm::OptimizationLevel::O1;
+  case 2:
+    return llvm::OptimizationLevel::O2;
+  default:
+    return llvm::OptimizationLevel::O3;
+  }
+}
+
+// PGO instrumentation or profile use selected by the options, if any
+static std::optional<llvm::PGOOptions> make_pgo_options(const CodeGenOptions& options) {
+  if (options.profile_generate) {
+    return llvm::PGOOptions(options.profile_output, "", "", "", llvm::vfs::getRealFileSystem(),
+                            llvm::PGOOptions::IRInstr);
+  }
+  if (!options.profile_use.empty()) {
+    return llvm::PGOOptions(options.profile_use, "", "", "", llvm::vfs::getRealFileSystem(),
+                            llvm::PGOOptions::IRUse);
+  }
+  return std::nullopt;
+}
+
+TargetSelection select_target(const CodeGenOptions& options) {
+  std::string host_triple = llvm::sys::getDefaultTargetTriple();
+  TargetSelection target;
+  target.triple = options.target_triple.empty() ? host_triple
+                                                : llvm::Triple::normalize(options.target_triple);
+  target.cpu = options.cpu;
+
+  if (target.cpu == "native") {
+    if (llvm::Triple(target.triple).getArch() != llvm::Triple(host_triple).getArch()) {
+      throw CodeGenError("-mcpu=native cannot be used when targeting '" + target.triple + "'");
+    }
+    target.cpu = llvm::sys::getHostCPUName().str();
+
+    // Sorted so the feature string does not depend on hash order
+    llvm::StringMap<bool> host_features;
+    if (llvm::sys::getHostCPUFeatures(host_features)) {
+      std::vector<std::string> features;
+      for (const auto& feature : host_features) {
+        features.push_back((feature.getValue() ? "+" : "-") + feature.getKey().str());
+      }
+      std::sort(features.begin(), features.end());
+      for (const auto& feature : features) {
+        target.features += (target.features.empty() ? "" : ",") + feature;
+      }
+    }
+  }
+
+  // Explicit features come last so they override the host defaults
+  if (!options.features.empty()) {
+    target.features += (target.features.empty() ? "" : ",") + options.features;
+  }
+  return target;
+}
+
+llvm::TargetMachine* CodeGenerator::get_target_machine() {
+  if (target_machine_) {
+    return target_machine_.get();
+  }
+
+  target_machine_ = target_machine_pool().acquire(target_machine_key());
+  if (!target_machine_) {
+    std::string error;
+    auto target = llvm::TargetRegistry::lookupTarget(target_triple_, error);
+    if (!target) {
+      throw CodeGenError(error);
+    }
+
+    std::string cpu = target_cpu_.empty() ? "generic" : target_cpu_;
+
+    llvm::TargetOptions opt;
+    auto rm = llvm::Reloc::Model::PIC_;
+    target_machine_.reset(target->createTargetMachine(target_triple_, cpu, target_features_, opt,
+                                                      rm, std::nullopt,
+                                                      get_codegen_opt_level(options_.opt_level)));
+    if (!target_machine_) {
+      throw CodeGenError("could not create target machine for '" + target_triple_ + "'");
+    }
+  }
+
+  module_->setTargetTriple(target_triple_);
+  module_->setDataLayout(target_machine_->createDataLayout());
+  return target_machine_.get();
+}
+
+void CodeGenerator::optimize() {
+  llvm::TargetMachine* target_machine = get_target_machine();
+
+  // Instrumentation is inserted at every level; a profile only guides the optimizer
+  if (options_.opt_level <= 0 && !options_.profile_generate) {
+    return;
+  }
+  if (!options_.profile_use.empty() && !llvm::sys::fs::exists(options_.profile_use)) {
+    throw CodeGenError("could not read profile '" + options_.profile_use + "'");
+  }
+
+  // The pass pipeline assumes well-formed IR
+  std::string errors;
+  llvm::raw_string_ostream error_stream(errors);
+  if (llvm::verifyModule(*module_, &error_stream)) {
+    throw CodeGenError("generated invalid LLVM IR: " + error_stream.str());
+  }
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  // With stats, each pass's exclusive wall time is recorded, along with LLVM's own report
+  llvm::PassInstrumentationCallbacks callbacks;
+  std::string llvm_report;
+  llvm::raw_string_ostream llvm_report_stream(llvm_report);
+  llvm::TimePassesHandler time_passes(options_.stats != nullptr);
+  struct RunningPass {
+    std::chrono::steady_clock::time_point start;
+    double nested_ms;
+  };
+  std::vector<RunningPass> running;
+  auto pass_finished = [&](llvm::StringRef name) {
+    double total_ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - running.back().start)
+                          .count();
+    double exclusive_ms = total_ms - running.back().nested_ms;
+    running.pop_back();
+    if (!running.empty()) {
+      running.back().nested_ms += total_ms;
+    }
+    // Pass managers and adaptors only run other passes
+    if (!name.contains("PassManager") && !name.contains("PassAdaptor")) {
+      options_.stats->record_pass(name, exclusive_ms);
+    }
+  };
+  if (options_.stats) {
+    time_passes.setOutStream(llvm_report_stream);
+    time_passes.registerCallbacks(callbacks);
+    callbacks.registerBeforeNonSkippedPassCallback([&](llvm::StringRef, llvm::Any) {
+      running.push_back({std::chrono::steady_clock::now(), 0});
+    });
+    callbacks.registerAfterPassCallback(
+        [&](llvm::StringRef name, llvm::Any, const llvm::PreservedAnalyses&) {
+          pass_finished(name);
+        });
+    callbacks.registerAfterPassInvalidatedCallback(
+        [&](llvm::StringRef name, const llvm::PreservedAnalyses&) { pass_finished(name); });
+  }
+
+  llvm::PassBuilder pass_builder(target_machine, llvm::PipelineTuningOptions(),
+                                 make_pgo_options(options_), &callbacks);
+  pass_builder.registerModuleAnalyses(mam);
+  pass_builder.registerCGSCCAnalyses(cgam);
+  pass_builder.registerFunctionAnalyses(fam);
+  pass_builder.registerLoopAnalyses(lam);
+  pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  // For ThinLTO, the passes that pay off once functions are imported wait for the link
+  llvm::OptimizationLevel level = get_optimization_level(options_.opt_level);
+  llvm::ModulePassManager mpm;
+  if (options_.opt_level <= 0) {
+    mpm = pass_builder.buildO0DefaultPipeline(level, options_.thin_lto);
+  } else if (options_.thin_lto) {
+    mpm = pass_builder.buildThinLTOPreLinkDefaultPipeline(level);
+  } else {
+    mpm = pass_builder.buildPerModuleDefaultPipeline(level);
+  }
+  mpm.run(*module_, mam);
+
+  if (options_.stats) {
+    time_passes.print();
+    options_.stats->add_llvm_report(llvm_report_stream.str());
+  }
+}
+
 // =============================================================================
 // Type conversion
 // =============================================================================
 
-llvm::Type* CodeGenerator::convert_type(TypePtr type) {
-  switch (type->kind) {
+llvm::Type* CodeGenerator::convert_type(const TypePtr& type) {
+  auto& slot = llvm_types_[type.get()];
+  if (!slot)
+    slot = convert_type_uncached(*type);
+  return slot;
+}
+
+llvm::Type* CodeGenerator::convert_type_uncached(const Type& type) {
+  switch (type.kind) {
   case TypeKind::Void:
     return llvm::Type::getVoidTy(*context_);
   case TypeKind::Int8:
@@ -100,9 +475,31 @@ llvm::Type* CodeGenerator::convert_type(TypePtr type) {
     return llvm::PointerType::get(*context_, 0);
   }
   case TypeKind::Array: {
-    auto arr_type = static_cast<ArrayType*>(type.get());
-    llvm::Type* elem = convert_type(arr_type->element_type);
-    return llvm::ArrayType::get(elem, arr_type->size_val);
+    const auto& arr_type = static_cast<const ArrayType&>(type);
+    if (arr_type.is_soa()) {
+      // One array per field of the element struct
+      std::vector<llvm::Type*> field_arrays;
+      for (const auto& field : static_cast<const StructType&>(*arr_type.element_type).fields) {
+        field_arrays.push_back(llvm::ArrayType::get(convert_type(field.second), arr_type.size_val));
+      }
+      return llvm::StructType::get(*context_, field_arrays);
+    }
+    llvm::Type* elem = convert_type(arr_type.element_type);
+    return llvm::ArrayType::get(elem, arr_type.size_val);
+  }
+  case TypeKind::Vector: {
+    const auto& vec_type = static_cast<const VectorType&>(type);
+    return llvm::FixedVectorType::get(convert_type(vec_type.element_type),
+                                      static_cast<unsigned>(vec_type.lanes));
+  }
+  case TypeKind::Struct: {
+    // The resolver rejects structs that contain themselves, so this terminates
+    const auto& struct_type = static_cast<const StructType&>(type);
+    std::vector<llvm::Type*> field_types;
+    for (const auto& field : struct_type.fields) {
+      field_types.push_back(convert_type(field.second));
+    }
+    return llvm::StructType::create(*context_, field_types, struct_type.name);
   }
   default:
     return llvm::Type::getInt32Ty(*context_);
@@ -130,53 +527,307 @@ void CodeGenerator::push_value(llvm::Value* val) {
 // Variable management
 // =============================================================================
 
-void CodeGenerator::enter_scope() {
-  named_values_.emplace_back();
+llvm::Value* CodeGenerator::get_variable(const VariableExpr& expr, llvm::Type*& type) {
+  switch (expr.binding.kind) {
+  case BindingKind::Local: {
+    llvm::AllocaInst* alloca = locals_[expr.binding.index];
+    type = alloca->getAllocatedType();
+    return alloca;
+  }
+  case BindingKind::Global: {
+    llvm::GlobalVariable* global = globals_[expr.binding.index];
+    type = global->getValueType();
+    return global;
+  }
+  default:
+    throw CodeGenError("unknown variable: '" + expr.name + "'",
+                       SourceLocation(expr.line, expr.column, expr.name.length()));
+  }
 }
 
-void CodeGenerator::exit_scope() {
-  if (!named_values_.empty()) {
-    named_values_.pop_back();
+CodeGenerator::Place CodeGenerator::codegen_place(Expr& expr) {
+  auto element_index = [&](IndexExpr& index) {
+    return coerce(codegen_expr(*index.index), index.index->type, builder_->getInt64Ty());
+  };
+
+  switch (expr.kind) {
+  case ExprKind::Variable: {
+    Place place;
+    place.address = get_variable(static_cast<VariableExpr&>(expr), place.type);
+    return place;
+  }
+  case ExprKind::Index: {
+    auto& index = static_cast<IndexExpr&>(expr);
+    const auto& base_type = index.array->type;
+    llvm::Type* element = convert_type(expr.type);
+    if (base_type->is_pointer()) {
+      llvm::Value* pointer = codegen_expr(*index.array);
+      return {builder_->CreateGEP(element, pointer, element_index(index), "elemptr"), element};
+    }
+    if (!base_type->is_array()) {
+      break; // Vector lanes are values
+    }
+    const auto& array_type = static_cast<const ArrayType&>(*base_type);
+    Place array = codegen_place(*index.array);
+    llvm::Value* position = element_index(index);
+    if (options_.bounds_check) {
+      check_index(index, position, array_type.size_val);
+    }
+    if (array_type.is_soa()) {
+      return {array.address, array.type, position};
+    }
+    llvm::Value* indices[] = {builder_->getInt64(0), position};
+    return {builder_->CreateInBoundsGEP(array.type, array.address, indices, "elemptr"), element};
+  }
+  case ExprKind::FieldAccess: {
+    auto& field = static_cast<FieldAccessExpr&>(expr);
+    llvm::Type* field_type = convert_type(expr.type);
+    if (field.object->type->is_pointer()) {
+      llvm::Value* pointer = codegen_expr(*field.object);
+      llvm::Type* struct_type =
+          convert_type(static_cast<const PointerType&>(*field.object->type).pointee);
+      return {builder_->CreateStructGEP(struct_type, pointer, field.field_index, field.field),
+              field_type};
+    }
+    Place object = codegen_place(*field.object);
+    if (object.soa_index) {
+      // The field's own array, at the element's index
+      llvm::Value* indices[] = {builder_->getInt64(0), builder_->getInt32(field.field_index),
+                                object.soa_index};
+      return {builder_->CreateInBoundsGEP(object.type, object.address, indices, field.field),
+              field_type};
+    }
+    return {builder_->CreateStructGEP(object.type, object.address, field.field_index, field.field),
+            field_type};
+  }
+  case ExprKind::UnaryOp: {
+    auto& unary = static_cast<UnaryOpExpr&>(expr);
+    if (unary.op == UnaryOp::Deref) {
+      return {codegen_expr(*unary.operand), convert_type(expr.type)};
+    }
+    break;
   }
+  default:
+    break;
+  }
+
+  // Anything else is a temporary, such as the result of a call
+  llvm::Value* value = codegen_expr(expr);
+  llvm::AllocaInst* temp = create_alloca(value->getType(), "tmp");
+  builder_->CreateStore(value, temp);
+  return {temp, value->getType()};
 }
 
-void CodeGenerator::set_variable(const std::string& name, llvm::Value* alloca, bool is_mutable) {
-  if (named_values_.empty()) {
-    named_values_.emplace_back();
+// Whether every value in range is representable in an integer type
+static bool fits(int64_t range_low, int64_t range_high, const Type& type) {
+  int64_t low = INT64_MIN;
+  int64_t high = INT64_MAX;
+  switch (type.kind) {
+  case TypeKind::Int8:
+    low = INT8_MIN, high = INT8_MAX;
+    break;
+  case TypeKind::Int16:
+    low = INT16_MIN, high = INT16_MAX;
+    break;
+  case TypeKind::Int32:
+    low = INT32_MIN, high = INT32_MAX;
+    break;
+  case TypeKind::UInt8:
+    low = 0, high = UINT8_MAX;
+    break;
+  case TypeKind::UInt16:
+    low = 0, high = UINT16_MAX;
+    break;
+  case TypeKind::UInt32:
+    low = 0, high = UINT32_MAX;
+    break;
+  case TypeKind::UInt64:
+    low = 0;
+    break;
+  default:
+    break;
   }
-  named_values_.back()[name] = VariableInfo{alloca, is_mutable};
+  return range_low >= low && range_high <= high;
 }
 
-llvm::Value* CodeGenerator::get_variable(const std::string& name) {
-  // Search from innermost scope outward
-  for (auto it = named_values_.rbegin(); it != named_values_.rend(); ++it) {
-    auto found = it->find(name);
-    if (found != it->end()) {
-      return found->second.value;
+std::optional<CodeGenerator::IndexRange> CodeGenerator::index_range(const Expr& expr) {
+  if (!expr.type || !expr.type->is_integer()) {
+    return std::nullopt;
+  }
+
+  std::optional<IndexRange> range;
+  if (auto value = constants_ ? constants_->evaluate(expr) : std::nullopt) {
+    range = IndexRange{value->integer, value->integer};
+  } else if (expr.kind == ExprKind::Variable) {
+    const auto& variable = static_cast<const VariableExpr&>(expr);
+    auto it = loop_ranges_.find(variable.binding.index);
+    if (variable.binding.kind == BindingKind::Local && it != loop_ranges_.end()) {
+      range = it->second;
     }
+  } else if (expr.kind == ExprKind::BinaryOp) {
+    // Operands are converted to the result type first, so their values must survive that
+    const auto& binary = static_cast<const BinaryOpExpr&>(expr);
+    auto left = index_range(*binary.left);
+    auto right = index_range(*binary.right);
+    if (!left || !right || !fits(left->low, left->high, *expr.type) ||
+        !fits(right->low, right->high, *expr.type)) {
+      return std::nullopt;
+    }
+    IndexRange result;
+    bool overflow = true;
+    if (binary.op == BinaryOp::Add) {
+      overflow = __builtin_add_overflow(left->low, right->low, &result.low) ||
+                 __builtin_add_overflow(left->high, right->high, &result.high);
+    } else if (binary.op == BinaryOp::Sub) {
+      overflow = __builtin_sub_overflow(left->low, right->high, &result.low) ||
+                 __builtin_sub_overflow(left->high, right->low, &result.high);
+    }
+    if (!overflow) {
+      range = result;
+    }
+  } else if (expr.kind == ExprKind::Cast) {
+    range = index_range(*static_cast<const CastExpr&>(expr).expr);
   }
-  // Check for global
-  llvm::GlobalVariable* global = module_->getNamedGlobal(name);
-  if (global) {
-    return global;
+
+  // Arithmetic wraps at the width of the type, which the values must not reach
+  if (range && !fits(range->low, range->high, *expr.type)) {
+    return std::nullopt;
   }
-  return nullptr;
+  return range;
 }
 
-bool CodeGenerator::is_variable_mutable(const std::string& name) {
-  // Search from innermost scope outward for local variables
-  for (auto it = named_values_.rbegin(); it != named_values_.rend(); ++it) {
-    auto found = it->find(name);
-    if (found != it->end()) {
-      return found->second.is_mutable;
-    }
+void CodeGenerator::check_index(const IndexExpr& index, llvm::Value* position, size_t size) {
+  auto range = index_range(*index.index);
+  if (range && range->low >= 0 && static_cast<uint64_t>(range->high) < size) {
+    return;
+  }
+
+  // Negative indexes compare as huge unsigned ones. The failure path is shared and cold, so a
+  // check costs a compare and a predictable branch.
+  if (!bounds_trap_) {
+    bounds_trap_ = llvm::BasicBlock::Create(*context_, "outofbounds", current_function_);
+    llvm::IRBuilder<> trap(bounds_trap_);
+    trap.CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+    trap.CreateUnreachable();
+  }
+  llvm::Value* in_bounds = builder_->CreateICmpULT(position, builder_->getInt64(size), "inbounds");
+  llvm::BasicBlock* next = llvm::BasicBlock::Create(*context_, "inbounds", current_function_);
+  builder_->CreateCondBr(in_bounds, next, bounds_trap_,
+                         llvm::MDBuilder(*context_).createBranchWeights(1 << 20, 1));
+  builder_->SetInsertPoint(next);
+}
+
+llvm::Value* CodeGenerator::load_place(const Place& place, llvm::Type* type) {
+  if (!place.soa_index) {
+    return builder_->CreateLoad(type, place.address, "elem");
+  }
+
+  // Gather the element from the field arrays
+  llvm::Value* value = llvm::PoisonValue::get(type);
+  for (unsigned i = 0; i < type->getStructNumElements(); ++i) {
+    llvm::Value* indices[] = {builder_->getInt64(0), builder_->getInt32(i), place.soa_index};
+    llvm::Value* address = builder_->CreateInBoundsGEP(place.type, place.address, indices);
+    llvm::Value* field = builder_->CreateLoad(type->getStructElementType(i), address, "field");
+    value = builder_->CreateInsertValue(value, field, i, "elem");
+  }
+  return value;
+}
+
+void CodeGenerator::store_place(const Place& place, llvm::Value* value) {
+  if (!place.soa_index) {
+    builder_->CreateStore(value, place.address);
+    return;
+  }
+
+  // Scatter the element into the field arrays
+  for (unsigned i = 0; i < value->getType()->getStructNumElements(); ++i) {
+    llvm::Value* indices[] = {builder_->getInt64(0), builder_->getInt32(i), place.soa_index};
+    llvm::Value* address = builder_->CreateInBoundsGEP(place.type, place.address, indices);
+    builder_->CreateStore(builder_->CreateExtractValue(value, i, "field"), address);
+  }
+}
+
+// Scalar type of the lanes of a vector type, or the type itself
+static const TypePtr& scalar_type(const TypePtr& type) {
+  return type->is_vector() ? static_cast<const VectorType&>(*type).element_type : type;
+}
+
+llvm::Value* CodeGenerator::coerce(llvm::Value* value, const TypePtr& from, const TypePtr& to) {
+  return coerce(value, from, convert_type(to), scalar_type(to)->is_unsigned_integer());
+}
+
+llvm::Value* CodeGenerator::coerce(llvm::Value* value, const TypePtr& from, llvm::Type* to,
+                                   bool to_unsigned) {
+  llvm::Type* source = value->getType();
+  if (source == to) {
+    return value;
+  }
+
+  // Scalars convert to the element type, then fill every lane
+  if (auto* vector = llvm::dyn_cast<llvm::FixedVectorType>(to); vector && !source->isVectorTy()) {
+    return builder_->CreateVectorSplat(
+        vector->getNumElements(), coerce(value, from, vector->getElementType(), to_unsigned),
+        "splat");
+  }
+  // The resolver converts vectors only to themselves
+  if (source->isVectorTy() || to->isVectorTy()) {
+    throw CodeGenError("invalid conversion between vector types");
+  }
+
+  // Booleans and unsigned integers widen with zeros
+  bool is_signed = !from || from->is_signed_integer();
+
+  if (source->isIntegerTy() && to->isIntegerTy()) {
+    return builder_->CreateIntCast(value, to, is_signed, "conv");
+  }
+  if (source->isIntegerTy() && to->isFloatingPointTy()) {
+    return is_signed ? builder_->CreateSIToFP(value, to, "conv")
+                     : builder_->CreateUIToFP(value, to, "conv");
+  }
+  if (source->isFloatingPointTy() && to->isIntegerTy()) {
+    return to_unsigned ? builder_->CreateFPToUI(value, to, "conv")
+                       : builder_->CreateFPToSI(value, to, "conv");
+  }
+  if (source->isFloatingPointTy() && to->isFloatingPointTy()) {
+    return builder_->CreateFPCast(value, to, "conv");
+  }
+  return value;
+}
+
+void CodeGenerator::set_debug_location(uint32_t line, uint32_t column) {
+  // Nodes made up by the compiler have no position and keep the enclosing one
+  if (di_subprogram_ && line > 0) {
+    builder_->SetCurrentDebugLocation(
+        llvm::DILocation::get(*context_, line, column, di_subprogram_));
+  }
+}
+
+llvm::DIType* CodeGenerator::debug_type(const TypePtr& type) {
+  const llvm::DataLayout& layout = module_->getDataLayout();
+  if (type->is_void()) {
+    return nullptr;
+  }
+  if (type->is_pointer()) {
+    return di_builder_->createPointerType(
+        debug_type(static_cast<const PointerType&>(*type).pointee),
+        layout.getPointerSizeInBits());
   }
-  // Globals are always considered mutable for now
-  llvm::GlobalVariable* global = module_->getNamedGlobal(name);
-  if (global) {
-    return true;
+
+  unsigned encoding = 0;
+  if (type->is_boolean()) {
+    encoding = llvm::dwarf::DW_ATE_boolean;
+  } else if (type->is_signed_integer()) {
+    encoding = llvm::dwarf::DW_ATE_signed;
+  } else if (type->is_unsigned_integer()) {
+    encoding = llvm::dwarf::DW_ATE_unsigned;
+  } else if (type->is_floating_point()) {
+    encoding = llvm::dwarf::DW_ATE_float;
+  } else {
+    // Profiles and backtraces need only the scalar types of signatures spelled out
+    return di_builder_->createUnspecifiedType(type->to_string());
   }
-  return false;
+  uint64_t bits = layout.getTypeAllocSizeInBits(convert_type(type)).getFixedValue();
+  return di_builder_->createBasicType(type->to_string(), bits, encoding);
 }
 
 llvm::AllocaInst* CodeGenerator::create_alloca(llvm::Type* type, const std::string& name) {
@@ -212,36 +863,48 @@ void CodeGenerator::visit(StringLiteralExpr& expr) {
 }
 
 void CodeGenerator::visit(VariableExpr& expr) {
-  llvm::Value* var = get_variable(expr.name);
-  if (!var) {
-    throw CodeGenError("unknown variable: '" + expr.name + "'",
-                       SourceLocation(expr.line, expr.column, expr.name.length()));
-  }
+  llvm::Type* type = nullptr;
+  llvm::Value* var = get_variable(expr, type);
 
   // Load the value (unless it's a pointer we're taking the address of)
   // For now, always load
-  llvm::Value* loaded =
-      builder_->CreateLoad(convert_type(expr.type ? expr.type : get_int32_type()), var, expr.name);
+  llvm::Value* loaded = builder_->CreateLoad(type, var, expr.name);
   push_value(loaded);
 }
 
 void CodeGenerator::visit(BinaryOpExpr& expr) {
-  // Generate left and right
+  // Generate left and right, converted to their common type
   llvm::Value* left = codegen_expr(*expr.left);
   llvm::Value* right = codegen_expr(*expr.right);
 
-  llvm::Value* result = codegen_binary_op(expr.op, left, right, expr.type);
+  TypePtr operand_type = common_type(expr.left->type, expr.right->type);
+  if (operand_type) {
+    left = coerce(left, expr.left->type, operand_type);
+    right = coerce(right, expr.right->type, operand_type);
+  } else {
+    operand_type = expr.left->type;
+  }
+
+  // Unsigned integers, booleans and pointers order and divide unsigned
+  bool is_signed = scalar_type(operand_type)->is_signed_integer();
+  llvm::Value* result = codegen_binary_op(expr.op, left, right, is_signed);
   push_value(result);
 }
 
 void CodeGenerator::visit(UnaryOpExpr& expr) {
+  // The resolver only lets this through for operands that have an address
+  if (expr.op == UnaryOp::AddrOf) {
+    push_value(codegen_place(*expr.operand).address);
+    return;
+  }
+
   llvm::Value* operand = codegen_expr(*expr.operand);
 
   llvm::Value* result = nullptr;
 
   switch (expr.op) {
   case UnaryOp::Neg:
-    if (operand->getType()->isFloatingPointTy()) {
+    if (operand->getType()->isFPOrFPVectorTy()) {
       result = builder_->CreateFNeg(operand, "negtmp");
     } else {
       result = builder_->CreateNeg(operand, "negtmp");
@@ -253,57 +916,135 @@ void CodeGenerator::visit(UnaryOpExpr& expr) {
   case UnaryOp::Deref:
     result = builder_->CreateLoad(convert_type(expr.type), operand, "deref");
     break;
-  case UnaryOp::AddrOf: {
-    // This is tricky - we need the alloca, not the loaded value
-    // For now, this won't work correctly with our current approach
-    // We need to handle this specially in the parser/codegen
-    auto& var_expr = static_cast<VariableExpr&>(*expr.operand);
-    llvm::Value* var = get_variable(var_expr.name);
-    result = var; // Return the pointer directly
+  case UnaryOp::AddrOf:
     break;
   }
-  }
 
   push_value(result);
 }
 
 void CodeGenerator::visit(CallExpr& expr) {
+  if (expr.builtin != Builtin::None) {
+    push_value(codegen_builtin(expr));
+    return;
+  }
+
   // Get function
   auto& var_expr = static_cast<VariableExpr&>(*expr.callee);
-  llvm::Function* callee = module_->getFunction(var_expr.name);
-  if (!callee) {
+  if (var_expr.binding.kind != BindingKind::Function) {
     throw CodeGenError("unknown function: '" + var_expr.name + "'",
                        SourceLocation(expr.line, expr.column, var_expr.name.length()));
   }
+  llvm::Function* callee = functions_[var_expr.binding.index];
 
   // Generate arguments
   std::vector<llvm::Value*> args;
-  for (auto& arg : expr.arguments) {
-    args.push_back(codegen_expr(*arg));
+  for (size_t i = 0; i < expr.arguments.size(); ++i) {
+    llvm::Value* arg = codegen_expr(*expr.arguments[i]);
+    args.push_back(coerce(arg, expr.arguments[i]->type,
+                          function_decls_[var_expr.binding.index]->params[i].type));
   }
 
-  llvm::Value* result = builder_->CreateCall(callee, args, "calltmp");
+  // Void results cannot be named
+  const char* name = callee->getReturnType()->isVoidTy() ? "" : "calltmp";
+  llvm::Value* result = builder_->CreateCall(callee, args, name);
   push_value(result);
 }
 
+llvm::Value* CodeGenerator::codegen_builtin(CallExpr& expr) {
+  auto argument = [&](size_t i, llvm::Type* type) {
+    llvm::Value* value = codegen_expr(*expr.arguments[i]);
+    return type ? coerce(value, expr.arguments[i]->type, type) : value;
+  };
+
+  switch (expr.builtin) {
+  case Builtin::StructConstruct: {
+    llvm::Type* type = convert_type(expr.type);
+    const auto& fields = static_cast<const StructType&>(*expr.type).fields;
+    llvm::Value* value = llvm::Constant::getNullValue(type);
+    for (size_t i = 0; i < expr.arguments.size(); ++i) {
+      llvm::Value* field = argument(i, convert_type(fields[i].second));
+      value = builder_->CreateInsertValue(value, field, static_cast<unsigned>(i), "fields");
+    }
+    return value;
+  }
+  case Builtin::VectorConstruct: {
+    auto* type = llvm::cast<llvm::FixedVectorType>(convert_type(expr.type));
+    llvm::Type* element = type->getElementType();
+    if (expr.arguments.size() == 1) {
+      return builder_->CreateVectorSplat(type->getNumElements(), argument(0, element), "splat");
+    }
+    // Constant lanes fold into a constant vector
+    llvm::Value* vector = llvm::PoisonValue::get(type);
+    for (size_t i = 0; i < expr.arguments.size(); ++i) {
+      vector = builder_->CreateInsertElement(vector, argument(i, element), uint64_t(i), "lanes");
+    }
+    return vector;
+  }
+  case Builtin::Shuffle: {
+    llvm::Value* first = argument(0, nullptr);
+    llvm::Value* second = argument(1, nullptr);
+    llvm::SmallVector<int, 16> mask;
+    for (size_t i = 2; i < expr.arguments.size(); ++i) {
+      mask.push_back(static_cast<int>(static_cast<IntegerLiteralExpr&>(*expr.arguments[i]).value));
+    }
+    return builder_->CreateShuffleVector(first, second, mask, "shuffle");
+  }
+  case Builtin::Select: {
+    llvm::Type* type = convert_type(expr.type);
+    llvm::Value* mask = argument(0, nullptr);
+    llvm::Value* if_true = argument(1, type);
+    llvm::Value* if_false = argument(2, type);
+    return builder_->CreateSelect(mask, if_true, if_false, "select");
+  }
+  default:
+    break;
+  }
+
+  // Horizontal reductions; floating-point lanes may be combined in any order
+  llvm::Value* vector = argument(0, nullptr);
+  bool is_fp = expr.type->is_floating_point();
+  bool is_signed = expr.type->is_signed_integer();
+  llvm::Type* element = convert_type(expr.type);
+  llvm::CallInst* result = nullptr;
+  switch (expr.builtin) {
+  case Builtin::ReduceAdd:
+    if (!is_fp)
+      return builder_->CreateAddReduce(vector);
+    result = builder_->CreateFAddReduce(llvm::ConstantFP::getNegativeZero(element), vector);
+    break;
+  case Builtin::ReduceMul:
+    if (!is_fp)
+      return builder_->CreateMulReduce(vector);
+    result = builder_->CreateFMulReduce(llvm::ConstantFP::get(element, 1.0), vector);
+    break;
+  case Builtin::ReduceMin:
+    return is_fp ? builder_->CreateFPMinReduce(vector)
+                 : builder_->CreateIntMinReduce(vector, is_signed);
+  case Builtin::ReduceMax:
+    return is_fp ? builder_->CreateFPMaxReduce(vector)
+                 : builder_->CreateIntMaxReduce(vector, is_signed);
+  default:
+    throw CodeGenError("unknown builtin", SourceLocation(expr.line, expr.column));
+  }
+  result->setHasAllowReassoc(true);
+  return result;
+}
+
 void CodeGenerator::visit(IndexExpr& expr) {
-  llvm::Value* array = codegen_expr(*expr.array);
-  llvm::Value* index = codegen_expr(*expr.index);
-
-  // For arrays: GEP to get element pointer, then load
-  std::vector<llvm::Value*> indices = {llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context_), 0),
-                                       index};
-  llvm::Value* elem_ptr = get_element_ptr(array, indices, convert_type(expr.type));
-  llvm::Value* loaded = builder_->CreateLoad(convert_type(expr.type), elem_ptr, "elem");
-  push_value(loaded);
+  if (expr.array->type->is_vector()) {
+    llvm::Value* vector = codegen_expr(*expr.array);
+    llvm::Value* index = codegen_expr(*expr.index);
+    push_value(builder_->CreateExtractElement(vector, index, "lane"));
+    return;
+  }
+
+  // Elements of arrays and pointers are loaded from their address
+  push_value(load_place(codegen_place(expr), convert_type(expr.type)));
 }
 
 void CodeGenerator::visit(FieldAccessExpr& expr) {
-  llvm::Value* obj = codegen_expr(*expr.object);
-
-  // This would need struct type info to work properly
-  // For now, just push a placeholder
-  push_value(obj);
+  push_value(load_place(codegen_place(expr), convert_type(expr.type)));
 }
 
 void CodeGenerator::visit(CastExpr& expr) {
@@ -314,12 +1055,17 @@ void CodeGenerator::visit(CastExpr& expr) {
 
   llvm::Value* result = nullptr;
 
+  // Integers extend and convert by the signedness of the source, floats by that of the target
+  bool from_signed = expr.expr->type->is_signed_integer();
+  bool to_unsigned = expr.target_type->is_unsigned_integer();
   if (source->isIntegerTy() && target->isFloatingPointTy()) {
-    result = builder_->CreateSIToFP(val, target, "sitofp");
+    result = from_signed ? builder_->CreateSIToFP(val, target, "sitofp")
+                         : builder_->CreateUIToFP(val, target, "uitofp");
   } else if (source->isFloatingPointTy() && target->isIntegerTy()) {
-    result = builder_->CreateFPToSI(val, target, "fptosi");
+    result = to_unsigned ? builder_->CreateFPToUI(val, target, "fptoui")
+                         : builder_->CreateFPToSI(val, target, "fptosi");
   } else if (source->isIntegerTy() && target->isIntegerTy()) {
-    result = builder_->CreateIntCast(val, target, true, "intcast");
+    result = builder_->CreateIntCast(val, target, from_signed, "intcast");
   } else if (source->isFloatingPointTy() && target->isFloatingPointTy()) {
     result = builder_->CreateFPCast(val, target, "fpcast");
   } else {
@@ -350,50 +1096,41 @@ void CodeGenerator::visit(LetStmt& stmt) {
   llvm::Type* llvm_type = convert_type(var_type);
   llvm::AllocaInst* alloca = create_alloca(llvm_type, stmt.name);
 
+  // Without an initializer the variable starts out zeroed
+  llvm::Value* init_val = llvm::Constant::getNullValue(llvm_type);
   if (stmt.initializer) {
-    llvm::Value* init_val = codegen_expr(*stmt.initializer);
-    builder_->CreateStore(init_val, alloca);
+    init_val = coerce(codegen_expr(*stmt.initializer), stmt.initializer->type, var_type);
   }
+  builder_->CreateStore(init_val, alloca);
 
-  set_variable(stmt.name, alloca, stmt.is_mutable);
+  locals_[stmt.slot] = alloca;
 }
 
 void CodeGenerator::visit(AssignStmt& stmt) {
   llvm::Value* val = codegen_expr(*stmt.value);
 
-  // Get the target (should be a variable or field access)
-  if (stmt.target->kind == ExprKind::Variable) {
-    auto& var = static_cast<VariableExpr&>(*stmt.target);
-    llvm::Value* ptr = get_variable(var.name);
-    if (!ptr) {
-      throw CodeGenError("unknown variable: '" + var.name + "'",
-                         SourceLocation(var.line, var.column, var.name.length()));
-    }
-    // Check if variable is mutable
-    if (!is_variable_mutable(var.name)) {
-      throw CodeGenError("cannot assign to immutable variable '" + var.name + "'",
-                         SourceLocation(var.line, var.column, var.name.length()));
-    }
-    builder_->CreateStore(val, ptr);
-  } else if (stmt.target->kind == ExprKind::Index) {
-    // Array assignment
+  // Mutability was checked during resolution
+  if (stmt.target->kind == ExprKind::Index) {
     auto& idx = static_cast<IndexExpr&>(*stmt.target);
-    llvm::Value* array = codegen_expr(*idx.array);
-    llvm::Value* index = codegen_expr(*idx.index);
-
-    std::vector<llvm::Value*> indices = {
-        llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context_), 0), index};
-    llvm::Value* elem_ptr = get_element_ptr(array, indices, convert_type(stmt.value->type));
-    builder_->CreateStore(val, elem_ptr);
+    if (idx.array->type->is_vector()) {
+      // Replace one lane of the vector where it is stored
+      Place place = codegen_place(*idx.array);
+      llvm::Value* vector = load_place(place, place.type);
+      llvm::Value* lane = coerce(val, stmt.value->type, scalar_type(idx.array->type));
+      llvm::Value* index = codegen_expr(*idx.index);
+      store_place(place, builder_->CreateInsertElement(vector, lane, index, "lanes"));
+      return;
+    }
   }
+
+  Place place = codegen_place(*stmt.target);
+  store_place(place, coerce(val, stmt.value->type, stmt.target->type));
 }
 
 void CodeGenerator::visit(BlockStmt& stmt) {
-  enter_scope();
   for (auto& s : stmt.statements) {
     codegen_stmt(*s);
   }
-  exit_scope();
 }
 
 void CodeGenerator::visit(IfStmt& stmt) {
@@ -453,7 +1190,8 @@ void CodeGenerator::visit(WhileStmt& stmt) {
   codegen_stmt(*stmt.body);
 
   if (!builder_->GetInsertBlock()->getTerminator()) {
-    builder_->CreateBr(cond_bb);
+    llvm::BranchInst* back_edge = builder_->CreateBr(cond_bb);
+    attach_loop_hints(stmt.hints, back_edge, cond_bb, body_bb);
   }
 
   // End
@@ -472,54 +1210,77 @@ void CodeGenerator::visit(ForStmt& stmt) {
 
   loop_stack_.push_back({step_bb, end_bb});
 
-  enter_scope();
-
-  // Initialize loop variable
-  llvm::AllocaInst* loop_var = create_alloca(llvm::Type::getInt32Ty(*context_), stmt.var_name);
+  // Initialize the loop variable, which has the range's integer type
+  TypePtr range_type = stmt.var_type ? stmt.var_type : get_int32_type();
+  bool is_unsigned = range_type->is_unsigned_integer();
+  llvm::Type* var_type = convert_type(range_type);
+  llvm::AllocaInst* loop_var = create_alloca(var_type, stmt.var_name);
   llvm::Value* start_val = codegen_expr(*stmt.range_start);
-  builder_->CreateStore(start_val, loop_var);
-  set_variable(stmt.var_name, loop_var);
+  builder_->CreateStore(coerce(start_val, stmt.range_start->type, range_type), loop_var);
+  locals_[stmt.slot] = loop_var;
 
-  llvm::Value* end_val = codegen_expr(*stmt.range_end);
+  // The end is evaluated once, before the first iteration
+  llvm::Value* end_val =
+      coerce(codegen_expr(*stmt.range_end), stmt.range_end->type, range_type);
 
   builder_->CreateBr(cond_bb);
 
   // Condition
   builder_->SetInsertPoint(cond_bb);
-  llvm::Value* current =
-      builder_->CreateLoad(llvm::Type::getInt32Ty(*context_), loop_var, stmt.var_name);
-  llvm::Value* cond = builder_->CreateICmpSLT(current, end_val, "forcond");
+  llvm::Value* current = builder_->CreateLoad(var_type, loop_var, stmt.var_name);
+  llvm::Value* cond = is_unsigned ? builder_->CreateICmpULT(current, end_val, "forcond")
+                                  : builder_->CreateICmpSLT(current, end_val, "forcond");
   builder_->CreateCondBr(cond, body_bb, end_bb);
 
-  // Body
+  // Body. The variable cannot be assigned, so in the body it lies between the lowest start
+  // and below the highest end; indexes computed from it may need no bounds checks. A pointer
+  // to it could write anything, so then nothing is known.
+  if (options_.bounds_check && !stmt.var_address_taken) {
+    auto start = index_range(*stmt.range_start);
+    auto end = index_range(*stmt.range_end);
+    if (start && end && start->low < end->high) {
+      loop_ranges_[stmt.slot] = {start->low, end->high - 1};
+    }
+  }
   builder_->SetInsertPoint(body_bb);
   codegen_stmt(*stmt.body);
   if (!builder_->GetInsertBlock()->getTerminator()) {
     builder_->CreateBr(step_bb);
   }
+  loop_ranges_.erase(stmt.slot);
 
-  // Step
+  // Step; the variable is below the end, so the increment cannot wrap. A store through a
+  // pointer to it could have set it to anything, and then the increment wraps like any other.
   builder_->SetInsertPoint(step_bb);
-  llvm::Value* step_val =
-      builder_->CreateLoad(llvm::Type::getInt32Ty(*context_), loop_var, stmt.var_name);
-  llvm::Value* next_val = builder_->CreateAdd(
-      step_val, llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context_), 1), "next");
+  llvm::Value* step_val = builder_->CreateLoad(var_type, loop_var, stmt.var_name);
+  bool in_range = !stmt.var_address_taken;
+  llvm::Value* next_val = builder_->CreateAdd(step_val, llvm::ConstantInt::get(var_type, 1), "next",
+                                              in_range && is_unsigned, in_range && !is_unsigned);
   builder_->CreateStore(next_val, loop_var);
-  builder_->CreateBr(cond_bb);
+  llvm::BranchInst* back_edge = builder_->CreateBr(cond_bb);
+  attach_loop_hints(stmt.hints, back_edge, cond_bb, body_bb);
 
   // End
   builder_->SetInsertPoint(end_bb);
 
-  exit_scope();
   loop_stack_.pop_back();
 }
 
 void CodeGenerator::visit(ReturnStmt& stmt) {
-  if (stmt.value) {
-    llvm::Value* val = codegen_expr(*stmt.value);
-    builder_->CreateRet(val);
-  } else {
+  llvm::Value* val = stmt.value ? codegen_expr(*stmt.value) : nullptr;
+
+  // The resolver checked that become's call can reuse the frame; a call folded to a constant
+  // needs no frame at all
+  if (stmt.is_tail_call) {
+    if (auto* call = llvm::dyn_cast<llvm::CallInst>(val)) {
+      call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    }
+  }
+
+  if (!val || current_function_->getReturnType()->isVoidTy()) {
     builder_->CreateRetVoid();
+  } else {
+    builder_->CreateRet(coerce(val, stmt.value->type, current_return_type_));
   }
 }
 
@@ -537,9 +1298,35 @@ void CodeGenerator::declare_function(FunctionDecl& decl) {
   llvm::Type* ret_type = convert_type(decl.return_type);
   llvm::FunctionType* func_type = llvm::FunctionType::get(ret_type, param_types, false);
 
-  // Create function
-  llvm::Function* function =
-      llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, decl.name, module_.get());
+  // Functions are private to their module unless exported; main is the entry point and
+  // externs are defined elsewhere. Split codegen units call into each other, so there the
+  // functions stay external, hidden from outside the executable; so do incremental modules.
+  bool is_local = !decl.is_extern && !decl.is_export && decl.name != "main";
+  bool is_split = options_.unit_count > 1;
+  auto linkage = is_local && !is_split && !options_.incremental
+                     ? llvm::Function::InternalLinkage
+                     : llvm::Function::ExternalLinkage;
+  llvm::Function* function = llvm::Function::Create(func_type, linkage, decl.name, module_.get());
+  if (is_local && is_split) {
+    function->setVisibility(llvm::GlobalValue::HiddenVisibility);
+  }
+
+  // tuz has no exceptions, so nothing unwinds through its frames. The optimizer infers the
+  // rest (memory effects, willreturn, norecurse) from the bodies.
+  function->setDoesNotThrow();
+  if (decl.inline_hint == InlineHint::Inline) {
+    function->addFnAttr(llvm::Attribute::InlineHint);
+  } else if (decl.inline_hint == InlineHint::NoInline) {
+    function->addFnAttr(llvm::Attribute::NoInline);
+  }
+
+  // Let the vectorizers and backend use the selected CPU
+  if (!target_cpu_.empty()) {
+    function->addFnAttr("target-cpu", target_cpu_);
+  }
+  if (!target_features_.empty()) {
+    function->addFnAttr("target-features", target_features_);
+  }
 
   // Set parameter names
   size_t idx = 0;
@@ -547,11 +1334,36 @@ void CodeGenerator::declare_function(FunctionDecl& decl) {
     arg.setName(decl.params[idx++].name);
   }
 
-  functions_[decl.name] = function;
+  if (functions_.size() <= decl.index) {
+    functions_.resize(decl.index + 1);
+  }
+  functions_[decl.index] = function;
+}
+
+// Calls whose result is returned right away may reuse the caller's frame once no local's
+// address can escape to them. Marking them 'tail' lets the backend emit a jump even when the
+// optimizer does not run; become's calls are musttail already.
+static void mark_tail_calls(llvm::Function& function) {
+  for (auto& inst : llvm::instructions(function)) {
+    if (llvm::isa<llvm::AllocaInst>(inst) && llvm::PointerMayBeCaptured(&inst, true, true)) {
+      return;
+    }
+  }
+  for (auto& block : function) {
+    auto* ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator());
+    auto* call = ret ? llvm::dyn_cast_or_null<llvm::CallInst>(ret->getPrevNode()) : nullptr;
+    if (!call || call->isMustTailCall() || !call->getCalledFunction() ||
+        call->getCalledFunction()->isIntrinsic()) {
+      continue;
+    }
+    if (ret->getReturnValue() == call || call->getType()->isVoidTy()) {
+      call->setTailCallKind(llvm::CallInst::TCK_Tail);
+    }
+  }
 }
 
 void CodeGenerator::generate_function_body(FunctionDecl& decl) {
-  llvm::Function* function = functions_[decl.name];
+  llvm::Function* function = decl.index < functions_.size() ? functions_[decl.index] : nullptr;
   if (!function) {
     throw CodeGenError("Function not declared: " + decl.name);
   }
@@ -561,17 +1373,38 @@ void CodeGenerator::generate_function_body(FunctionDecl& decl) {
   }
 
   current_function_ = function;
+  current_return_type_ = decl.return_type;
 
   llvm::BasicBlock* entry = llvm::BasicBlock::Create(*context_, "entry", function);
   builder_->SetInsertPoint(entry);
 
-  enter_scope();
+  if (di_builder_) {
+    llvm::SmallVector<llvm::Metadata*, 8> signature{debug_type(decl.return_type)};
+    for (auto& param : decl.params) {
+      signature.push_back(debug_type(param.type));
+    }
+    auto flags = llvm::DISubprogram::SPFlagDefinition;
+    if (options_.opt_level > 0) {
+      flags |= llvm::DISubprogram::SPFlagOptimized;
+    }
+    if (function->hasLocalLinkage()) {
+      flags |= llvm::DISubprogram::SPFlagLocalToUnit;
+    }
+    di_subprogram_ = di_builder_->createFunction(
+        di_file_, decl.name, "", di_file_, decl.line,
+        di_builder_->createSubroutineType(di_builder_->getOrCreateTypeArray(signature)),
+        decl.line, llvm::DINode::FlagPrototyped, flags);
+    function->setSubprogram(di_subprogram_);
+    set_debug_location(decl.line, decl.column);
+  }
 
-  // Create allocas for parameters
+  // Create allocas for parameters; parameter i lives in local slot i
+  locals_.assign(decl.local_count, nullptr);
+  bounds_trap_ = nullptr;
   for (auto& arg : function->args()) {
     llvm::AllocaInst* alloca = create_alloca(arg.getType(), std::string(arg.getName()));
     builder_->CreateStore(&arg, alloca);
-    set_variable(std::string(arg.getName()), alloca);
+    locals_[arg.getArgNo()] = alloca;
   }
 
   // Generate body
@@ -585,16 +1418,23 @@ void CodeGenerator::generate_function_body(FunctionDecl& decl) {
     if (decl.return_type->is_void()) {
       builder_->CreateRetVoid();
     } else {
-      builder_->CreateRet(llvm::ConstantInt::get(convert_type(decl.return_type), 0));
+      builder_->CreateRet(llvm::Constant::getNullValue(convert_type(decl.return_type)));
     }
   }
 
-  exit_scope();
+  mark_tail_calls(*function);
+
+  if (di_subprogram_) {
+    di_builder_->finalizeSubprogram(di_subprogram_);
+    di_subprogram_ = nullptr;
+    builder_->SetCurrentDebugLocation(llvm::DebugLoc());
+  }
 
   // Verify function
   llvm::verifyFunction(*function);
 
   current_function_ = nullptr;
+  current_return_type_ = nullptr;
 }
 
 void CodeGenerator::visit(FunctionDecl& decl) {
@@ -606,13 +1446,8 @@ void CodeGenerator::visit(FunctionDecl& decl) {
 }
 
 void CodeGenerator::visit(StructDecl& decl) {
-  std::vector<llvm::Type*> field_types;
-  for (auto& field : decl.fields) {
-    field_types.push_back(convert_type(field.type));
-  }
-
-  auto* struct_type = llvm::StructType::create(*context_, field_types, decl.name);
-  struct_types_[decl.name] = struct_type;
+  // Struct types are otherwise created on first use
+  convert_type(decl.type);
 }
 
 void CodeGenerator::visit(GlobalDecl& decl) {
@@ -627,26 +1462,39 @@ void CodeGenerator::visit(GlobalDecl& decl) {
   llvm::Type* llvm_type = convert_type(type);
   llvm::Constant* init = nullptr;
 
-  if (decl.initializer) {
-    // For simple literals, we can evaluate them
-    if (decl.initializer->kind == ExprKind::IntegerLiteral) {
-      auto& lit = static_cast<IntegerLiteralExpr&>(*decl.initializer);
-      init = llvm::ConstantInt::get(llvm_type, lit.value);
-    } else if (decl.initializer->kind == ExprKind::FloatLiteral) {
-      auto& lit = static_cast<FloatLiteralExpr&>(*decl.initializer);
-      init = llvm::ConstantFP::get(llvm_type, lit.value);
-    } else if (decl.initializer->kind == ExprKind::BoolLiteral) {
-      auto& lit = static_cast<BoolLiteralExpr&>(*decl.initializer);
-      init = llvm::ConstantInt::get(llvm_type, lit.value ? 1 : 0);
+  // Only unit 0 defines globals, so only it checks their initializers; the other units refer to
+  // its definitions, as incremental modules refer to those of earlier ones
+  if (options_.unit_index == 0 && decl.index >= first_new_global_) {
+    // Initializers are evaluated at compile time, never at startup
+    if (decl.initializer && constants_) {
+      auto value = constants_->global_value(decl.index);
+      if (!value) {
+        throw CodeGenError("initializer of global '" + decl.name +
+                               "' is not a constant expression",
+                           SourceLocation(decl.initializer->line, decl.initializer->column));
+      }
+      init = codegen_constant(*value);
+    }
+    if (!init) {
+      init = llvm::Constant::getNullValue(llvm_type);
     }
   }
 
-  if (!init) {
-    init = llvm::Constant::getNullValue(llvm_type);
+  // Other files cannot name a global, so it is private to its module like an unexported
+  // function. Split codegen units and incremental modules refer to the definition in another
+  // module, so there it stays external, hidden from outside the executable.
+  bool is_shared = options_.unit_count > 1 || options_.incremental;
+  auto linkage = is_shared ? llvm::GlobalValue::ExternalLinkage
+                           : llvm::GlobalValue::InternalLinkage;
+  auto* global =
+      new llvm::GlobalVariable(*module_, llvm_type, !decl.is_mutable, linkage, init, decl.name);
+  if (is_shared) {
+    global->setVisibility(llvm::GlobalValue::HiddenVisibility);
   }
-
-  new llvm::GlobalVariable(*module_, llvm_type, !decl.is_mutable,
-                           llvm::GlobalValue::ExternalLinkage, init, decl.name);
+  if (globals_.size() <= decl.index) {
+    globals_.resize(decl.index + 1);
+  }
+  globals_[decl.index] = global;
 }
 
 // =============================================================================
@@ -654,11 +1502,38 @@ void CodeGenerator::visit(GlobalDecl& decl) {
 // =============================================================================
 
 llvm::Value* CodeGenerator::codegen_expr(Expr& expr) {
+  // Fold operators, casts, immutable globals and pure calls whose operands are all constant;
+  // literals are constants already
+  if (constants_ && expr.kind != ExprKind::IntegerLiteral &&
+      expr.kind != ExprKind::FloatLiteral && expr.kind != ExprKind::BoolLiteral) {
+    if (auto value = constants_->evaluate(expr)) {
+      return codegen_constant(*value);
+    }
+  }
+  if (!di_subprogram_) {
+    visit_expr(*this, expr);
+    return pop_value();
+  }
+
+  // Operators after a call or a nested operand belong to this expression again
+  llvm::DebugLoc outer = builder_->getCurrentDebugLocation();
+  set_debug_location(expr.line, expr.column);
   visit_expr(*this, expr);
+  builder_->SetCurrentDebugLocation(outer);
   return pop_value();
 }
 
+llvm::Constant* CodeGenerator::codegen_constant(const ConstValue& value) {
+  llvm::Type* type = convert_type(value.type);
+  if (value.is_floating_point()) {
+    return llvm::ConstantFP::get(type, value.real);
+  }
+  return llvm::ConstantInt::get(type, static_cast<uint64_t>(value.integer),
+                                value.type->is_signed_integer());
+}
+
 void CodeGenerator::codegen_stmt(Stmt& stmt) {
+  set_debug_location(stmt.line, stmt.column);
   visit_stmt(*this, stmt);
 }
 
@@ -667,9 +1542,10 @@ void CodeGenerator::codegen_decl(Decl& decl) {
 }
 
 llvm::Value* CodeGenerator::codegen_binary_op(BinaryOp op, llvm::Value* left, llvm::Value* right,
-                                              TypePtr result_type) {
+                                              bool is_signed) {
+  // Vector operands work lane by lane
   llvm::Type* type = left->getType();
-  bool is_fp = type->isFloatingPointTy();
+  bool is_fp = type->isFPOrFPVectorTy();
 
   switch (op) {
   case BinaryOp::Add:
@@ -682,11 +1558,17 @@ llvm::Value* CodeGenerator::codegen_binary_op(BinaryOp op, llvm::Value* left, ll
     return is_fp ? builder_->CreateFMul(left, right, "multmp")
                  : builder_->CreateMul(left, right, "multmp");
   case BinaryOp::Div:
-    return is_fp ? builder_->CreateFDiv(left, right, "divtmp")
-                 : builder_->CreateSDiv(left, right, "divtmp");
+    if (is_fp) {
+      return builder_->CreateFDiv(left, right, "divtmp");
+    }
+    return is_signed ? builder_->CreateSDiv(left, right, "divtmp")
+                     : builder_->CreateUDiv(left, right, "divtmp");
   case BinaryOp::Mod:
-    return is_fp ? builder_->CreateFRem(left, right, "modtmp")
-                 : builder_->CreateSRem(left, right, "modtmp");
+    if (is_fp) {
+      return builder_->CreateFRem(left, right, "modtmp");
+    }
+    return is_signed ? builder_->CreateSRem(left, right, "modtmp")
+                     : builder_->CreateURem(left, right, "modtmp");
   case BinaryOp::Eq:
     return is_fp ? builder_->CreateFCmpOEQ(left, right, "eqtmp")
                  : builder_->CreateICmpEQ(left, right, "eqtmp");
@@ -694,17 +1576,29 @@ llvm::Value* CodeGenerator::codegen_binary_op(BinaryOp op, llvm::Value* left, ll
     return is_fp ? builder_->CreateFCmpONE(left, right, "neqtmp")
                  : builder_->CreateICmpNE(left, right, "neqtmp");
   case BinaryOp::Lt:
-    return is_fp ? builder_->CreateFCmpOLT(left, right, "lttmp")
-                 : builder_->CreateICmpSLT(left, right, "lttmp");
+    if (is_fp) {
+      return builder_->CreateFCmpOLT(left, right, "lttmp");
+    }
+    return is_signed ? builder_->CreateICmpSLT(left, right, "lttmp")
+                     : builder_->CreateICmpULT(left, right, "lttmp");
   case BinaryOp::Gt:
-    return is_fp ? builder_->CreateFCmpOGT(left, right, "gttmp")
-                 : builder_->CreateICmpSGT(left, right, "gttmp");
+    if (is_fp) {
+      return builder_->CreateFCmpOGT(left, right, "gttmp");
+    }
+    return is_signed ? builder_->CreateICmpSGT(left, right, "gttmp")
+                     : builder_->CreateICmpUGT(left, right, "gttmp");
   case BinaryOp::Leq:
-    return is_fp ? builder_->CreateFCmpOLE(left, right, "leqtmp")
-                 : builder_->CreateICmpSLE(left, right, "leqtmp");
+    if (is_fp) {
+      return builder_->CreateFCmpOLE(left, right, "leqtmp");
+    }
+    return is_signed ? builder_->CreateICmpSLE(left, right, "leqtmp")
+                     : builder_->CreateICmpULE(left, right, "leqtmp");
   case BinaryOp::Geq:
-    return is_fp ? builder_->CreateFCmpOGE(left, right, "geqtmp")
-                 : builder_->CreateICmpSGE(left, right, "geqtmp");
+    if (is_fp) {
+      return builder_->CreateFCmpOGE(left, right, "geqtmp");
+    }
+    return is_signed ? builder_->CreateICmpSGE(left, right, "geqtmp")
+                     : builder_->CreateICmpUGE(left, right, "geqtmp");
   case BinaryOp::And:
     return builder_->CreateAnd(left, right, "andtmp");
   case BinaryOp::Or:
@@ -714,63 +1608,207 @@ llvm::Value* CodeGenerator::codegen_binary_op(BinaryOp op, llvm::Value* left, ll
   }
 }
 
-llvm::Value* CodeGenerator::get_element_ptr(llvm::Value* ptr,
-                                            const std::vector<llvm::Value*>& indices,
-                                            llvm::Type* elem_type) {
-  return builder_->CreateGEP(elem_type, ptr, indices, "gep");
+void CodeGenerator::attach_loop_hints(const LoopHints& hints, llvm::BranchInst* back_edge,
+                                      llvm::BasicBlock* header, llvm::BasicBlock* body) {
+  if (hints.empty()) {
+    return;
+  }
+
+  auto* int1 = llvm::Type::getInt1Ty(*context_);
+  auto* int32 = llvm::Type::getInt32Ty(*context_);
+  auto property = [&](const char* name, llvm::Metadata* value = nullptr) -> llvm::Metadata* {
+    llvm::SmallVector<llvm::Metadata*, 2> operands = {llvm::MDString::get(*context_, name)};
+    if (value) {
+      operands.push_back(value);
+    }
+    return llvm::MDNode::get(*context_, operands);
+  };
+  auto constant = [](llvm::Type* type, uint64_t value) {
+    return llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(type, value));
+  };
+
+  // The first operand of a loop ID refers to the node itself
+  llvm::SmallVector<llvm::Metadata*, 8> properties = {nullptr};
+  if (hints.vectorize) {
+    properties.push_back(property("llvm.loop.vectorize.enable", constant(int1, *hints.vectorize)));
+  }
+  if (hints.vectorize_width) {
+    properties.push_back(
+        property("llvm.loop.vectorize.width", constant(int32, hints.vectorize_width)));
+  }
+  if (hints.interleave_count) {
+    properties.push_back(
+        property("llvm.loop.interleave.count", constant(int32, hints.interleave_count)));
+  }
+  if (hints.unroll_full) {
+    properties.push_back(property("llvm.loop.unroll.full"));
+  } else if (hints.unroll_count) {
+    properties.push_back(property("llvm.loop.unroll.count", constant(int32, hints.unroll_count)));
+  } else if (hints.unroll) {
+    properties.push_back(
+        property(*hints.unroll ? "llvm.loop.unroll.enable" : "llvm.loop.unroll.disable"));
+  }
+
+  if (hints.parallel) {
+    // Every memory access in the loop joins one access group, which the loop declares free of
+    // cross-iteration dependences. Nested loops keep the groups of their own hints too.
+    llvm::MDNode* group = llvm::MDNode::getDistinct(*context_, {});
+    llvm::SmallPtrSet<llvm::BasicBlock*, 16> visited = {header};
+    llvm::SmallVector<llvm::BasicBlock*, 16> worklist = {header, body};
+    visited.insert(body);
+    while (!worklist.empty()) {
+      llvm::BasicBlock* block = worklist.pop_back_val();
+      for (auto& inst : *block) {
+        if (inst.mayReadOrWriteMemory()) {
+          inst.setMetadata(llvm::LLVMContext::MD_access_group,
+                           llvm::uniteAccessGroups(
+                               inst.getMetadata(llvm::LLVMContext::MD_access_group), group));
+        }
+      }
+      // The loop's blocks are those reachable from the body without leaving through the header
+      if (block == header) {
+        continue;
+      }
+      for (llvm::BasicBlock* successor : llvm::successors(block)) {
+        if (visited.insert(successor).second) {
+          worklist.push_back(successor);
+        }
+      }
+    }
+    properties.push_back(property("llvm.loop.parallel_accesses", group));
+  }
+
+  llvm::MDNode* loop_id = llvm::MDNode::getDistinct(*context_, properties);
+  loop_id->replaceOperandWith(0, loop_id);
+  back_edge->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
 }
 
 // =============================================================================
 // Output
 // =============================================================================
 
+int32_t CodeGenerator::execute_jit(const std::string& entry_function,
+                                   const std::vector<std::string>& args) {
+  if (!module_) {
+    throw CodeGenError("module has already been handed over");
+  }
+
+  llvm::Function* entry = module_->getFunction(entry_function);
+  if (!entry || entry->isDeclaration()) {
+    throw CodeGenError("entry function '" + entry_function + "' not found");
+  }
+
+  bool returns_void = entry->getReturnType()->isVoidTy();
+  if (!returns_void && !entry->getReturnType()->isIntegerTy(32)) {
+    throw CodeGenError("entry function '" + entry_function + "' must return i32 or void");
+  }
+  size_t param_count = entry->arg_size();
+  if (param_count != 0 && !(param_count == 2 && !returns_void)) {
+    throw CodeGenError("entry function '" + entry_function +
+                       "' must take no parameters or (argc, argv)");
+  }
+
+  llvm::orc::LLJITBuilder builder;
+  configure_jit(builder, options_);
+  auto jit = builder.create();
+  if (!jit) {
+    throw CodeGenError("could not create JIT: " + llvm::toString(jit.takeError()));
+  }
+  jit_ = std::move(*jit);
+
+  // Resolve extern functions (puts, malloc, ...) against the host process
+  auto process_symbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      jit_->getDataLayout().getGlobalPrefix());
+  if (!process_symbols) {
+    throw CodeGenError(llvm::toString(process_symbols.takeError()));
+  }
+  jit_->getMainJITDylib().addGenerator(std::move(*process_symbols));
+
+  if (!owned_context_) {
+    throw CodeGenError("the JIT needs a generator that owns its LLVM context");
+  }
+
+  builder_->ClearInsertionPoint();
+  llvm::orc::ThreadSafeModule module(std::move(module_), std::move(owned_context_));
+  if (auto err = jit_->addIRModule(std::move(module))) {
+    throw CodeGenError(llvm::toString(std::move(err)));
+  }
+
+  auto symbol = jit_->lookup(entry_function);
+  if (!symbol) {
+    throw CodeGenError(llvm::toString(symbol.takeError()));
+  }
+
+  if (param_count == 2) {
+    auto main_fn = symbol->toPtr<int (*)(int, char**)>();
+    llvm::ArrayRef<std::string> argv(args);
+    std::string program_name = argv.empty() ? entry_function : argv.front();
+    return llvm::orc::runAsMain(main_fn, argv.drop_front(argv.empty() ? 0 : 1),
+                                llvm::StringRef(program_name));
+  }
+
+  if (returns_void) {
+    symbol->toPtr<void (*)()>()();
+    return 0;
+  }
+  return symbol->toPtr<int32_t (*)()>()();
+}
+
 void CodeGenerator::dump_ir(const std::string& filename) {
   std::error_code ec;
   llvm::raw_fd_ostream os(filename, ec, llvm::sys::fs::OF_None);
   if (ec) {
-    std::cerr << "Error opening file: " << ec.message() << std::endl;
-    return;
+    throw CodeGenError("could not open file '" + filename + "': " + ec.message());
   }
   module_->print(os, nullptr);
 }
 
 void CodeGenerator::compile_to_object(const std::string& filename) {
-  std::string target_triple_str = llvm::sys::getDefaultTargetTriple();
-  llvm::Triple target_triple(target_triple_str);
-  module_->setTargetTriple(target_triple.str());
-
-  std::string error;
-  auto target = llvm::TargetRegistry::lookupTarget(target_triple_str, error);
-  if (!target) {
-    std::cerr << "Error: " << error << std::endl;
-    return;
-  }
-
-  auto cpu = "generic";
-  auto features = "";
-
-  llvm::TargetOptions opt;
-  auto rm = llvm::Reloc::Model::PIC_;
-  auto target_machine = target->createTargetMachine(target_triple_str, cpu, features, opt, rm);
-
-  module_->setDataLayout(target_machine->createDataLayout());
-
   std::error_code ec;
   llvm::raw_fd_ostream dest(filename, ec, llvm::sys::fs::OF_None);
   if (ec) {
-    std::cerr << "Could not open file: " << ec.message() << std::endl;
-    return;
+    throw CodeGenError("could not open file '" + filename + "': " + ec.message());
   }
+  emit_object(dest);
+  dest.flush();
+}
+
+void CodeGenerator::compile_to_buffer(llvm::SmallVectorImpl<char>& object) {
+  llvm::raw_svector_ostream dest(object);
+  emit_object(dest);
+}
+
+void CodeGenerator::emit_object(llvm::raw_pwrite_stream& dest) {
+  llvm::TargetMachine* target_machine = get_target_machine();
 
   llvm::legacy::PassManager pass;
   auto file_type = llvm::CodeGenFileType::ObjectFile;
 
   if (target_machine->addPassesToEmitFile(pass, dest, nullptr, file_type)) {
-    std::cerr << "Target machine can't emit file of this type" << std::endl;
-    return;
+    throw CodeGenError("target '" + target_triple_ + "' cannot emit object files");
   }
 
   pass.run(*module_);
+}
+
+void CodeGenerator::compile_to_bitcode(const std::string& filename) {
+  // Sets the triple and data layout the bitcode is compiled for later
+  get_target_machine();
+
+  std::error_code ec;
+  llvm::raw_fd_ostream dest(filename, ec, llvm::sys::fs::OF_None);
+  if (ec) {
+    throw CodeGenError("could not open file '" + filename + "': " + ec.message());
+  }
+
+  if (options_.thin_lto) {
+    // The summary drives importing at the thin link; the module hash keys the backend cache
+    llvm::ProfileSummaryInfo psi(*module_);
+    llvm::ModuleSummaryIndex index = llvm::buildModuleSummaryIndex(*module_, nullptr, &psi);
+    llvm::WriteBitcodeToFile(*module_, dest, false, &index, true);
+  } else {
+    llvm::WriteBitcodeToFile(*module_, dest);
+  }
   dest.flush();
 }
 
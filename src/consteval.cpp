@@ -0,0 +1,626 @@
+#include "tuz/consteval.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace tuz {
+
+// Interpreted calls of one evaluator running longer in total, or nested deeper, are not
+// constant
+static constexpr uint64_t MaxSteps = uint64_t(1) << 20;
+static constexpr unsigned MaxCallDepth = 128;
+
+// =============================================================================
+// Scalar helpers
+// =============================================================================
+
+// Bit width of a scalar type as generated (booleans are i1), 0 for anything else
+static unsigned bit_width(const Type& type) {
+  switch (type.kind) {
+  case TypeKind::Bool:
+    return 1;
+  case TypeKind::Int8:
+  case TypeKind::UInt8:
+    return 8;
+  case TypeKind::Int16:
+  case TypeKind::UInt16:
+    return 16;
+  case TypeKind::Int32:
+  case TypeKind::UInt32:
+  case TypeKind::Float32:
+    return 32;
+  case TypeKind::Int64:
+  case TypeKind::UInt64:
+  case TypeKind::Float64:
+    return 64;
+  default:
+    return 0;
+  }
+}
+
+static bool is_scalar(const TypePtr& type) {
+  return type && bit_width(*type) != 0;
+}
+
+// Truncate to width bits, then sign- or zero-extend back to 64
+static int64_t extend(uint64_t bits, unsigned width, bool is_signed) {
+  if (width >= 64) {
+    return static_cast<int64_t>(bits);
+  }
+  uint64_t mask = (uint64_t(1) << width) - 1;
+  bits &= mask;
+  if (is_signed && (bits >> (width - 1)) & 1) {
+    bits |= ~mask;
+  }
+  return static_cast<int64_t>(bits);
+}
+
+// The bits of an integer value read as a signed number, like LLVM's signed operations do
+static int64_t as_signed(const ConstValue& value) {
+  return extend(static_cast<uint64_t>(value.integer), bit_width(*value.type), true);
+}
+
+ConstValue ConstValue::of_integer(const TypePtr& type, int64_t value) {
+  ConstValue result;
+  result.type = type;
+  result.integer =
+      extend(static_cast<uint64_t>(value), bit_width(*type), type->is_signed_integer());
+  return result;
+}
+
+ConstValue ConstValue::of_real(const TypePtr& type, double value) {
+  ConstValue result;
+  result.type = type;
+  result.real = type->kind == TypeKind::Float32 ? static_cast<float>(value) : value;
+  return result;
+}
+
+ConstValue ConstValue::of_bool(bool value) {
+  return of_integer(get_bool_type(), value ? 1 : 0);
+}
+
+// Convert value to type the way codegen does: integers extend and convert to floats by
+// is_signed, the signedness of their type; floats truncate toward zero into a signed or an
+// unsigned integer by the target's signedness. Out-of-range float-to-integer conversions
+// produce poison in LLVM, so they are not constant.
+static std::optional<ConstValue> convert(const ConstValue& value, const TypePtr& to,
+                                         bool is_signed) {
+  if (!is_scalar(to)) {
+    return std::nullopt;
+  }
+  unsigned from_width = bit_width(*value.type);
+
+  if (!value.is_floating_point() && !to->is_floating_point()) {
+    return ConstValue::of_integer(
+        to, extend(static_cast<uint64_t>(value.integer), from_width, is_signed));
+  }
+  if (!value.is_floating_point()) {
+    int64_t bits = extend(static_cast<uint64_t>(value.integer), from_width, is_signed);
+    if (to->kind == TypeKind::Float32) {
+      float real = is_signed ? static_cast<float>(bits) : static_cast<float>(uint64_t(bits));
+      return ConstValue::of_real(to, real);
+    }
+    double real = is_signed ? static_cast<double>(bits) : static_cast<double>(uint64_t(bits));
+    return ConstValue::of_real(to, real);
+  }
+  if (!to->is_floating_point()) {
+    double truncated = std::trunc(value.real);
+    int to_width = static_cast<int>(bit_width(*to));
+    if (to->is_unsigned_integer()) {
+      if (std::isnan(truncated) || truncated < 0 || truncated >= std::ldexp(1.0, to_width)) {
+        return std::nullopt;
+      }
+      return ConstValue::of_integer(to, static_cast<int64_t>(static_cast<uint64_t>(truncated)));
+    }
+    double limit = std::ldexp(1.0, to_width - 1);
+    if (std::isnan(truncated) || truncated < -limit || truncated >= limit) {
+      return std::nullopt;
+    }
+    return ConstValue::of_integer(to, static_cast<int64_t>(truncated));
+  }
+  return ConstValue::of_real(to, value.real);
+}
+
+// Implicit conversion of a value of static type from, as CodeGenerator::coerce
+static std::optional<ConstValue> coerce(const ConstValue& value, const TypePtr& from,
+                                        const TypePtr& to) {
+  return convert(value, to, !from || from->is_signed_integer());
+}
+
+static ConstValue zero_of(const TypePtr& type) {
+  return type->is_floating_point() ? ConstValue::of_real(type, 0) : ConstValue::of_integer(type, 0);
+}
+
+// =============================================================================
+// Evaluator
+// =============================================================================
+
+ConstEvaluator::ConstEvaluator(std::vector<GlobalDecl*> globals,
+                               std::vector<FunctionDecl*> functions)
+    : globals_(std::move(globals)), functions_(std::move(functions)),
+      global_states_(globals_.size(), GlobalState::Pending), global_values_(globals_.size()) {
+}
+
+void ConstEvaluator::add_declarations(const std::vector<GlobalDecl*>& globals,
+                                      const std::vector<FunctionDecl*>& functions,
+                                      uint32_t first_global, uint32_t first_function) {
+  size_t kept = std::min<size_t>(globals_.size(), first_global);
+  globals_.resize(kept);
+  globals_.insert(globals_.end(), globals.begin() + kept, globals.end());
+  global_states_.resize(kept);
+  global_states_.resize(globals_.size(), GlobalState::Pending);
+  global_values_.resize(kept);
+  global_values_.resize(globals_.size());
+
+  // Calls are cached by callee, so those of replaced functions are never looked up again
+  kept = std::min<size_t>(functions_.size(), first_function);
+  functions_.resize(kept);
+  functions_.insert(functions_.end(), functions.begin() + kept, functions.end());
+  steps_ = 0;
+}
+
+size_t ConstEvaluator::CallKeyHash::operator()(const CallKey& key) const {
+  size_t hash = std::hash<const FunctionDecl*>()(key.function);
+  for (uint64_t argument : key.arguments) {
+    hash = hash * 31 + std::hash<uint64_t>()(argument);
+  }
+  return hash;
+}
+
+std::optional<ConstValue> ConstEvaluator::evaluate(const Expr& expr) {
+  return eval(expr, nullptr);
+}
+
+std::optional<ConstValue> ConstEvaluator::global_value(uint32_t index) {
+  return eval_global(index);
+}
+
+TypePtr ConstEvaluator::global_type(const GlobalDecl& decl) {
+  if (decl.type) {
+    return decl.type;
+  }
+  if (decl.initializer && decl.initializer->type) {
+    return decl.initializer->type;
+  }
+  return get_int32_type();
+}
+
+std::optional<ConstValue> ConstEvaluator::eval_global(uint32_t index) {
+  if (index >= globals_.size()) {
+    return std::nullopt;
+  }
+  switch (global_states_[index]) {
+  case GlobalState::Done:
+    return global_values_[index];
+  case GlobalState::InProgress:
+    return std::nullopt; // Initializer refers back to itself
+  case GlobalState::Pending:
+    break;
+  }
+
+  global_states_[index] = GlobalState::InProgress;
+  const GlobalDecl& decl = *globals_[index];
+  TypePtr type = global_type(decl);
+  std::optional<ConstValue> value;
+  if (!decl.initializer) {
+    if (is_scalar(type)) {
+      value = zero_of(type);
+    }
+  } else if (auto init = eval(*decl.initializer, nullptr)) {
+    value = coerce(*init, decl.initializer->type, type);
+  }
+
+  global_states_[index] = GlobalState::Done;
+  global_values_[index] = value;
+  return value;
+}
+
+bool ConstEvaluator::step() {
+  return ++steps_ <= MaxSteps;
+}
+
+std::optional<ConstValue> ConstEvaluator::eval(const Expr& expr, Frame* frame) {
+  // Only results that do not depend on a call's locals can be reused
+  if (frame) {
+    return eval_uncached(expr, frame);
+  }
+  auto it = memo_.find(&expr);
+  if (it != memo_.end()) {
+    return it->second;
+  }
+  auto value = eval_uncached(expr, nullptr);
+  memo_.emplace(&expr, value);
+  return value;
+}
+
+std::optional<ConstValue> ConstEvaluator::eval_uncached(const Expr& expr, Frame* frame) {
+  // Outside calls every expression is evaluated once, so only interpretation is budgeted
+  if (frame && !step()) {
+    return std::nullopt;
+  }
+
+  switch (expr.kind) {
+  case ExprKind::IntegerLiteral: {
+    TypePtr type = expr.type ? expr.type : get_int32_type();
+    if (!is_scalar(type) || type->is_floating_point()) {
+      return std::nullopt;
+    }
+    return ConstValue::of_integer(type, static_cast<const IntegerLiteralExpr&>(expr).value);
+  }
+  case ExprKind::FloatLiteral: {
+    TypePtr type = expr.type ? expr.type : get_float64_type();
+    if (!type->is_floating_point()) {
+      return std::nullopt;
+    }
+    return ConstValue::of_real(type, static_cast<const FloatLiteralExpr&>(expr).value);
+  }
+  case ExprKind::BoolLiteral:
+    return ConstValue::of_bool(static_cast<const BoolLiteralExpr&>(expr).value);
+  case ExprKind::Variable:
+    return eval_variable(static_cast<const VariableExpr&>(expr), frame);
+  case ExprKind::BinaryOp:
+    return eval_binary(static_cast<const BinaryOpExpr&>(expr), frame);
+  case ExprKind::UnaryOp:
+    return eval_unary(static_cast<const UnaryOpExpr&>(expr), frame);
+  case ExprKind::Call:
+    return eval_call(static_cast<const CallExpr&>(expr), frame);
+  case ExprKind::Cast:
+    return eval_cast(static_cast<const CastExpr&>(expr), frame);
+  default:
+    // Strings, indexing and field access need memory
+    return std::nullopt;
+  }
+}
+
+std::optional<ConstValue> ConstEvaluator::eval_variable(const VariableExpr& expr, Frame* frame) {
+  switch (expr.binding.kind) {
+  case BindingKind::Local:
+    if (!frame || expr.binding.index >= frame->locals.size()) {
+      return std::nullopt;
+    }
+    return frame->locals[expr.binding.index].value;
+  case BindingKind::Global:
+    // Mutable globals may change before the expression runs
+    if (expr.binding.index >= globals_.size() || globals_[expr.binding.index]->is_mutable) {
+      return std::nullopt;
+    }
+    return eval_global(expr.binding.index);
+  default:
+    return std::nullopt;
+  }
+}
+
+std::optional<ConstValue> ConstEvaluator::eval_binary(const BinaryOpExpr& expr, Frame* frame) {
+  auto left = eval(*expr.left, frame);
+  if (!left) {
+    return std::nullopt;
+  }
+  auto right = eval(*expr.right, frame);
+  if (!right) {
+    return std::nullopt;
+  }
+
+  // Both sides are converted to their common type first, as in codegen
+  TypePtr operand_type = common_type(expr.left->type, expr.right->type);
+  if (!is_scalar(operand_type)) {
+    return std::nullopt;
+  }
+  left = coerce(*left, expr.left->type, operand_type);
+  right = coerce(*right, expr.right->type, operand_type);
+  if (!left || !right) {
+    return std::nullopt;
+  }
+
+  if (operand_type->is_floating_point()) {
+    double a = left->real;
+    double b = right->real;
+    switch (expr.op) {
+    case BinaryOp::Add:
+      return ConstValue::of_real(operand_type, a + b);
+    case BinaryOp::Sub:
+      return ConstValue::of_real(operand_type, a - b);
+    case BinaryOp::Mul:
+      return ConstValue::of_real(operand_type, a * b);
+    case BinaryOp::Div:
+      return ConstValue::of_real(operand_type, a / b);
+    case BinaryOp::Mod:
+      return ConstValue::of_real(operand_type, std::fmod(a, b));
+    // Ordered comparisons: false when either side is NaN
+    case BinaryOp::Eq:
+      return ConstValue::of_bool(a == b);
+    case BinaryOp::Neq:
+      return ConstValue::of_bool(!std::isnan(a) && !std::isnan(b) && a != b);
+    case BinaryOp::Lt:
+      return ConstValue::of_bool(a < b);
+    case BinaryOp::Gt:
+      return ConstValue::of_bool(a > b);
+    case BinaryOp::Leq:
+      return ConstValue::of_bool(a <= b);
+    case BinaryOp::Geq:
+      return ConstValue::of_bool(a >= b);
+    default:
+      return std::nullopt;
+    }
+  }
+
+  // Unsigned integers and booleans are kept zero-extended, so a and b order them unsigned
+  uint64_t a = static_cast<uint64_t>(left->integer);
+  uint64_t b = static_cast<uint64_t>(right->integer);
+  bool is_signed = operand_type->is_signed_integer();
+  switch (expr.op) {
+  case BinaryOp::Add:
+    return ConstValue::of_integer(operand_type, static_cast<int64_t>(a + b));
+  case BinaryOp::Sub:
+    return ConstValue::of_integer(operand_type, static_cast<int64_t>(a - b));
+  case BinaryOp::Mul:
+    return ConstValue::of_integer(operand_type, static_cast<int64_t>(a * b));
+  case BinaryOp::Div:
+  case BinaryOp::Mod: {
+    if (!is_signed) {
+      if (b == 0) {
+        return std::nullopt;
+      }
+      return ConstValue::of_integer(operand_type,
+                                    static_cast<int64_t>(expr.op == BinaryOp::Div ? a / b : a % b));
+    }
+    // Signed division, which is undefined for a zero divisor and for MIN / -1
+    int64_t dividend = as_signed(*left);
+    int64_t divisor = as_signed(*right);
+    int64_t min = extend(uint64_t(1) << (bit_width(*operand_type) - 1), bit_width(*operand_type),
+                         true);
+    if (divisor == 0 || (divisor == -1 && dividend == min)) {
+      return std::nullopt;
+    }
+    return ConstValue::of_integer(operand_type, expr.op == BinaryOp::Div ? dividend / divisor
+                                                                         : dividend % divisor);
+  }
+  case BinaryOp::Eq:
+    return ConstValue::of_bool(a == b);
+  case BinaryOp::Neq:
+    return ConstValue::of_bool(a != b);
+  case BinaryOp::Lt:
+    return ConstValue::of_bool(is_signed ? as_signed(*left) < as_signed(*right) : a < b);
+  case BinaryOp::Gt:
+    return ConstValue::of_bool(is_signed ? as_signed(*left) > as_signed(*right) : a > b);
+  case BinaryOp::Leq:
+    return ConstValue::of_bool(is_signed ? as_signed(*left) <= as_signed(*right) : a <= b);
+  case BinaryOp::Geq:
+    return ConstValue::of_bool(is_signed ? as_signed(*left) >= as_signed(*right) : a >= b);
+  case BinaryOp::And:
+  case BinaryOp::Or:
+    // Logical operators are only defined on booleans
+    if (!operand_type->is_boolean()) {
+      return std::nullopt;
+    }
+    return ConstValue::of_bool(expr.op == BinaryOp::And ? (a & b) : (a | b));
+  default:
+    return std::nullopt;
+  }
+}
+
+std::optional<ConstValue> ConstEvaluator::eval_unary(const UnaryOpExpr& expr, Frame* frame) {
+  if (expr.op != UnaryOp::Neg && expr.op != UnaryOp::Not) {
+    return std::nullopt; // Dereference and address-of need memory
+  }
+  auto operand = eval(*expr.operand, frame);
+  if (!operand) {
+    return std::nullopt;
+  }
+
+  if (operand->is_floating_point()) {
+    if (expr.op == UnaryOp::Not) {
+      return std::nullopt;
+    }
+    return ConstValue::of_real(operand->type, -operand->real);
+  }
+  uint64_t bits = static_cast<uint64_t>(operand->integer);
+  return ConstValue::of_integer(operand->type,
+                                static_cast<int64_t>(expr.op == UnaryOp::Neg ? 0 - bits : ~bits));
+}
+
+std::optional<ConstValue> ConstEvaluator::eval_cast(const CastExpr& expr, Frame* frame) {
+  auto value = eval(*expr.expr, frame);
+  if (!value) {
+    return std::nullopt;
+  }
+  // Explicit casts convert by the same signedness rules as implicit conversions
+  return coerce(*value, expr.expr->type, expr.target_type);
+}
+
+std::optional<ConstValue> ConstEvaluator::eval_call(const CallExpr& expr, Frame* frame) {
+  const auto& callee = static_cast<const VariableExpr&>(*expr.callee);
+  if (callee.binding.kind != BindingKind::Function ||
+      callee.binding.index >= functions_.size()) {
+    return std::nullopt;
+  }
+  const FunctionDecl& fn = *functions_[callee.binding.index];
+  if (fn.is_extern || !fn.body || !is_scalar(fn.return_type) ||
+      expr.arguments.size() != fn.params.size() || call_depth_ >= MaxCallDepth) {
+    return std::nullopt;
+  }
+
+  // Parameters take the first slots, converted to their declared types
+  Frame callee_frame;
+  callee_frame.return_type = fn.return_type;
+  callee_frame.locals.resize(std::max<size_t>(fn.local_count, fn.params.size()));
+  CallKey key{&fn, {}};
+  for (size_t i = 0; i < fn.params.size(); ++i) {
+    auto arg = eval(*expr.arguments[i], frame);
+    if (!arg) {
+      return std::nullopt;
+    }
+    auto value = coerce(*arg, expr.arguments[i]->type, fn.params[i].type);
+    if (!value) {
+      return std::nullopt;
+    }
+    callee_frame.locals[i] = {fn.params[i].type, value};
+    key.arguments.push_back(value->is_floating_point() ? std::bit_cast<uint64_t>(value->real)
+                                                       : static_cast<uint64_t>(value->integer));
+  }
+
+  // The callee computes only on its arguments, so a call gives the same result every time. A
+  // call that failed for lack of budget or depth stays unfolded even where it might succeed.
+  auto cached = calls_.find(key);
+  if (cached != calls_.end()) {
+    return cached->second;
+  }
+
+  call_depth_++;
+  Flow flow = exec(*fn.body, callee_frame);
+  call_depth_--;
+
+  std::optional<ConstValue> result;
+  switch (flow) {
+  case Flow::Fail:
+    break;
+  case Flow::Return:
+    result = callee_frame.return_value;
+    break;
+  case Flow::Normal:
+    // Falling off the end returns zero
+    result = zero_of(fn.return_type);
+    break;
+  }
+  calls_.emplace(std::move(key), result);
+  return result;
+}
+
+// =============================================================================
+// Statements of interpreted calls
+// =============================================================================
+
+ConstEvaluator::Flow ConstEvaluator::exec(const Stmt& stmt, Frame& frame) {
+  if (!step()) {
+    return Flow::Fail;
+  }
+
+  switch (stmt.kind) {
+  case StmtKind::Expr:
+    return eval(*static_cast<const ExprStmt&>(stmt).expr, &frame) ? Flow::Normal : Flow::Fail;
+
+  case StmtKind::Let: {
+    const auto& let = static_cast<const LetStmt&>(stmt);
+    TypePtr type = let.declared_type;
+    if (!type && let.initializer) {
+      type = let.initializer->type;
+    }
+    if (!type) {
+      type = get_int32_type();
+    }
+    if (!is_scalar(type) || let.slot >= frame.locals.size()) {
+      return Flow::Fail;
+    }
+    std::optional<ConstValue> value;
+    if (let.initializer) {
+      auto init = eval(*let.initializer, &frame);
+      if (!init || !(value = coerce(*init, let.initializer->type, type))) {
+        return Flow::Fail;
+      }
+    }
+    frame.locals[let.slot] = {type, value};
+    return Flow::Normal;
+  }
+
+  case StmtKind::Assign: {
+    const auto& assign = static_cast<const AssignStmt&>(stmt);
+    if (assign.target->kind != ExprKind::Variable) {
+      return Flow::Fail;
+    }
+    const auto& var = static_cast<const VariableExpr&>(*assign.target);
+    // Writing a global is a side effect
+    if (var.binding.kind != BindingKind::Local || var.binding.index >= frame.locals.size() ||
+        !frame.locals[var.binding.index].type) {
+      return Flow::Fail;
+    }
+    auto& local = frame.locals[var.binding.index];
+    auto value = eval(*assign.value, &frame);
+    if (!value || !(local.value = coerce(*value, assign.value->type, local.type))) {
+      return Flow::Fail;
+    }
+    return Flow::Normal;
+  }
+
+  case StmtKind::Block:
+    for (const auto* s : static_cast<const BlockStmt&>(stmt).statements) {
+      Flow flow = exec(*s, frame);
+      if (flow != Flow::Normal) {
+        return flow;
+      }
+    }
+    return Flow::Normal;
+
+  case StmtKind::If: {
+    const auto& if_stmt = static_cast<const IfStmt&>(stmt);
+    auto cond = eval(*if_stmt.condition, &frame);
+    if (!cond || !cond->type->is_boolean()) {
+      return Flow::Fail;
+    }
+    if (cond->integer) {
+      return exec(*if_stmt.then_branch, frame);
+    }
+    return if_stmt.else_branch ? exec(*if_stmt.else_branch, frame) : Flow::Normal;
+  }
+
+  case StmtKind::While: {
+    const auto& loop = static_cast<const WhileStmt&>(stmt);
+    while (true) {
+      auto cond = eval(*loop.condition, &frame);
+      if (!cond || !cond->type->is_boolean()) {
+        return Flow::Fail;
+      }
+      if (!cond->integer) {
+        return Flow::Normal;
+      }
+      Flow flow = exec(*loop.body, frame);
+      if (flow != Flow::Normal) {
+        return flow;
+      }
+    }
+  }
+
+  case StmtKind::For: {
+    // The loop variable counts up to the end value, which is computed once
+    const auto& loop = static_cast<const ForStmt&>(stmt);
+    TypePtr var_type = loop.var_type ? loop.var_type : get_int32_type();
+    bool is_unsigned = var_type->is_unsigned_integer();
+    auto start = eval(*loop.range_start, &frame);
+    if (!start || !(start = coerce(*start, loop.range_start->type, var_type)) ||
+        loop.slot >= frame.locals.size()) {
+      return Flow::Fail;
+    }
+    frame.locals[loop.slot] = {var_type, start};
+    auto end = eval(*loop.range_end, &frame);
+    if (!end || !(end = coerce(*end, loop.range_end->type, var_type))) {
+      return Flow::Fail;
+    }
+    auto in_range = [&](int64_t counter) {
+      return is_unsigned ? uint64_t(counter) < uint64_t(end->integer) : counter < end->integer;
+    };
+    while (in_range(frame.locals[loop.slot].value->integer)) {
+      Flow flow = exec(*loop.body, frame);
+      if (flow != Flow::Normal) {
+        return flow;
+      }
+      auto& counter = frame.locals[loop.slot].value;
+      counter = ConstValue::of_integer(var_type, counter->integer + 1);
+    }
+    return Flow::Normal;
+  }
+
+  case StmtKind::Return: {
+    const auto& ret = static_cast<const ReturnStmt&>(stmt);
+    if (!ret.value) {
+      return Flow::Fail; // Only calls that produce a value are evaluated
+    }
+    auto value = eval(*ret.value, &frame);
+    if (!value || !(frame.return_value = coerce(*value, ret.value->type, frame.return_type))) {
+      return Flow::Fail;
+    }
+    return Flow::Return;
+  }
+  }
+  return Flow::Fail;
+}
+
+} // namespace tuz
@@ -1,9 +1,20 @@
 #include "tuz/diagnostic.h"
 
+#include "json.h"
+
 #include <algorithm>
-#include <fstream>
+#include <bit>
+#include <cerrno>
+#include <fcntl.h>
 #include <iomanip>
 #include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace tuz {
 
@@ -12,31 +23,99 @@ namespace tuz {
 // =============================================================================
 
 SourceFile::SourceFile(std::string path, std::string content)
-    : path_(std::move(path)), content_(std::move(content)) {
-  compute_line_offsets();
+    : path_(std::move(path)), owned_(std::move(content)), content_(owned_) {}
+
+SourceFile::~SourceFile() {
+  if (mapping_) {
+    munmap(mapping_, mapping_size_);
+  }
 }
 
-void SourceFile::compute_line_offsets() {
-  line_offsets_.clear();
-  line_offsets_.push_back(0); // Line 1 starts at offset 0
+std::shared_ptr<SourceFile> SourceFile::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  std::shared_ptr<SourceFile> file(new SourceFile());
+  file->path_ = path;
+
+  // Map regular files; an empty file cannot be mapped, and pipes or devices have no size
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      file->mapping_ = mapping;
+      file->mapping_size_ = size;
+      file->content_ = std::string_view(static_cast<const char*>(mapping), size);
+      close(fd);
+      return file;
+    }
+  }
+
+  // Fall back to reading the whole file
+  char buffer[65536];
+  for (;;) {
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      close(fd);
+      return nullptr;
+    }
+    if (count == 0) {
+      break;
+    }
+    file->owned_.append(buffer, static_cast<size_t>(count));
+  }
+  close(fd);
+  file->content_ = file->owned_;
+  return file;
+}
 
-  for (size_t i = 0; i < content_.size(); ++i) {
-    if (content_[i] == '\n') {
-      line_offsets_.push_back(i + 1);
+// Append the offset after every '\n' in data
+static void find_line_starts(const char* data, size_t size, std::vector<size_t>& offsets) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  // Compare 16 bytes at a time and walk the set bits of the match mask
+  const __m128i newline = _mm_set1_epi8('\n');
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+    while (mask != 0) {
+      offsets.push_back(i + static_cast<size_t>(std::countr_zero(mask)) + 1);
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    if (data[i] == '\n') {
+      offsets.push_back(i + 1);
     }
   }
 }
 
-std::string SourceFile::get_line(uint32_t line_num) const {
-  if (line_num == 0 || line_num > line_offsets_.size()) {
-    return "";
+const std::vector<size_t>& SourceFile::line_offsets() const {
+  std::call_once(line_offsets_once_, [this] {
+    line_offsets_.push_back(0); // Line 1 starts at offset 0
+    find_line_starts(content_.data(), content_.size(), line_offsets_);
+  });
+  return line_offsets_;
+}
+
+std::string_view SourceFile::get_line(uint32_t line_num) const {
+  const auto& offsets = line_offsets();
+  if (line_num == 0 || line_num > offsets.size()) {
+    return {};
   }
 
-  size_t start = line_offsets_[line_num - 1];
+  size_t start = offsets[line_num - 1];
   size_t end = content_.size();
 
-  if (line_num < line_offsets_.size()) {
-    end = line_offsets_[line_num] - 1; // Exclude the newline
+  if (line_num < offsets.size()) {
+    end = offsets[line_num] - 1; // Exclude the newline
   }
 
   // Also exclude \r for Windows line endings
@@ -57,15 +136,11 @@ std::shared_ptr<SourceFile> SourceManager::load_file(const std::string& path) {
     return it->second;
   }
 
-  std::ifstream file(path);
-  if (!file) {
+  auto source_file = SourceFile::open(path);
+  if (!source_file) {
     return nullptr;
   }
 
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-
-  auto source_file = std::make_shared<SourceFile>(path, buffer.str());
   files_[path] = source_file;
   return source_file;
 }
@@ -82,8 +157,9 @@ std::shared_ptr<SourceFile> SourceManager::get_file(const std::string& path) con
 // Console Diagnostic Consumer
 // =============================================================================
 
-ConsoleDiagnosticConsumer::ConsoleDiagnosticConsumer(bool use_colors, bool show_source_context)
-    : use_colors_(use_colors), show_source_context_(show_source_context) {
+ConsoleDiagnosticConsumer::ConsoleDiagnosticConsumer(bool use_colors, bool show_source_context,
+                                                     std::ostream& out)
+    : out_(out), use_colors_(use_colors), show_source_context_(show_source_context) {
 }
 
 void ConsoleDiagnosticConsumer::reset() {
@@ -146,14 +222,14 @@ void ConsoleDiagnosticConsumer::print_source_context(const DiagnosticMessage& di
   uint32_t line_num_width = std::to_string(end_line).length();
 
   for (uint32_t current_line = start_line; current_line <= end_line; ++current_line) {
-    std::string line_content = file->get_line(current_line);
+    std::string_view line_content = file->get_line(current_line);
 
     // Print line number and content
-    std::cerr << std::setw(line_num_width) << current_line << " | " << line_content << "\n";
+    out_ << std::setw(line_num_width) << current_line << " | " << line_content << "\n";
 
     // Print caret line for the error line
     if (current_line == line_num && col_num > 0) {
-      std::cerr << std::string(line_num_width, ' ') << " | ";
+      out_ << std::string(line_num_width, ' ') << " | ";
 
       // Calculate visual column (accounting for tabs)
       size_t visual_col = 0;
@@ -166,11 +242,11 @@ void ConsoleDiagnosticConsumer::print_source_context(const DiagnosticMessage& di
         }
       }
 
-      std::cerr << std::string(visual_col, ' ');
+      out_ << std::string(visual_col, ' ');
 
       // Print carets
       if (use_colors_) {
-        std::cerr << color_for_level(diagnostic.level);
+        out_ << color_for_level(diagnostic.level);
       }
 
       // Default length to 1 if not specified
@@ -181,13 +257,13 @@ void ConsoleDiagnosticConsumer::print_source_context(const DiagnosticMessage& di
         caret_count = static_cast<uint32_t>(line_content.size()) - (col_num - 1);
       }
 
-      std::cerr << std::string(std::max(1u, caret_count), '^');
+      out_ << std::string(std::max(1u, caret_count), '^');
 
       if (use_colors_) {
-        std::cerr << reset_color();
+        out_ << reset_color();
       }
 
-      std::cerr << "\n";
+      out_ << "\n";
     }
   }
 }
@@ -195,26 +271,26 @@ void ConsoleDiagnosticConsumer::print_source_context(const DiagnosticMessage& di
 void ConsoleDiagnosticConsumer::print_message(const DiagnosticMessage& msg, bool is_note) {
   // Location info
   if (msg.file && msg.location.is_valid()) {
-    std::cerr << msg.file->path() << ":" << msg.location.line << ":" << msg.location.column << ": ";
+    out_ << msg.file->path() << ":" << msg.location.line << ":" << msg.location.column << ": ";
   }
 
   // Level and color
   if (use_colors_) {
-    std::cerr << color_for_level(msg.level);
+    out_ << color_for_level(msg.level);
   }
 
   if (is_note) {
-    std::cerr << "note: ";
+    out_ << "note: ";
   } else {
-    std::cerr << level_to_string(msg.level) << ": ";
+    out_ << level_to_string(msg.level) << ": ";
   }
 
   if (use_colors_) {
-    std::cerr << reset_color();
+    out_ << reset_color();
   }
 
   // Message
-  std::cerr << msg.message << "\n";
+  out_ << msg.message << "\n";
 
   // Source context
   if (show_source_context_ && !is_note) {
@@ -243,6 +319,105 @@ void ConsoleDiagnosticConsumer::consume(const DiagnosticMessage& diagnostic) {
   print_message(diagnostic, false);
 }
 
+// =============================================================================
+// Buffered Diagnostic Consumer
+// =============================================================================
+
+void BufferedDiagnosticConsumer::consume(const DiagnosticMessage& diagnostic) {
+  if (diagnostic.level == DiagnosticLevel::Error || diagnostic.level == DiagnosticLevel::Fatal) {
+    ++error_count_;
+  }
+  diagnostics_.push_back(diagnostic);
+}
+
+void BufferedDiagnosticConsumer::reset() {
+  diagnostics_.clear();
+  error_count_ = 0;
+}
+
+void flush_diagnostics(const std::vector<BufferedDiagnosticConsumer*>& buffers,
+                       DiagnosticConsumer& target) {
+  std::vector<const DiagnosticMessage*> merged;
+  for (auto* buffer : buffers) {
+    for (const auto& diagnostic : buffer->diagnostics()) {
+      merged.push_back(&diagnostic);
+    }
+  }
+
+  // Diagnostics without a file sort first, as they would be reported before any file is read
+  auto key = [](const DiagnosticMessage* diagnostic) {
+    std::string_view path = diagnostic->file ? std::string_view(diagnostic->file->path()) : "";
+    return std::make_pair(path, diagnostic->location.line);
+  };
+  std::stable_sort(merged.begin(), merged.end(),
+                   [&](const auto* a, const auto* b) { return key(a) < key(b); });
+
+  for (const auto* diagnostic : merged) {
+    target.consume(*diagnostic);
+  }
+  for (auto* buffer : buffers) {
+    buffer->reset();
+  }
+}
+
+// =============================================================================
+// JSON Diagnostic Consumer
+// =============================================================================
+
+static const char* json_level(DiagnosticLevel level) {
+  switch (level) {
+  case DiagnosticLevel::Note:
+    return "note";
+  case DiagnosticLevel::Warning:
+    return "warning";
+  case DiagnosticLevel::Error:
+    return "error";
+  case DiagnosticLevel::Fatal:
+    return "fatal";
+  }
+  return "unknown";
+}
+
+static void append_json_diagnostic(std::string& out, const DiagnosticMessage& diagnostic) {
+  out += "{\"level\":";
+  append_json_string(out, json_level(diagnostic.level));
+  if (diagnostic.file) {
+    out += ",\"file\":";
+    append_json_string(out, diagnostic.file->path());
+  }
+  if (diagnostic.location.is_valid()) {
+    out += ",\"line\":" + std::to_string(diagnostic.location.line);
+    out += ",\"column\":" + std::to_string(diagnostic.location.column);
+    out += ",\"length\":" + std::to_string(diagnostic.location.length);
+  }
+  out += ",\"message\":";
+  append_json_string(out, diagnostic.message);
+  if (!diagnostic.notes.empty()) {
+    out += ",\"notes\":[";
+    for (size_t i = 0; i < diagnostic.notes.size(); ++i) {
+      if (i > 0) {
+        out += ',';
+      }
+      append_json_diagnostic(out, diagnostic.notes[i]);
+    }
+    out += ']';
+  }
+  out += '}';
+}
+
+void JsonDiagnosticConsumer::consume(const DiagnosticMessage& diagnostic) {
+  if (diagnostic.level == DiagnosticLevel::Error || diagnostic.level == DiagnosticLevel::Fatal) {
+    ++error_count_;
+  }
+
+  // Each line goes out in one write, so lines from several compilers sharing a pipe stay whole
+  std::string line;
+  append_json_diagnostic(line, diagnostic);
+  line += '\n';
+  out_.write(line.data(), static_cast<std::streamsize>(line.size()));
+  out_.flush();
+}
+
 // =============================================================================
 // Diagnostic Engine
 // =============================================================================
@@ -291,9 +466,22 @@ void DiagnosticEngine::report_at(DiagnosticLevel level, const std::string& messa
 // Global diagnostic instance
 // =============================================================================
 
+static thread_local DiagnosticEngine* scoped_diagnostics = nullptr;
+
 DiagnosticEngine& get_global_diagnostics() {
+  if (scoped_diagnostics) {
+    return *scoped_diagnostics;
+  }
   static DiagnosticEngine instance;
   return instance;
 }
 
+DiagnosticScope::DiagnosticScope(DiagnosticEngine& engine) : previous_(scoped_diagnostics) {
+  scoped_diagnostics = &engine;
+}
+
+DiagnosticScope::~DiagnosticScope() {
+  scoped_diagnostics = previous_;
+}
+
 } // namespace tuz
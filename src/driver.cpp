@@ -1,22 +1,115 @@
 #include "tuz/driver.h"
 
 #include "tuz/ast.h"
+#include "tuz/cache.h"
 #include "tuz/codegen.h"
 #include "tuz/diagnostic.h"
 #include "tuz/lexer.h"
+#include "tuz/lto.h"
 #include "tuz/parser.h"
+#include "tuz/repl.h"
+#include "tuz/resolver.h"
+#include "tuz/server.h"
+#include "tuz/stats.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/VersionTuple.h>
+#include <llvm/Support/raw_os_ostream.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/TargetParser/Host.h>
+#include <llvm/TargetParser/Triple.h>
+#include <optional>
+#include <thread>
+
+#ifdef TUZ_HAVE_LLD
+#include <lld/Common/Driver.h>
+
+LLD_HAS_DRIVER(elf)
+#endif
 
 namespace tuz {
 
-bool Driver::compile(const CompileOptions& options) {
+// Where the driver's messages go; the compile server points them at each request's client
+static thread_local std::ostream* output_stream = &std::cout;
+static thread_local std::ostream* error_stream = &std::cerr;
+
+static std::ostream& out() {
+  return *output_stream;
+}
+
+static std::ostream& err() {
+  return *error_stream;
+}
+
+// Redirects out() and err() on the current thread while in scope
+class ScopedOutput {
+public:
+  ScopedOutput(std::ostream& out, std::ostream& err)
+      : previous_out_(output_stream), previous_err_(error_stream) {
+    output_stream = &out;
+    error_stream = &err;
+  }
+  ~ScopedOutput() {
+    output_stream = previous_out_;
+    error_stream = previous_err_;
+  }
+
+private:
+  std::ostream* previous_out_;
+  std::ostream* previous_err_;
+};
+
+// Report an error thrown while resolving or generating code
+static void report_codegen_error(const std::exception& e,
+                                 const std::shared_ptr<SourceFile>& source_file) {
+  auto& diagnostics = get_global_diagnostics();
+  auto* codegen_error = dynamic_cast<const CodeGenError*>(&e);
+  if (codegen_error && codegen_error->has_location()) {
+    diagnostics.error(e.what(), codegen_error->location(), source_file);
+  } else {
+    diagnostics.error(e.what());
+  }
+}
+
+static CodeGenOptions make_codegen_options(const CompileOptions& options,
+                                           CompileStats* stats = nullptr) {
+  CodeGenOptions codegen_options;
+  codegen_options.stats = stats;
+  codegen_options.opt_level = options.optimize ? options.opt_level : 0;
+  codegen_options.target_triple = options.target_triple;
+  codegen_options.cpu = options.target_cpu;
+  codegen_options.features = options.target_features;
+  codegen_options.profile_generate = options.profile_generate;
+  codegen_options.profile_use = options.profile_use;
+  codegen_options.thin_lto = options.thin_lto;
+  codegen_options.debug_info = options.debug_info;
+  codegen_options.bounds_check = options.bounds_check;
+  if (options.profile_generate) {
+    // Like clang: one raw profile per binary (%m), merged by llvm-profdata afterwards
+    llvm::SmallString<128> path(options.profile_dir);
+    llvm::sys::path::append(path, "default_%m.profraw");
+    codegen_options.profile_output = path.str().str();
+  }
+  return codegen_options;
+}
+
+// Load, lex and parse one input file; returns false after reporting errors
+static bool parse_input(const CompileOptions& options, const std::string& input, Program& program,
+                        std::shared_ptr<SourceFile>& source_file, CompileStats* stats) {
   // Set up diagnostic system
   auto source_manager = std::make_shared<SourceManager>();
-  auto source_file = source_manager->load_file(options.input_file);
+  source_file = source_manager->load_file(input);
   if (!source_file) {
-    std::cerr << "Error: Could not open file: " << options.input_file << std::endl;
+    err() << "Error: Could not open file: " << input << std::endl;
     return false;
   }
   source_manager->set_main_file(source_file);
@@ -24,168 +117,751 @@ bool Driver::compile(const CompileOptions& options) {
   // Create diagnostic engine with console output
   auto& diagnostics = get_global_diagnostics();
   diagnostics.set_source_manager(source_manager);
-  diagnostics.set_consumer(std::make_unique<ConsoleDiagnosticConsumer>(true, true));
+  if (options.diagnostics_json) {
+    diagnostics.set_consumer(std::make_unique<JsonDiagnosticConsumer>(err()));
+  } else {
+    diagnostics.set_consumer(std::make_unique<ConsoleDiagnosticConsumer>(true, true, err()));
+  }
   diagnostics.reset();
 
   if (options.verbose) {
-    std::cout << "Compiling: " << options.input_file << std::endl;
+    out() << "Compiling: " << input << std::endl;
   }
 
-  // Lexing
   if (options.verbose)
-    std::cout << "  Lexing..." << std::endl;
+    out() << "  Parsing..." << std::endl;
   Lexer lexer(source_file->content());
   std::vector<Token> tokens;
+  size_t token_count = 0;
   try {
-    tokens = lexer.tokenize();
+    // Lexing and parsing normally run as a single pass, the parser pulling tokens on demand.
+    // Stats lex up front instead, so the two phases are measured separately.
+    if (stats) {
+      CompileStats::Phase phase(stats, "lex", input);
+      tokens = lexer.tokenize();
+      phase.set("tokens", tokens.size());
+      phase.set("bytes", lexer.bytes_allocated() + tokens.capacity() * sizeof(Token));
+    }
+
+    CompileStats::Phase phase(stats, "parse", input);
+    Parser parser = stats ? Parser(std::move(tokens)) : Parser(lexer);
+    program = parser.parse_program();
+    token_count = parser.token_count();
+    phase.set("tokens", token_count);
+    phase.set("ast_nodes", program.context->node_count());
+    phase.set("bytes", program.context->bytes_allocated());
+  } catch (const ParseError& e) {
+    diagnostics.error(e.what(), SourceLocation(e.line, e.column), source_file);
+    return false;
   } catch (const std::exception& e) {
     diagnostics.error(e.what());
     return false;
   }
 
   if (options.verbose) {
-    std::cout << "  Tokens: " << tokens.size() << std::endl;
+    out() << "  Tokens: " << token_count << std::endl;
+    out() << "  Declarations: " << program.declarations.size() << std::endl;
   }
+  return true;
+}
 
-  // Parsing
-  if (options.verbose)
-    std::cout << "  Parsing..." << std::endl;
-  Parser parser(tokens);
+std::unique_ptr<CodeGenerator> Driver::build(const CompileOptions& options,
+                                             const std::string& input, CompileStats* stats) {
   Program program;
+  std::shared_ptr<SourceFile> source_file;
+  if (!parse_input(options, input, program, source_file, stats)) {
+    return nullptr;
+  }
+
+  // Code generation
+  if (options.verbose)
+    out() << "  Generating LLVM IR..." << std::endl;
+  CodeGenOptions codegen_options = make_codegen_options(options, stats);
+  codegen_options.source_file = input;
+
+  std::unique_ptr<CodeGenerator> codegen;
   try {
-    program = parser.parse_program();
-  } catch (const ParseError& e) {
-    diagnostics.error(e.what(), SourceLocation(e.line, e.column), source_file);
-    return false;
+    codegen = std::make_unique<CodeGenerator>(codegen_options);
+    {
+      CompileStats::Phase phase(stats, "codegen", input);
+      codegen->generate(program);
+    }
+
+    if (options.verbose && codegen_options.opt_level > 0)
+      out() << "  Optimizing (O" << codegen_options.opt_level << ")..." << std::endl;
+    CompileStats::Phase phase(stats, "optimize", input);
+    codegen->optimize();
   } catch (const std::exception& e) {
-    diagnostics.error(e.what());
+    report_codegen_error(e, source_file);
+    return nullptr;
+  }
+
+  return codegen;
+}
+
+// Create a temporary object file path
+static bool create_temp_object(llvm::SmallString<128>& path) {
+  if (auto ec = llvm::sys::fs::createTemporaryFile("tuz", "o", path)) {
+    err() << "Error: Could not create temporary file: " << ec.message() << std::endl;
     return false;
   }
+  return true;
+}
+
+static void remove_files(const std::vector<std::string>& files) {
+  for (const auto& file : files) {
+    std::remove(file.c_str());
+  }
+}
+
+// Where -S and -c write the output for an input: next to the input when there are several,
+// otherwise named after -o
+static std::string output_path(const CompileOptions& options, const std::string& input,
+                               const char* extension) {
+  if (options.input_files.size() == 1) {
+    return options.output_file + "." + extension;
+  }
+  llvm::SmallString<128> path(input);
+  llvm::sys::path::replace_extension(path, extension);
+  return path.str().str();
+}
+
+static uint64_t file_size(const std::string& path) {
+  uint64_t size = 0;
+  return llvm::sys::fs::file_size(path, size) ? 0 : size;
+}
+
+static std::unique_ptr<CompileStats> make_stats(const CompileOptions& options) {
+  return options.stats_format.empty() ? nullptr : std::make_unique<CompileStats>();
+}
+
+// Reports go to stderr so they never mix with the output of --run
+static void print_stats(const CompileOptions& options, const CompileStats* stats) {
+  if (!stats) {
+    return;
+  }
+  if (options.stats_format == "json") {
+    stats->print_json(err());
+  } else {
+    stats->print_text(err());
+  }
+}
 
+bool Driver::compile(const CompileOptions& options) {
+  auto stats = make_stats(options);
+  bool success = compile_inputs(options, stats.get());
+  print_stats(options, stats.get());
+  return success;
+}
+
+bool Driver::compile_inputs(const CompileOptions& options, CompileStats* stats) {
+  if (options.emit_llvm || options.emit_bitcode) {
+    for (const auto& input : options.input_files) {
+      auto codegen = build(options, input, stats);
+      if (!codegen) {
+        return false;
+      }
+      try {
+        if (options.emit_llvm) {
+          std::string ll_file = output_path(options, input, "ll");
+          if (options.verbose)
+            out() << "  Writing LLVM IR to: " << ll_file << std::endl;
+          codegen->dump_ir(ll_file);
+        }
+        if (options.emit_bitcode) {
+          std::string bc_file = output_path(options, input, "bc");
+          if (options.verbose)
+            out() << "  Writing LLVM bitcode to: " << bc_file << std::endl;
+          codegen->compile_to_bitcode(bc_file);
+        }
+      } catch (const CodeGenError& e) {
+        report_codegen_error(e, nullptr);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::unique_ptr<ObjectCache> cache;
+  if (!options.cache_dir.empty()) {
+    cache = std::make_unique<ObjectCache>(options.cache_dir);
+  }
+
+  // Objects to link, in input order; cached objects are linked in place, so only the
+  // temporaries are removed afterwards
+  std::vector<std::string> link_inputs;
+  std::vector<std::string> temporaries;
+  bool success = true;
+  for (const auto& input : options.input_files) {
+    std::optional<std::vector<std::string>> objects;
+    std::string key;
+    if (cache) {
+      auto source = llvm::MemoryBuffer::getFile(input);
+      if (!source) {
+        err() << "Error: Could not open file: " << input << std::endl;
+        success = false;
+        break;
+      }
+      try {
+        CodeGenOptions codegen_options = make_codegen_options(options);
+        codegen_options.source_file = input;
+        key = ObjectCache::compute_key((*source)->getBuffer(), codegen_options,
+                                       splits_units(options));
+      } catch (const CodeGenError& e) {
+        get_global_diagnostics().error(e.what());
+        success = false;
+        break;
+      }
+      CompileStats::Phase phase(stats, "cache", input);
+      objects = cache->lookup(key);
+      phase.set("hit", objects.has_value());
+      if (objects && options.verbose) {
+        out() << "Cached: " << input << std::endl;
+      }
+    }
+
+    if (!objects) {
+      size_t first = temporaries.size();
+      if (!emit_objects(options, input, temporaries, stats)) {
+        success = false;
+        break;
+      }
+      objects.emplace(temporaries.begin() + first, temporaries.end());
+      if (cache && !cache->store(key, *objects) && options.verbose) {
+        out() << "  Could not write cache entry to " << cache->directory() << std::endl;
+      }
+    }
+
+    if (options.emit_object) {
+      std::string obj_file = output_path(options, input, "o");
+      if (options.verbose)
+        out() << "  Writing object file: " << obj_file << std::endl;
+      if (auto ec = llvm::sys::fs::copy_file(objects->front(), obj_file)) {
+        err() << "Error: Could not write " << obj_file << ": " << ec.message() << std::endl;
+        success = false;
+        break;
+      }
+    }
+    link_inputs.insert(link_inputs.end(), objects->begin(), objects->end());
+  }
+
+  if (cache && options.verbose) {
+    out() << "Cache: " << cache->hits() << " hit(s), " << cache->misses() << " miss(es) in "
+          << cache->directory() << std::endl;
+  }
+
+  // With ThinLTO the objects so far are bitcode; the backends turn them into native objects
+  if (success && !options.emit_object && options.thin_lto) {
+    CompileStats::Phase phase(stats, "thin-link", options.output_file);
+    size_t first = temporaries.size();
+    success = thin_link(link_inputs, options, temporaries);
+    link_inputs.assign(temporaries.begin() + first, temporaries.end());
+    phase.set("objects", link_inputs.size());
+  }
+
+  // Link to executable
+  if (success && !options.emit_object) {
+    CompileStats::Phase phase(stats, "link", options.output_file);
+    success = link_object(link_inputs, options);
+    if (success) {
+      phase.set("bytes", file_size(options.output_file));
+    }
+  }
+  remove_files(temporaries);
+  return success;
+}
+
+bool Driver::splits_units(const CompileOptions& options) {
+  // Objects to link are built in parallel; -S and -c produce a single module, and so does -j1,
+  // which would gain nothing from losing inlining across units.
+  // With ThinLTO, -j runs the backends in parallel instead
+  return options.jobs > 1 && !options.emit_llvm && !options.emit_bitcode && !options.emit_object &&
+         !options.thin_lto;
+}
+
+bool Driver::thin_link(const std::vector<std::string>& bitcode_files,
+                       const CompileOptions& options, std::vector<std::string>& native_files) {
+  ThinLinkOptions link_options;
+  link_options.threads = static_cast<unsigned>(std::max(options.jobs, 0));
+  link_options.cache_dir = options.cache_dir;
   if (options.verbose) {
-    std::cout << "  Declarations: " << program.declarations.size() << std::endl;
+    out() << "  Running ThinLTO on " << bitcode_files.size() << " module(s)..." << std::endl;
+  }
+  try {
+    run_thin_lto(bitcode_files, make_codegen_options(options), link_options, native_files);
+  } catch (const CodeGenError& e) {
+    get_global_diagnostics().error(e.what());
+    return false;
   }
+  return true;
+}
+
+bool Driver::emit_objects(const CompileOptions& options, const std::string& input,
+                          std::vector<std::string>& obj_files, CompileStats* stats) {
+  if (splits_units(options)) {
+    return emit_parallel(options, input, obj_files, stats);
+  }
+
+  auto codegen = build(options, input, stats);
+  if (!codegen) {
+    return false;
+  }
+
+  llvm::SmallString<128> obj_file;
+  if (!create_temp_object(obj_file)) {
+    return false;
+  }
+  obj_files.push_back(obj_file.str().str());
 
-  // Code generation
   if (options.verbose)
-    std::cout << "  Generating LLVM IR..." << std::endl;
-  CodeGenerator codegen;
+    out() << "  Generating object file: " << obj_file.str().str() << std::endl;
+  CompileStats::Phase phase(stats, "emit", input);
   try {
-    codegen.generate(program);
-  } catch (const CodeGenError& e) {
-    if (e.has_location()) {
-      diagnostics.error(e.what(), e.location(), source_file);
+    if (options.thin_lto) {
+      codegen->compile_to_bitcode(obj_file.str().str());
     } else {
-      diagnostics.error(e.what());
+      codegen->compile_to_object(obj_file.str().str());
     }
+  } catch (const CodeGenError& e) {
+    report_codegen_error(e, nullptr);
+    return false;
+  }
+  phase.set("bytes", file_size(obj_file.str().str()));
+  return true;
+}
+
+bool Driver::emit_parallel(const CompileOptions& options, const std::string& input,
+                           std::vector<std::string>& obj_files, CompileStats* stats) {
+  Program program;
+  std::shared_ptr<SourceFile> source_file;
+  if (!parse_input(options, input, program, source_file, stats)) {
     return false;
+  }
+
+  // Resolve once up front; the codegen units then only read the shared AST
+  try {
+    CompileStats::Phase phase(stats, "resolve", input);
+    Resolver resolver(program.context->symbols());
+    resolver.resolve(program);
   } catch (const std::exception& e) {
-    diagnostics.error(e.what());
+    report_codegen_error(e, source_file);
     return false;
   }
 
-  // Output
-  if (options.emit_llvm) {
-    std::string ll_file = options.output_file + ".ll";
-    if (options.verbose)
-      std::cout << "  Writing LLVM IR to: " << ll_file << std::endl;
-    codegen.dump_ir(ll_file);
-    return true;
+  // The split depends only on the program, never on the number of threads, so the linked
+  // output is the same for every -j
+  size_t bodies = 0;
+  for (auto& decl : program.declarations) {
+    if (decl->kind == DeclKind::Function && static_cast<FunctionDecl&>(*decl).body) {
+      ++bodies;
+    }
   }
+  unsigned unit_count = static_cast<unsigned>(std::clamp<size_t>(bodies, 1, MaxCodeGenUnits));
+  unsigned threads = std::min<unsigned>(options.jobs, unit_count);
 
-  // Compile to object file
-  std::string obj_file = options.output_file + ".o";
-  if (options.verbose)
-    std::cout << "  Generating object file: " << obj_file << std::endl;
-  codegen.compile_to_object(obj_file);
+  size_t first = obj_files.size();
+  for (unsigned u = 0; u < unit_count; ++u) {
+    llvm::SmallString<128> path;
+    if (!create_temp_object(path)) {
+      return false;
+    }
+    obj_files.push_back(path.str().str());
+  }
 
-  if (options.emit_object) {
-    return true;
+  if (options.verbose) {
+    out() << "  Generating " << unit_count << " codegen unit(s) on " << threads
+          << " thread(s)..." << std::endl;
   }
 
-  // Link to executable
-  return link_object(obj_file, options);
+  // Each unit gets its own generator, and with it its own LLVMContext and module. Units report
+  // to a buffer of their own, so workers never contend for the console.
+  auto source_manager = get_global_diagnostics().get_source_manager();
+  std::vector<DiagnosticEngine> unit_diagnostics(unit_count);
+  std::vector<BufferedDiagnosticConsumer*> buffers;
+  for (auto& engine : unit_diagnostics) {
+    auto buffer = std::make_unique<BufferedDiagnosticConsumer>();
+    buffers.push_back(buffer.get());
+    engine.set_source_manager(source_manager);
+    engine.set_consumer(std::move(buffer));
+  }
+
+  // The units overlap in time, so the section's own wall time is what goes into the total
+  CompileStats::Phase section(stats, "units", input);
+  section.set("units", unit_count);
+  section.set("threads", threads);
+  std::vector<char> emitted(unit_count, 0);
+  std::atomic<unsigned> next_unit{0};
+  auto worker = [&] {
+    for (unsigned u = next_unit++; u < unit_count; u = next_unit++) {
+      DiagnosticScope scope(unit_diagnostics[u]);
+      try {
+        CodeGenOptions codegen_options = make_codegen_options(options, stats);
+        codegen_options.source_file = input;
+        codegen_options.unit_index = u;
+        codegen_options.unit_count = unit_count;
+        CodeGenerator codegen(codegen_options);
+        std::string unit = input + " [unit " + std::to_string(u) + "]";
+        {
+          CompileStats::Phase phase(section, "codegen", unit);
+          codegen.generate(program);
+        }
+        {
+          CompileStats::Phase phase(section, "optimize", unit);
+          codegen.optimize();
+        }
+        CompileStats::Phase phase(section, "emit", unit);
+        codegen.compile_to_object(obj_files[first + u]);
+        emitted[u] = 1;
+        phase.set("bytes", file_size(obj_files[first + u]));
+      } catch (const std::exception& e) {
+        report_codegen_error(e, source_file);
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+
+  // Merged by position, then unit, so diagnostics do not depend on scheduling
+  bool success = std::all_of(emitted.begin(), emitted.end(), [](char ok) { return ok; });
+  flush_diagnostics(buffers, *get_global_diagnostics().get_consumer());
+  return success;
 }
 
-bool Driver::link_object(const std::string& obj_file, const CompileOptions& options) {
+int Driver::execute(const CompileOptions& options) {
+  auto stats = make_stats(options);
+  auto codegen = build(options, options.input_files.front(), stats.get());
+  if (!codegen) {
+    return 1;
+  }
+  // The report covers compilation only, so it is printed before main runs
+  print_stats(options, stats.get());
+
   if (options.verbose)
-    std::cout << "  Linking..." << std::endl;
+    out() << "  Running in JIT..." << std::endl;
 
-  // Build link command
-  std::string cmd = "clang " + obj_file + " -o " + options.output_file;
+  std::vector<std::string> args;
+  args.push_back(options.input_files.front());
+  args.insert(args.end(), options.program_args.begin(), options.program_args.end());
 
-  // Add optimization flags
-  if (options.optimize) {
-    cmd += " -O" + std::to_string(options.opt_level);
+  try {
+    return codegen->execute_jit("main", args);
+  } catch (const CodeGenError& e) {
+    get_global_diagnostics().error(e.what());
+    return 1;
+  }
+}
+
+#ifdef TUZ_HAVE_LLD
+// Locate the C runtime start files and dynamic linker for an ELF/glibc target
+struct ElfRuntime {
+  std::string lib_dir;
+  std::string gcc_dir; // crtbeginS.o, crtendS.o and libgcc
+  std::string dynamic_linker;
+};
+
+// The newest GCC installation for the target, whose crtbeginS.o and crtendS.o set up
+// __dso_handle and the init and fini frames, and whose libgcc holds the helpers code calls
+static std::optional<std::string> find_gcc_dir(const llvm::Triple& triple) {
+  std::string arch = triple.getArchName().str();
+  std::optional<std::string> newest;
+  llvm::VersionTuple newest_version;
+  std::vector<std::string> roots = {"/usr/lib/gcc/" + arch + "-linux-gnu",
+                                    "/usr/lib/gcc/" + arch + "-redhat-linux",
+                                    "/usr/lib64/gcc/" + arch + "-suse-linux"};
+  for (const auto& root : roots) {
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(root, ec), end; it != end && !ec;
+         it.increment(ec)) {
+      llvm::VersionTuple version;
+      if (version.tryParse(llvm::sys::path::filename(it->path())) ||
+          !llvm::sys::fs::exists(it->path() + "/crtbeginS.o") ||
+          !llvm::sys::fs::exists(it->path() + "/crtendS.o")) {
+        continue;
+      }
+      if (!newest || newest_version < version) {
+        newest = it->path();
+        newest_version = version;
+      }
+    }
+  }
+  return newest;
+}
+
+static std::optional<ElfRuntime> find_elf_runtime(const llvm::Triple& triple) {
+  if (!triple.isOSLinux() || !triple.isOSBinFormatELF()) {
+    return std::nullopt;
+  }
+
+  std::string dynamic_linker;
+  switch (triple.getArch()) {
+  case llvm::Triple::x86_64:
+    dynamic_linker = "/lib64/ld-linux-x86-64.so.2";
+    break;
+  case llvm::Triple::aarch64:
+    dynamic_linker = "/lib/ld-linux-aarch64.so.1";
+    break;
+  default:
+    return std::nullopt;
+  }
+
+  auto gcc_dir = find_gcc_dir(triple);
+  if (!gcc_dir) {
+    return std::nullopt;
+  }
+
+  std::string multiarch = triple.getArchName().str() + "-linux-gnu";
+  for (std::string dir : {"/usr/lib/" + multiarch, "/lib/" + multiarch, std::string("/usr/lib64"),
+                          std::string("/usr/lib")}) {
+    if (llvm::sys::fs::exists(dir + "/Scrt1.o") && llvm::sys::fs::exists(dir + "/crti.o") &&
+        llvm::sys::fs::exists(dir + "/crtn.o")) {
+      return ElfRuntime{dir, *gcc_dir, dynamic_linker};
+    }
+  }
+  return std::nullopt;
+}
+
+Driver::LinkResult Driver::link_with_lld(const std::vector<std::string>& obj_files,
+                                         const CompileOptions& options) {
+  llvm::Triple triple(options.target_triple.empty() ? llvm::sys::getDefaultTargetTriple()
+                                                    : options.target_triple);
+  auto runtime = find_elf_runtime(triple);
+  if (!runtime) {
+    return LinkResult::Unavailable;
+  }
+
+  std::vector<std::string> args = {"ld.lld",
+                                   "--eh-frame-hdr",
+                                   "-pie",
+                                   "-dynamic-linker",
+                                   runtime->dynamic_linker,
+                                   "-o",
+                                   options.output_file,
+                                   runtime->lib_dir + "/Scrt1.o",
+                                   runtime->lib_dir + "/crti.o",
+                                   runtime->gcc_dir + "/crtbeginS.o"};
+  args.insert(args.end(), obj_files.begin(), obj_files.end());
+  for (const auto& path : options.library_paths) {
+    args.push_back("-L" + path);
+  }
+  args.push_back("-L" + runtime->gcc_dir);
+  args.push_back("-L" + runtime->lib_dir);
+  for (const auto& lib : options.libraries) {
+    args.push_back("-l" + lib);
+  }
+  // libgcc around libc as gcc links it: helpers libc itself needs resolve too, and libgcc_s
+  // is only a dependency of programs that use it
+  for (const char* lib : {"-lgcc", "--as-needed", "-lgcc_s", "--no-as-needed", "-lc", "-lgcc",
+                          "--as-needed", "-lgcc_s", "--no-as-needed"}) {
+    args.push_back(lib);
+  }
+  args.push_back(runtime->gcc_dir + "/crtendS.o");
+  args.push_back(runtime->lib_dir + "/crtn.o");
+
+  std::vector<const char*> argv;
+  for (const auto& arg : args) {
+    argv.push_back(arg.c_str());
+  }
+
+  if (options.verbose) {
+    out() << "  Linking in process:";
+    for (const auto& arg : args) {
+      out() << " " << arg;
+    }
+    out() << std::endl;
+  }
+
+  // lld keeps its state in globals, so links in one process (the compile server) take turns
+  static std::mutex lld_mutex;
+  std::lock_guard<std::mutex> lock(lld_mutex);
+  llvm::raw_os_ostream lld_out(out());
+  llvm::raw_os_ostream lld_err(err());
+  lld::Result result = lld::lldMain(argv, lld_out, lld_err, {{lld::Gnu, &lld::elf::link}});
+  return result.retCode == 0 ? LinkResult::Success : LinkResult::Failed;
+}
+#endif
+
+Driver::LinkResult Driver::link_with_clang(const std::vector<std::string>& obj_files,
+                                           const CompileOptions& options) {
+  auto clang = llvm::sys::findProgramByName("clang");
+  if (!clang) {
+    err() << "Error: clang not found in PATH" << std::endl;
+    return LinkResult::Unavailable;
+  }
+
+  std::vector<std::string> args = {*clang};
+  args.insert(args.end(), obj_files.begin(), obj_files.end());
+  args.push_back("-o");
+  args.push_back(options.output_file);
+  if (!options.target_triple.empty()) {
+    args.push_back("--target=" + options.target_triple);
   }
 
   // Add library paths
   for (const auto& path : options.library_paths) {
-    cmd += " -L" + path;
+    args.push_back("-L" + path);
   }
 
   // Add libraries
   for (const auto& lib : options.libraries) {
-    cmd += " -l" + lib;
+    args.push_back("-l" + lib);
   }
 
   // Link with standard C library
-  cmd += " -lc";
+  args.push_back("-lc");
 
+  // Pulls in the profile runtime that writes the counters out at exit
+  if (options.profile_generate) {
+    args.push_back("-fprofile-generate");
+  }
+
+  if (options.verbose) {
+    out() << "  Command:";
+    for (const auto& arg : args) {
+      out() << " " << arg;
+    }
+    out() << std::endl;
+  }
+
+  // Arguments are passed directly, so paths with spaces need no quoting
+  std::vector<llvm::StringRef> argv(args.begin(), args.end());
+  int result = llvm::sys::ExecuteAndWait(*clang, argv);
+  return result == 0 ? LinkResult::Success : LinkResult::Failed;
+}
+
+bool Driver::link_object(const std::vector<std::string>& obj_files,
+                         const CompileOptions& options) {
   if (options.verbose)
-    std::cout << "  Command: " << cmd << std::endl;
+    out() << "  Linking..." << std::endl;
 
-  int result = std::system(cmd.c_str());
+  LinkResult result = LinkResult::Unavailable;
 
-  // Clean up object file
-  std::remove(obj_file.c_str());
+#ifdef TUZ_HAVE_LLD
+  // The profile runtime ships with clang, so instrumented programs are linked by its driver
+  if (options.profile_generate && options.linker != "clang" && options.verbose)
+    out() << "  Linking the profile runtime with clang" << std::endl;
+  if (options.linker != "clang" && !options.profile_generate) {
+    result = link_with_lld(obj_files, options);
+    if (result == LinkResult::Unavailable && options.verbose)
+      out() << "  C runtime not found for lld, falling back to clang" << std::endl;
+  }
+#else
+  if (options.linker == "lld" && options.verbose)
+    out() << "  tuzc was built without lld, falling back to clang" << std::endl;
+#endif
+
+  if (result == LinkResult::Unavailable) {
+    result = link_with_clang(obj_files, options);
+  }
 
-  if (result != 0) {
-    std::cerr << "Linking failed" << std::endl;
+  if (result != LinkResult::Success) {
+    err() << "Linking failed" << std::endl;
     return false;
   }
 
   if (options.verbose) {
-    std::cout << "Output: " << options.output_file << std::endl;
+    out() << "Output: " << options.output_file << std::endl;
   }
 
   return true;
 }
 
 static void print_usage(const char* program) {
-  std::cout << "Usage: " << program << " [options] <input file>" << std::endl;
-  std::cout << std::endl;
-  std::cout << "Options:" << std::endl;
-  std::cout << "  -o <file>     Output file name (default: a.out)" << std::endl;
-  std::cout << "  -S            Emit LLVM IR only" << std::endl;
-  std::cout << "  -c            Emit object file only" << std::endl;
-  std::cout << "  -O<level>     Optimization level (0-3)" << std::endl;
-  std::cout << "  -v            Verbose output" << std::endl;
-  std::cout << "  -L<path>      Add library search path" << std::endl;
-  std::cout << "  -l<lib>       Link with library" << std::endl;
-  std::cout << "  -h, --help    Show this help message" << std::endl;
+  out() << "Usage: " << program << " [options] <input files...>" << std::endl;
+  out() << std::endl;
+  out() << "Options:" << std::endl;
+  out() << "  -o <file>     Output file name (default: a.out)" << std::endl;
+  out() << "  -S            Emit LLVM IR only" << std::endl;
+  out() << "  -c            Emit object file only" << std::endl;
+  out() << "  -emit-bc      Emit LLVM bitcode only" << std::endl;
+  out() << "  -flto=thin    Compile to bitcode with summaries and run ThinLTO when linking"
+        << std::endl;
+  out() << "  -O<level>     Optimization level (0-3)" << std::endl;
+  out() << "  -g            Emit debug info; with --run, register jitted code with gdb and perf"
+        << std::endl;
+  out() << "  -fbounds-check Trap on out-of-bounds array indexes not proven in range" << std::endl;
+  out() << "  -v            Verbose output" << std::endl;
+  out() << "  -j <n>        Generate code on n threads when building an executable, in units"
+        << std::endl;
+  out() << "                that are not inlined into each other (ThinLTO backends; every core"
+        << std::endl;
+  out() << "                by default)" << std::endl;
+  out() << "  -L<path>      Add library search path" << std::endl;
+  out() << "  -l<lib>       Link with library" << std::endl;
+  out() << "  --target=<triple> Generate code for the given target triple" << std::endl;
+  out() << "  -mcpu=<cpu>   Target CPU, or 'native' for the host CPU and its features" << std::endl;
+  out() << "  -mattr=<list> Target features, e.g. +avx2,-fma" << std::endl;
+  out() << "  -fuse-ld=<ld> Linker: lld (in process, default when available) or clang" << std::endl;
+  out() << "  --cache       Reuse objects of unchanged inputs from ~/.cache/tuz" << std::endl;
+  out() << "  --cache-dir=<dir> Reuse objects of unchanged inputs from <dir>" << std::endl;
+  out() << "  -ftime-report Print time, memory and counters per phase and LLVM pass" << std::endl;
+  out() << "  --stats=<fmt> Print the same report as text or json (to stderr)" << std::endl;
+  out() << "  -fdiagnostics-format=<fmt> Print diagnostics as text or JSON lines" << std::endl;
+  out() << "  -fprofile-generate[=<dir>] Instrument the program to write a profile to" << std::endl;
+  out() << "                <dir>/default_%m.profraw when it exits" << std::endl;
+  out() << "  -fprofile-use=<file> Optimize with a profile merged by llvm-profdata" << std::endl;
+  out() << "  --run         JIT-compile and run main; arguments after the input file" << std::endl;
+  out() << "                are passed to the program" << std::endl;
+  out() << "  --repl        Evaluate declarations, statements and expressions from stdin"
+        << std::endl;
+  out() << "                after loading the input files" << std::endl;
+  out() << "  -h, --help    Show this help message" << std::endl;
 }
 
-int Driver::run(int argc, char** argv) {
-  if (argc < 2) {
-    print_usage(argv[0]);
-    return 1;
-  }
-
-  CompileOptions options;
+std::optional<int> Driver::parse_args(const std::vector<std::string>& args,
+                                      CompileOptions& options) {
+  for (size_t i = 0; i < args.size(); i++) {
+    const std::string& arg = args[i];
 
-  for (int i = 1; i < argc; i++) {
-    std::string arg = argv[i];
+    // With --run, everything after the input file belongs to the program
+    if (options.run_jit && !options.input_files.empty()) {
+      options.program_args.push_back(arg);
+      continue;
+    }
 
     if (arg == "-h" || arg == "--help") {
-      print_usage(argv[0]);
+      print_usage("tuzc");
       return 0;
-    } else if (arg == "-o" && i + 1 < argc) {
-      options.output_file = argv[++i];
+    } else if (arg == "-o" && i + 1 < args.size()) {
+      options.output_file = args[++i];
     } else if (arg == "-S") {
       options.emit_llvm = true;
     } else if (arg == "-c") {
       options.emit_object = true;
+    } else if (arg == "-emit-bc") {
+      options.emit_bitcode = true;
+    } else if (arg == "-flto=thin") {
+      options.thin_lto = true;
+    } else if (arg.rfind("--target=", 0) == 0) {
+      options.target_triple = arg.substr(9);
+    } else if (arg.rfind("-mcpu=", 0) == 0) {
+      options.target_cpu = arg.substr(6);
+    } else if (arg.rfind("-mattr=", 0) == 0) {
+      options.target_features = arg.substr(7);
+    } else if (arg.rfind("-fuse-ld=", 0) == 0) {
+      options.linker = arg.substr(9);
+      if (options.linker != "lld" && options.linker != "clang") {
+        err() << "Unknown linker: " << options.linker << std::endl;
+        return 1;
+      }
+    } else if (arg == "--run") {
+      options.run_jit = true;
+    } else if (arg == "--repl") {
+      options.repl = true;
+    } else if (arg == "-j" && i + 1 < args.size()) {
+      options.jobs = std::stoi(args[++i]);
+    } else if (arg.size() > 2 && arg[0] == '-' && arg[1] == 'j') {
+      options.jobs = std::stoi(arg.substr(2));
+    } else if (arg == "-fbounds-check") {
+      options.bounds_check = true;
+    } else if (arg == "-g") {
+      options.debug_info = true;
     } else if (arg == "-v") {
       options.verbose = true;
     } else if (arg.size() > 2 && arg[0] == '-' && arg[1] == 'O') {
@@ -195,21 +871,179 @@ int Driver::run(int argc, char** argv) {
       options.library_paths.push_back(arg.substr(2));
     } else if (arg.size() > 2 && arg[0] == '-' && arg[1] == 'l') {
       options.libraries.push_back(arg.substr(2));
+    } else if (arg == "-ftime-report") {
+      options.stats_format = "text";
+    } else if (arg.rfind("--stats=", 0) == 0) {
+      options.stats_format = arg.substr(8);
+      if (options.stats_format != "text" && options.stats_format != "json") {
+        err() << "Unknown stats format: " << options.stats_format << std::endl;
+        return 1;
+      }
+    } else if (arg.rfind("-fdiagnostics-format=", 0) == 0) {
+      std::string format = arg.substr(21);
+      if (format != "text" && format != "json") {
+        err() << "Unknown diagnostics format: " << format << std::endl;
+        return 1;
+      }
+      options.diagnostics_json = format == "json";
+    } else if (arg == "-fprofile-generate") {
+      options.profile_generate = true;
+    } else if (arg.rfind("-fprofile-generate=", 0) == 0) {
+      options.profile_generate = true;
+      options.profile_dir = arg.substr(19);
+    } else if (arg.rfind("-fprofile-use=", 0) == 0) {
+      options.profile_use = arg.substr(14);
+    } else if (arg.rfind("--serve=", 0) == 0) {
+      options.serve_socket = arg.substr(8);
+    } else if (arg.rfind("--server=", 0) == 0) {
+      options.server_socket = arg.substr(9);
+    } else if (arg == "--cache") {
+      options.cache_dir = ObjectCache::default_directory();
+    } else if (arg.rfind("--cache-dir=", 0) == 0) {
+      options.cache_dir = arg.substr(12);
     } else if (arg[0] != '-') {
-      options.input_file = arg;
+      options.input_files.push_back(arg);
     } else {
-      std::cerr << "Unknown option: " << arg << std::endl;
+      err() << "Unknown option: " << arg << std::endl;
       return 1;
     }
   }
 
-  if (options.input_file.empty()) {
-    std::cerr << "Error: No input file specified" << std::endl;
+  if (options.input_files.empty() && options.serve_socket.empty() && !options.repl) {
+    err() << "Error: No input file specified" << std::endl;
     return 1;
   }
 
+  if (options.profile_generate && !options.profile_use.empty()) {
+    err() << "Error: -fprofile-generate and -fprofile-use cannot be combined" << std::endl;
+    return 1;
+  }
+
+  if (options.run_jit && options.profile_generate) {
+    err() << "Error: -fprofile-generate needs a linked executable, not --run" << std::endl;
+    return 1;
+  }
+  return std::nullopt;
+}
+
+int Driver::run(const CompileOptions& options) {
+  if (!options.serve_socket.empty()) {
+    return serve(options);
+  }
+  if (options.repl) {
+    return repl(options);
+  }
+  if (options.run_jit) {
+    return execute(options);
+  }
   bool success = compile(options);
   return success ? 0 : 1;
 }
 
+int Driver::run(int argc, char** argv) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<std::string> args(argv + 1, argv + argc);
+  CompileOptions options;
+  if (auto exit_code = parse_args(args, options)) {
+    return *exit_code;
+  }
+
+  // --run and --repl execute in this process, so only compiles are sent to a server. The
+  // server parses the command line itself; without one listening, compile here.
+  if (!options.server_socket.empty() && !options.run_jit && !options.repl) {
+    std::erase_if(args, [](const std::string& arg) { return arg.rfind("--server=", 0) == 0; });
+    llvm::SmallString<256> cwd;
+    llvm::sys::fs::current_path(cwd);
+    if (auto exit_code = send_compile_request(options.server_socket, cwd.str().str(), args,
+                                              std::cout, std::cerr)) {
+      return *exit_code;
+    }
+    if (options.verbose) {
+      out() << "No compile server on " << options.server_socket << ", compiling here" << std::endl;
+    }
+  }
+  return run(options);
+}
+
+// Paths in a request are relative to the client's working directory, not the server's
+static void make_absolute(const std::string& cwd, std::string& path) {
+  if (path.empty()) {
+    return;
+  }
+  llvm::SmallString<256> absolute(path);
+  llvm::sys::fs::make_absolute(cwd, absolute);
+  path = absolute.str().str();
+}
+
+int Driver::run_request(const std::vector<std::string>& args, const std::string& cwd,
+                        std::ostream& output, std::ostream& errors) {
+  ScopedOutput redirect(output, errors);
+  DiagnosticEngine diagnostics;
+  DiagnosticScope scope(diagnostics);
+
+  CompileOptions options;
+  if (auto exit_code = parse_args(args, options)) {
+    return *exit_code;
+  }
+  if (options.run_jit || options.repl || !options.serve_socket.empty()) {
+    err() << "Error: --run, --repl and --serve cannot be sent to a compile server" << std::endl;
+    return 1;
+  }
+
+  for (auto& input : options.input_files) {
+    make_absolute(cwd, input);
+  }
+  for (auto& path : options.library_paths) {
+    make_absolute(cwd, path);
+  }
+  make_absolute(cwd, options.output_file);
+  make_absolute(cwd, options.cache_dir);
+  make_absolute(cwd, options.profile_dir);
+  make_absolute(cwd, options.profile_use);
+  return compile(options) ? 0 : 1;
+}
+
+int Driver::serve(const CompileOptions& options) {
+  unsigned workers = options.jobs > 0 ? static_cast<unsigned>(options.jobs)
+                                      : std::max(1u, std::thread::hardware_concurrency());
+  CompileServer server(options.serve_socket, workers);
+  if (!server.listen(err())) {
+    return 1;
+  }
+  if (options.verbose) {
+    out() << "Serving on " << options.serve_socket << " with " << workers << " worker(s)"
+          << std::endl;
+  }
+  server.serve();
+  return 0;
+}
+
+int Driver::repl(const CompileOptions& options) {
+  Repl session(make_codegen_options(options));
+
+  // Input files are loaded first, so the inputs can call their functions
+  for (const auto& input : options.input_files) {
+    auto source = SourceFile::open(input);
+    if (!source) {
+      err() << "Error: Could not open file: " << input << std::endl;
+      return 1;
+    }
+    try {
+      session.evaluate(source->content());
+    } catch (const ParseError& e) {
+      get_global_diagnostics().error(e.what(), SourceLocation(e.line, e.column), source);
+      return 1;
+    } catch (const std::exception& e) {
+      report_codegen_error(e, source);
+      return 1;
+    }
+  }
+
+  return session.run(std::cin, out(), err());
+}
+
 } // namespace tuz
@@ -0,0 +1,43 @@
+#pragma once
+
+// Internal to the library: shared by the JSON diagnostics and the JSON compile statistics, so
+// both escape strings the same way.
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace tuz {
+
+// Append text to out as a quoted JSON string. Control characters are escaped; other bytes,
+// UTF-8 sequences included, are copied as they are.
+inline void append_json_string(std::string& out, std::string_view text) {
+  out += '"';
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escape[8];
+        std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+        out += escape;
+      } else {
+        out += c;
+      }
+    }
+  }
+  out += '"';
+}
+
+} // namespace tuz
@@ -1,9 +1,68 @@
 #include "tuz/lexer.h"
 
-#include <cctype>
+#include <algorithm>
+#include <array>
 
 namespace tuz {
 
+// =============================================================================
+// Lookup tables
+// =============================================================================
+
+namespace {
+
+constexpr auto build_char_classes() {
+  std::array<uint8_t, 256> classes{};
+  for (int c = 0; c < 256; ++c) {
+    uint8_t mask = 0;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+      mask |= CHAR_ALPHA | CHAR_IDENTIFIER_START | CHAR_IDENTIFIER;
+    if (c >= '0' && c <= '9')
+      mask |= CHAR_DIGIT | CHAR_IDENTIFIER;
+    if (c == '_')
+      mask |= CHAR_IDENTIFIER_START | CHAR_IDENTIFIER;
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+      mask |= CHAR_WHITESPACE;
+    classes[c] = mask;
+  }
+  return classes;
+}
+
+constexpr auto CharClasses = build_char_classes();
+
+// Operators keyed by their first character: the single-character token (if any) and the one
+// two-character token that may extend it
+struct OperatorEntry {
+  TokenType single = TokenType::INVALID;
+  std::string_view single_text;
+  char second = '\0';
+  TokenType pair = TokenType::INVALID;
+  std::string_view pair_text;
+};
+
+constexpr auto build_operator_table() {
+  std::array<OperatorEntry, 256> table{};
+  for (const auto& op : OperatorDefinitions) {
+    auto& entry = table[static_cast<uint8_t>(op.value[0])];
+    if (op.value.size() == 1) {
+      entry.single = op.type;
+      entry.single_text = op.value;
+    } else {
+      // A second pair for the same first character would need a longer entry
+      if (op.value.size() != 2 || entry.second != '\0')
+        throw "unsupported operator spelling";
+      entry.second = op.value[1];
+      entry.pair = op.type;
+      entry.pair_text = op.value;
+    }
+  }
+  return table;
+}
+
+constexpr auto OperatorTable = build_operator_table();
+
+} // namespace
+
 Lexer::Lexer(std::string_view source) : source_(source), position_(0), line_(1), column_(1) {
 }
 
@@ -56,17 +115,21 @@ Token Lexer::next_token() {
   }
 
   // Operators and delimiters
-  // Note: Tokens are sorted by the length
-  for (auto& token : Tokens) {
-    if (try_consume(token.value)) {
-      return Token(token.type, token.value, location);
-    }
+  const auto& op = OperatorTable[static_cast<uint8_t>(ch)];
+  if (op.pair != TokenType::INVALID && peek_at(1) == op.second) {
+    advance();
+    advance();
+    return Token(op.pair, op.pair_text, location);
+  }
+  if (op.single != TokenType::INVALID) {
+    advance();
+    return Token(op.single, op.single_text, location);
   }
 
   // Invalid token
-  auto invalidChar = std::string(1, ch);
+  std::string_view invalid_char(source_.data() + position_, 1);
   advance();
-  return Token(TokenType::INVALID, invalidChar, location);
+  return Token(TokenType::INVALID, invalid_char, location);
 }
 
 bool Lexer::try_consume(std::string_view value) {
@@ -86,8 +149,18 @@ bool Lexer::is_at_end() {
   return position_ >= source_.size();
 }
 
-void Lexer::advance_while(LexPredicate predicate) {
-  while (!is_at_end() && predicate(peek())) {
+void Lexer::advance_while(uint8_t char_class) {
+  // Only whitespace can span lines; other runs just move the column
+  if (!(char_class & CHAR_WHITESPACE)) {
+    auto start = position_;
+    while (position_ < source_.size() && has_class(source_[position_], char_class)) {
+      position_++;
+    }
+    column_ += static_cast<uint32_t>(position_ - start);
+    return;
+  }
+
+  while (!is_at_end() && has_class(peek(), char_class)) {
     advance();
   }
 }
@@ -115,7 +188,7 @@ void Lexer::advance() {
 }
 
 void Lexer::skip_whitespace() {
-  advance_while(&Lexer::is_whitespace);
+  advance_while(CHAR_WHITESPACE);
 }
 
 bool Lexer::skip_comment() {
@@ -145,7 +218,7 @@ Token Lexer::identifier() {
   auto location = current_location();
   auto start_pos = position_;
 
-  advance_while(&Lexer::is_identifier);
+  advance_while(CHAR_IDENTIFIER);
 
   std::string_view text(source_.data() + start_pos, position_ - start_pos);
 
@@ -163,11 +236,11 @@ Token Lexer::number() {
   auto start_pos = position_;
   auto is_float = false;
 
-  advance_while(&Lexer::is_digit);
+  advance_while(CHAR_DIGIT);
 
   if (advance_if(".")) {
     is_float = true;
-    advance_while(&Lexer::is_digit);
+    advance_while(CHAR_DIGIT);
   }
 
   // Exponent
@@ -175,7 +248,7 @@ Token Lexer::number() {
     // TODO: Ensure number is present after e
     is_float = true;
     advance_if("+-");
-    advance_while(&Lexer::is_digit);
+    advance_while(CHAR_DIGIT);
   }
 
   std::string_view text(source_.data() + start_pos, position_ - start_pos);
@@ -189,74 +262,73 @@ Token Lexer::string() {
   auto location = current_location();
   advance(); // skip opening quote
 
-  std::string value;
+  auto start_pos = position_;
+  auto has_escapes = false;
   while (!is_at_end() && peek() != '"') {
     if (peek() == '\\') {
+      has_escapes = true;
       advance();
-      switch (peek()) {
+    }
+    advance();
+  }
+
+  std::string_view raw(source_.data() + start_pos, std::min(position_, source_.size()) - start_pos);
+
+  if (peek() == '"') {
+    advance(); // skip closing quote
+  }
+
+  // Plain literals are a slice of the source; only escaped ones need a decoded copy
+  if (!has_escapes) {
+    return Token(TokenType::STRING_LITERAL, raw, location);
+  }
+
+  // Decoding never grows the text, so the raw length is enough
+  auto* value = static_cast<char*>(string_arena_.allocate(raw.size(), 1));
+  size_t length = 0;
+  for (size_t i = 0; i < raw.size(); ++i) {
+    auto ch = raw[i];
+    if (ch == '\\' && i + 1 < raw.size()) {
+      switch (raw[++i]) {
       case 'n':
-        value += '\n';
+        ch = '\n';
         break;
       case 't':
-        value += '\t';
+        ch = '\t';
         break;
       case 'r':
-        value += '\r';
-        break;
-      case '\\':
-        value += '\\';
-        break;
-      case '"':
-        value += '"';
+        ch = '\r';
         break;
       case '0':
-        value += '\0';
+        ch = '\0';
         break;
       default:
-        value += peek();
+        ch = raw[i];
         break;
       }
-    } else {
-      value += peek();
     }
-    advance();
-  }
-
-  if (peek() == '"') {
-    advance(); // skip closing quote
+    value[length++] = ch;
   }
 
-  return Token(TokenType::STRING_LITERAL, value, location);
+  return Token(TokenType::STRING_LITERAL, std::string_view(value, length), location);
 }
 
-bool Lexer::is_alpha(char c) {
-  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+bool Lexer::has_class(char c, uint8_t char_class) {
+  return (CharClasses[static_cast<uint8_t>(c)] & char_class) != 0;
 }
 
 bool Lexer::is_digit(char c) {
-  return c >= '0' && c <= '9';
-}
-
-bool Lexer::is_alphanumeric(char c) {
-  return is_alpha(c) || is_digit(c);
+  return has_class(c, CHAR_DIGIT);
 }
 
 bool Lexer::is_identifier_start(char c) {
-  return is_alpha(c) || c == '_';
-}
-
-bool Lexer::is_identifier(char c) {
-  return is_alphanumeric(c) || c == '_';
+  return has_class(c, CHAR_IDENTIFIER_START);
 }
 
 bool Lexer::is_string_start(char c) {
   return c == '"';
 }
 
-bool Lexer::is_whitespace(char c) {
-  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
-}
-
 Location Lexer::current_location() const {
   return {line_, column_};
 }
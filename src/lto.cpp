@@ -0,0 +1,128 @@
+#include "tuz/lto.h"
+
+#include "tuz/diagnostic.h"
+
+#include <algorithm>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/LTO/LTO.h>
+#include <llvm/Support/Caching.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+namespace tuz {
+
+void run_thin_lto(const std::vector<std::string>& inputs, const CodeGenOptions& options,
+                  const ThinLinkOptions& link_options, std::vector<std::string>& objects) {
+  TargetSelection target = select_target(options);
+
+  // The backends compile for the same target as compile_to_object would
+  llvm::lto::Config config;
+  config.CPU = target.cpu;
+  llvm::SmallVector<llvm::StringRef, 8> features;
+  llvm::StringRef(target.features).split(features, ',', -1, false);
+  for (auto feature : features) {
+    config.MAttrs.push_back(feature.str());
+  }
+  config.RelocModel = llvm::Reloc::PIC_;
+  config.OptLevel = static_cast<unsigned>(options.opt_level);
+  config.CGOptLevel = get_codegen_opt_level(options.opt_level);
+  config.DefaultTriple = target.triple;
+
+  llvm::lto::LTO lto(std::move(config),
+                     llvm::lto::createInProcessThinBackend(
+                         llvm::heavyweight_hardware_concurrency(link_options.threads)));
+
+  // Inputs refer to their buffers until the link has run
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> buffers;
+  std::unordered_set<std::string> defined;
+  for (const auto& path : inputs) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+      throw CodeGenError("could not read '" + path + "': " + buffer.getError().message());
+    }
+    auto input = llvm::lto::InputFile::create((*buffer)->getMemBufferRef());
+    if (!input) {
+      throw CodeGenError(path + ": " + llvm::toString(input.takeError()));
+    }
+
+    // Resolve symbols the way the linker would: the first definition prevails, and only main,
+    // exported functions and the runtime's "__" hooks are referenced from outside, so the rest
+    // can be internalized. Codegen gives those of tuz's symbols default visibility.
+    std::vector<llvm::lto::SymbolResolution> resolutions;
+    for (const auto& symbol : (*input)->symbols()) {
+      llvm::lto::SymbolResolution resolution;
+      std::string name = symbol.getName().str();
+      if (!symbol.isUndefined()) {
+        resolution.Prevailing = defined.insert(name).second;
+        if (!resolution.Prevailing && !symbol.isWeak()) {
+          throw CodeGenError("duplicate symbol '" + name + "' in " + path);
+        }
+        resolution.FinalDefinitionInLinkageUnit = true;
+      }
+      bool is_exported = !symbol.isUndefined() &&
+                         symbol.getVisibility() == llvm::GlobalValue::DefaultVisibility;
+      resolution.VisibleToRegularObj = is_exported || name.rfind("__", 0) == 0;
+      resolutions.push_back(resolution);
+    }
+    if (auto error = lto.add(std::move(*input), resolutions)) {
+      throw CodeGenError(path + ": " + llvm::toString(std::move(error)));
+    }
+    buffers.push_back(std::move(*buffer));
+  }
+
+  // Every task writes its own slot, so the backends need no locking
+  size_t first = objects.size();
+  objects.resize(first + lto.getMaxTasks());
+  auto add_stream = [&](unsigned task, const llvm::Twine&)
+      -> llvm::Expected<std::unique_ptr<llvm::CachedFileStream>> {
+    int fd;
+    llvm::SmallString<128> path;
+    if (auto ec = llvm::sys::fs::createTemporaryFile("tuz", "o", fd, path)) {
+      return llvm::errorCodeToError(ec);
+    }
+    objects[first + task] = path.str().str();
+    return std::make_unique<llvm::CachedFileStream>(
+        std::make_unique<llvm::raw_fd_ostream>(fd, true));
+  };
+
+  // Backend outputs are keyed on the module, its imports and the configuration; a hit hands
+  // over the cached object instead of running the backend
+  llvm::FileCache cache;
+  std::mutex cache_error_mutex;
+  std::string cache_error;
+  if (!link_options.cache_dir.empty()) {
+    auto add_buffer = [&](unsigned task, const llvm::Twine& name,
+                          std::unique_ptr<llvm::MemoryBuffer> buffer) {
+      auto stream = add_stream(task, name);
+      if (!stream) {
+        std::lock_guard<std::mutex> lock(cache_error_mutex);
+        cache_error = llvm::toString(stream.takeError());
+        return;
+      }
+      *(*stream)->OS << buffer->getBuffer();
+    };
+    auto local = llvm::localCache("ThinLTO", "thinlto", link_options.cache_dir, add_buffer);
+    if (!local) {
+      throw CodeGenError("could not open cache " + link_options.cache_dir + ": " +
+                         llvm::toString(local.takeError()));
+    }
+    cache = std::move(*local);
+  }
+
+  if (auto error = lto.run(add_stream, cache)) {
+    throw CodeGenError("ThinLTO failed: " + llvm::toString(std::move(error)));
+  }
+  if (!cache_error.empty()) {
+    throw CodeGenError("could not write a cached ThinLTO object: " + cache_error);
+  }
+
+  // Tasks without a module, such as an empty regular LTO partition, produce no object
+  objects.erase(std::remove(objects.begin() + first, objects.end(), std::string()),
+                objects.end());
+}
+
+} // namespace tuz
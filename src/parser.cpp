@@ -1,12 +1,28 @@
 #include "tuz/parser.h"
 
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+
 namespace tuz {
 
-Parser::Parser(std::vector<Token> tokens) : tokens_(std::move(tokens)), position_(0) {
+Parser::Parser(std::vector<Token> tokens, std::shared_ptr<ASTContext> context)
+    : tokens_(std::move(tokens)),
+      context_(context ? std::move(context) : std::make_shared<ASTContext>()), position_(0) {
+  if (tokens_.empty() || !tokens_.back().is(TokenType::END_OF_FILE)) {
+    tokens_.emplace_back(TokenType::END_OF_FILE, "", 0, 0);
+  }
+}
+
+Parser::Parser(Lexer& lexer, std::shared_ptr<ASTContext> context)
+    : lexer_(&lexer), context_(context ? std::move(context) : std::make_shared<ASTContext>()),
+      position_(0) {
+  tokens_.assign(LookaheadCapacity, Token(TokenType::END_OF_FILE, "", 0, 0));
 }
 
 Program Parser::parse_program() {
   Program program;
+  program.context = context_;
 
   while (!is_at_end()) {
     program.declarations.push_back(parse_declaration());
@@ -23,14 +39,20 @@ DeclPtr Parser::parse_declaration() {
     if (match(TokenType::FN)) {
       return parse_function_decl();
     }
+    if (check(TokenType::EXPORT) || check(TokenType::INLINE)) {
+      return parse_qualified_function_decl();
+    }
     if (match(TokenType::STRUCT)) {
       return parse_struct_decl();
     }
     if (match(TokenType::LET)) {
       return parse_global_decl();
     }
+    if (check(TokenType::AT)) {
+      return parse_attributed_decl();
+    }
 
-    throw error("Expected declaration (extern, fn, struct, or let)");
+    throw error("Expected declaration (extern, export, fn, struct, or let)");
   } catch (const ParseError& e) {
     synchronize();
     throw;
@@ -61,8 +83,10 @@ DeclPtr Parser::parse_extern_decl() {
 
   expect(TokenType::SEMICOLON, "Expected ';' after extern function declaration");
 
-  return std::make_shared<FunctionDecl>(name, std::move(params), return_type, nullptr, true, line,
-                                        col);
+  auto* decl = context_->create<FunctionDecl>(name, std::move(params), return_type, nullptr, true,
+                                              line, col);
+  decl->symbol = intern(name);
+  return decl;
 }
 
 DeclPtr Parser::parse_function_decl() {
@@ -92,8 +116,24 @@ DeclPtr Parser::parse_function_decl() {
     body = parse_block_stmt();
   }
 
-  return std::make_shared<FunctionDecl>(name, std::move(params), return_type, std::move(body),
-                                        is_extern, line, col);
+  auto* decl = context_->create<FunctionDecl>(name, std::move(params), return_type,
+                                              std::move(body), is_extern, line, col);
+  decl->symbol = intern(name);
+  return decl;
+}
+
+// 'export' and 'inline' in front of 'fn', in that order
+DeclPtr Parser::parse_qualified_function_decl() {
+  bool is_export = match(TokenType::EXPORT);
+  bool is_inline = match(TokenType::INLINE);
+  expect(TokenType::FN, "Expected 'fn' after function qualifiers");
+
+  auto* decl = static_cast<FunctionDecl*>(parse_function_decl());
+  decl->is_export = is_export;
+  if (is_inline) {
+    decl->inline_hint = InlineHint::Inline;
+  }
+  return decl;
 }
 
 DeclPtr Parser::parse_struct_decl() {
@@ -107,7 +147,10 @@ DeclPtr Parser::parse_struct_decl() {
   std::vector<Field> fields = parse_field_list();
   expect(TokenType::RBRACE, "Expected '}' after struct fields");
 
-  return std::make_shared<StructDecl>(name, std::move(fields), line, col);
+  auto* decl = context_->create<StructDecl>(name, std::move(fields), line, col);
+  decl->symbol = intern(name);
+  decl->type = context_->struct_type(name);
+  return decl;
 }
 
 DeclPtr Parser::parse_global_decl() {
@@ -131,17 +174,173 @@ DeclPtr Parser::parse_global_decl() {
 
   expect(TokenType::SEMICOLON, "Expected ';' after global declaration");
 
-  return std::make_shared<GlobalDecl>(name, type, std::move(initializer), is_mutable, line, col);
+  auto* decl =
+      context_->create<GlobalDecl>(name, type, std::move(initializer), is_mutable, line, col);
+  decl->symbol = intern(name);
+  return decl;
+}
+
+// Attributes in front of a declaration: @noinline for functions, @soa for structs
+DeclPtr Parser::parse_attributed_decl() {
+  std::vector<Attribute> attributes = parse_attributes();
+  auto check_flag = [](const Attribute& attribute) {
+    if (!attribute.arguments.empty()) {
+      throw ParseError("Unexpected arguments in '@" + attribute.name + "'", attribute.line,
+                       attribute.column);
+    }
+  };
+
+  if (check(TokenType::FN) || check(TokenType::EXPORT) || check(TokenType::INLINE)) {
+    for (const auto& attribute : attributes) {
+      if (attribute.name != "noinline") {
+        throw ParseError("Unknown function attribute '@" + attribute.name + "'", attribute.line,
+                         attribute.column);
+      }
+      check_flag(attribute);
+    }
+    const Attribute& first = attributes.front();
+    auto* decl = static_cast<FunctionDecl*>(parse_qualified_function_decl());
+    if (decl->inline_hint == InlineHint::Inline) {
+      throw ParseError("'inline' conflicts with '@noinline'", first.line, first.column);
+    }
+    decl->inline_hint = InlineHint::NoInline;
+    return decl;
+  }
+
+  bool soa = false;
+  for (const auto& attribute : attributes) {
+    if (attribute.name != "soa") {
+      throw ParseError("Unknown struct attribute '@" + attribute.name + "'", attribute.line,
+                       attribute.column);
+    }
+    check_flag(attribute);
+    soa = true;
+  }
+
+  expect(TokenType::STRUCT, "Expected 'fn' or 'struct' after attributes");
+  auto* decl = static_cast<StructDecl*>(parse_struct_decl());
+  decl->soa = soa;
+  return decl;
+}
+
+// =============================================================================
+// Attributes
+// =============================================================================
+
+std::vector<Attribute> Parser::parse_attributes() {
+  std::vector<Attribute> attributes;
+  while (match(TokenType::AT)) {
+    Attribute attribute;
+    attribute.line = previous().line;
+    attribute.column = previous().column;
+    attribute.name = expect(TokenType::IDENTIFIER, "Expected attribute name after '@'").text;
+
+    if (match(TokenType::LPAREN)) {
+      auto argument_token = [&]() -> std::string {
+        if (!check(TokenType::IDENTIFIER) && !check(TokenType::INTEGER_LITERAL)) {
+          throw error("Expected attribute argument");
+        }
+        return std::string(advance().text);
+      };
+
+      if (!check(TokenType::RPAREN)) {
+        do {
+          Attribute::Argument argument;
+          bool is_name = check(TokenType::IDENTIFIER);
+          argument.value = argument_token();
+          if (is_name && match(TokenType::ASSIGN)) {
+            argument.key = std::move(argument.value);
+            argument.value = argument_token();
+          }
+          attribute.arguments.push_back(std::move(argument));
+        } while (match(TokenType::COMMA));
+      }
+      expect(TokenType::RPAREN, "Expected ')' after attribute arguments");
+    }
+    attributes.push_back(std::move(attribute));
+  }
+  return attributes;
+}
+
+LoopHints Parser::loop_hints(const std::vector<Attribute>& attributes) {
+  LoopHints hints;
+  for (const auto& attribute : attributes) {
+    auto fail = [&](const std::string& message) {
+      return ParseError(message + " in '@" + attribute.name + "'", attribute.line,
+                        attribute.column);
+    };
+    auto count = [&](const Attribute::Argument& argument) {
+      uint32_t value = 0;
+      const std::string& text = argument.value;
+      auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+      if (ec != std::errc() || ptr != text.data() + text.size() || value == 0) {
+        throw fail("Expected a positive count");
+      }
+      return value;
+    };
+
+    if (attribute.name == "vectorize") {
+      // A width or interleave count implies vectorization
+      hints.vectorize = true;
+      for (const auto& argument : attribute.arguments) {
+        if (argument.key == "width") {
+          hints.vectorize_width = count(argument);
+        } else if (argument.key == "interleave") {
+          hints.interleave_count = count(argument);
+        } else if (argument.key.empty() && argument.value == "disable") {
+          hints.vectorize = false;
+        } else {
+          throw fail("Unknown argument '" + argument.value + "'");
+        }
+      }
+    } else if (attribute.name == "unroll") {
+      hints.unroll = true;
+      if (attribute.arguments.size() > 1 ||
+          (!attribute.arguments.empty() && !attribute.arguments[0].key.empty())) {
+        throw fail("Expected a count, 'full' or 'disable'");
+      }
+      if (!attribute.arguments.empty()) {
+        const auto& argument = attribute.arguments[0];
+        if (argument.value == "full") {
+          hints.unroll_full = true;
+        } else if (argument.value == "disable") {
+          hints.unroll = false;
+        } else {
+          hints.unroll_count = count(argument);
+        }
+      }
+    } else if (attribute.name == "parallel") {
+      if (!attribute.arguments.empty()) {
+        throw fail("Unexpected arguments");
+      }
+      hints.parallel = true;
+    } else {
+      throw ParseError("Unknown loop attribute '@" + attribute.name + "'", attribute.line,
+                       attribute.column);
+    }
+  }
+  return hints;
 }
 
 // =============================================================================
 // Statements
 // =============================================================================
 
+std::vector<StmtPtr> Parser::parse_statements() {
+  std::vector<StmtPtr> statements;
+  while (!is_at_end()) {
+    statements.push_back(parse_statement());
+  }
+  return statements;
+}
+
 StmtPtr Parser::parse_statement() {
   if (check(TokenType::LBRACE)) {
     return parse_block_stmt();
   }
+  if (check(TokenType::AT)) {
+    return parse_attributed_stmt();
+  }
   if (match(TokenType::LET)) {
     return parse_let_stmt();
   }
@@ -157,6 +356,9 @@ StmtPtr Parser::parse_statement() {
   if (match(TokenType::RETURN)) {
     return parse_return_stmt();
   }
+  if (match(TokenType::BECOME)) {
+    return parse_become_stmt();
+  }
 
   return parse_assign_or_expr_stmt();
 }
@@ -177,7 +379,7 @@ StmtPtr Parser::parse_block_stmt() {
 
   expect(TokenType::RBRACE, "Expected '}' after block");
 
-  return std::make_shared<BlockStmt>(std::move(statements), line, col);
+  return context_->create<BlockStmt>(std::move(statements), line, col);
 }
 
 StmtPtr Parser::parse_let_stmt() {
@@ -201,7 +403,9 @@ StmtPtr Parser::parse_let_stmt() {
 
   expect(TokenType::SEMICOLON, "Expected ';' after let statement");
 
-  return std::make_shared<LetStmt>(name, type, std::move(initializer), is_mutable, line, col);
+  auto* stmt = context_->create<LetStmt>(name, type, std::move(initializer), is_mutable, line, col);
+  stmt->symbol = intern(name);
+  return stmt;
 }
 
 StmtPtr Parser::parse_assign_or_expr_stmt() {
@@ -213,11 +417,11 @@ StmtPtr Parser::parse_assign_or_expr_stmt() {
   if (match(TokenType::ASSIGN)) {
     ExprPtr value = parse_expression();
     expect(TokenType::SEMICOLON, "Expected ';' after assignment");
-    return std::make_shared<AssignStmt>(std::move(expr), std::move(value), line, col);
+    return context_->create<AssignStmt>(std::move(expr), std::move(value), line, col);
   }
 
   expect(TokenType::SEMICOLON, "Expected ';' after expression");
-  return std::make_shared<ExprStmt>(std::move(expr), line, col);
+  return context_->create<ExprStmt>(std::move(expr), line, col);
 }
 
 StmtPtr Parser::parse_if_stmt() {
@@ -232,7 +436,7 @@ StmtPtr Parser::parse_if_stmt() {
     else_branch = parse_statement();
   }
 
-  return std::make_shared<IfStmt>(std::move(condition), std::move(then_branch),
+  return context_->create<IfStmt>(std::move(condition), std::move(then_branch),
                                   std::move(else_branch), line, col);
 }
 
@@ -243,7 +447,7 @@ StmtPtr Parser::parse_while_stmt() {
   ExprPtr condition = parse_expression();
   StmtPtr body = parse_statement();
 
-  return std::make_shared<WhileStmt>(std::move(condition), std::move(body), line, col);
+  return context_->create<WhileStmt>(std::move(condition), std::move(body), line, col);
 }
 
 StmtPtr Parser::parse_for_stmt() {
@@ -261,8 +465,27 @@ StmtPtr Parser::parse_for_stmt() {
 
   StmtPtr body = parse_statement();
 
-  return std::make_shared<ForStmt>(var_name, std::move(range_start), std::move(range_end),
-                                   std::move(body), line, col);
+  auto* stmt = context_->create<ForStmt>(var_name, std::move(range_start), std::move(range_end),
+                                         std::move(body), line, col);
+  stmt->var_symbol = intern(var_name);
+  return stmt;
+}
+
+// Loop hints in front of a for or while loop
+StmtPtr Parser::parse_attributed_stmt() {
+  LoopHints hints = loop_hints(parse_attributes());
+
+  if (match(TokenType::FOR)) {
+    auto* stmt = static_cast<ForStmt*>(parse_for_stmt());
+    stmt->hints = hints;
+    return stmt;
+  }
+  if (match(TokenType::WHILE)) {
+    auto* stmt = static_cast<WhileStmt*>(parse_while_stmt());
+    stmt->hints = hints;
+    return stmt;
+  }
+  throw error("Expected 'for' or 'while' after loop attributes");
 }
 
 StmtPtr Parser::parse_return_stmt() {
@@ -276,7 +499,22 @@ StmtPtr Parser::parse_return_stmt() {
 
   expect(TokenType::SEMICOLON, "Expected ';' after return");
 
-  return std::make_shared<ReturnStmt>(std::move(value), line, col);
+  return context_->create<ReturnStmt>(std::move(value), line, col);
+}
+
+StmtPtr Parser::parse_become_stmt() {
+  uint32_t line = previous().line;
+  uint32_t col = previous().column;
+
+  ExprPtr value = parse_expression();
+  if (value->kind != ExprKind::Call) {
+    throw ParseError("Expected a function call after 'become'", value->line, value->column);
+  }
+  expect(TokenType::SEMICOLON, "Expected ';' after become");
+
+  auto* stmt = context_->create<ReturnStmt>(std::move(value), line, col);
+  stmt->is_tail_call = true;
+  return stmt;
 }
 
 // =============================================================================
@@ -300,7 +538,7 @@ ExprPtr Parser::parse_or() {
     uint32_t col = previous().column;
     ExprPtr right = parse_and();
     expr =
-        std::make_shared<BinaryOpExpr>(BinaryOp::Or, std::move(expr), std::move(right), line, col);
+        context_->create<BinaryOpExpr>(BinaryOp::Or, std::move(expr), std::move(right), line, col);
   }
 
   return expr;
@@ -314,7 +552,7 @@ ExprPtr Parser::parse_and() {
     uint32_t col = previous().column;
     ExprPtr right = parse_equality();
     expr =
-        std::make_shared<BinaryOpExpr>(BinaryOp::And, std::move(expr), std::move(right), line, col);
+        context_->create<BinaryOpExpr>(BinaryOp::And, std::move(expr), std::move(right), line, col);
   }
 
   return expr;
@@ -329,11 +567,11 @@ ExprPtr Parser::parse_equality() {
 
     if (match(TokenType::EQ)) {
       ExprPtr right = parse_comparison();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Eq, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Eq, std::move(expr), std::move(right), line,
                                             col);
     } else if (match(TokenType::NEQ)) {
       ExprPtr right = parse_comparison();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Neq, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Neq, std::move(expr), std::move(right), line,
                                             col);
     } else {
       break;
@@ -352,19 +590,19 @@ ExprPtr Parser::parse_comparison() {
 
     if (match(TokenType::LT)) {
       ExprPtr right = parse_term();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Lt, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Lt, std::move(expr), std::move(right), line,
                                             col);
     } else if (match(TokenType::GT)) {
       ExprPtr right = parse_term();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Gt, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Gt, std::move(expr), std::move(right), line,
                                             col);
     } else if (match(TokenType::LEQ)) {
       ExprPtr right = parse_term();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Leq, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Leq, std::move(expr), std::move(right), line,
                                             col);
     } else if (match(TokenType::GEQ)) {
       ExprPtr right = parse_term();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Geq, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Geq, std::move(expr), std::move(right), line,
                                             col);
     } else {
       break;
@@ -383,11 +621,11 @@ ExprPtr Parser::parse_term() {
 
     if (match(TokenType::PLUS)) {
       ExprPtr right = parse_factor();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Add, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Add, std::move(expr), std::move(right), line,
                                             col);
     } else if (match(TokenType::MINUS)) {
       ExprPtr right = parse_factor();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Sub, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Sub, std::move(expr), std::move(right), line,
                                             col);
     } else {
       break;
@@ -406,15 +644,15 @@ ExprPtr Parser::parse_factor() {
 
     if (match(TokenType::STAR)) {
       ExprPtr right = parse_unary();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Mul, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Mul, std::move(expr), std::move(right), line,
                                             col);
     } else if (match(TokenType::SLASH)) {
       ExprPtr right = parse_unary();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Div, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Div, std::move(expr), std::move(right), line,
                                             col);
     } else if (match(TokenType::PERCENT)) {
       ExprPtr right = parse_unary();
-      expr = std::make_shared<BinaryOpExpr>(BinaryOp::Mod, std::move(expr), std::move(right), line,
+      expr = context_->create<BinaryOpExpr>(BinaryOp::Mod, std::move(expr), std::move(right), line,
                                             col);
     } else {
       break;
@@ -430,22 +668,22 @@ ExprPtr Parser::parse_unary() {
 
   if (match(TokenType::NOT)) {
     ExprPtr operand = parse_unary();
-    return std::make_shared<UnaryOpExpr>(UnaryOp::Not, std::move(operand), line, col);
+    return context_->create<UnaryOpExpr>(UnaryOp::Not, std::move(operand), line, col);
   }
 
   if (match(TokenType::MINUS)) {
     ExprPtr operand = parse_unary();
-    return std::make_shared<UnaryOpExpr>(UnaryOp::Neg, std::move(operand), line, col);
+    return context_->create<UnaryOpExpr>(UnaryOp::Neg, std::move(operand), line, col);
   }
 
   if (match(TokenType::AMPERSAND)) {
     ExprPtr operand = parse_unary();
-    return std::make_shared<UnaryOpExpr>(UnaryOp::AddrOf, std::move(operand), line, col);
+    return context_->create<UnaryOpExpr>(UnaryOp::AddrOf, std::move(operand), line, col);
   }
 
   if (match(TokenType::STAR)) {
     ExprPtr operand = parse_unary();
-    return std::make_shared<UnaryOpExpr>(UnaryOp::Deref, std::move(operand), line, col);
+    return context_->create<UnaryOpExpr>(UnaryOp::Deref, std::move(operand), line, col);
   }
 
   return parse_postfix();
@@ -462,17 +700,17 @@ ExprPtr Parser::parse_postfix() {
       // Function call
       std::vector<ExprPtr> args = parse_arg_list();
       expect(TokenType::RPAREN, "Expected ')' after arguments");
-      expr = std::make_shared<CallExpr>(std::move(expr), std::move(args), line, col);
+      expr = context_->create<CallExpr>(std::move(expr), std::move(args), line, col);
     } else if (match(TokenType::LBRACKET)) {
       // Array index
       ExprPtr index = parse_expression();
       expect(TokenType::RBRACKET, "Expected ']' after index");
-      expr = std::make_shared<IndexExpr>(std::move(expr), std::move(index), line, col);
+      expr = context_->create<IndexExpr>(std::move(expr), std::move(index), line, col);
     } else if (match(TokenType::DOT)) {
       // Field access
       Token& field_token = expect(TokenType::IDENTIFIER, "Expected field name");
       std::string field_name(field_token.text);
-      expr = std::make_shared<FieldAccessExpr>(std::move(expr), field_name, line, col);
+      expr = context_->create<FieldAccessExpr>(std::move(expr), field_name, line, col);
     } else {
       break;
     }
@@ -486,29 +724,39 @@ ExprPtr Parser::parse_primary() {
   uint32_t col = current().column;
 
   if (match(TokenType::INTEGER_LITERAL)) {
-    int64_t value = std::stoll(std::string(previous().text));
-    return std::make_shared<IntegerLiteralExpr>(value, line, col);
+    auto text = previous().text;
+    int64_t value = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc())
+      throw error(previous(), "Invalid integer literal");
+    return context_->create<IntegerLiteralExpr>(value, line, col);
   }
 
   if (match(TokenType::FLOAT_LITERAL)) {
-    double value = std::stod(std::string(previous().text));
-    return std::make_shared<FloatLiteralExpr>(value, line, col);
+    auto text = previous().text;
+    double value = 0.0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc())
+      throw error(previous(), "Invalid float literal");
+    return context_->create<FloatLiteralExpr>(value, line, col);
   }
 
   if (match(TokenType::TRUE)) {
-    return std::make_shared<BoolLiteralExpr>(true, line, col);
+    return context_->create<BoolLiteralExpr>(true, line, col);
   }
 
   if (match(TokenType::FALSE)) {
-    return std::make_shared<BoolLiteralExpr>(false, line, col);
+    return context_->create<BoolLiteralExpr>(false, line, col);
   }
 
   if (match(TokenType::STRING_LITERAL)) {
-    return std::make_shared<StringLiteralExpr>(std::string(previous().text), line, col);
+    return context_->create<StringLiteralExpr>(std::string(previous().text), line, col);
   }
 
   if (match(TokenType::IDENTIFIER)) {
-    return std::make_shared<VariableExpr>(std::string(previous().text), line, col);
+    auto* expr = context_->create<VariableExpr>(std::string(previous().text), line, col);
+    expr->symbol = intern(previous().text);
+    return expr;
   }
 
   if (match(TokenType::LPAREN)) {
@@ -534,7 +782,20 @@ TypePtr Parser::parse_type() {
 
   TypePtr base_type = nullptr;
 
-  if (match(TokenType::INT)) {
+  if (match(TokenType::LBRACKET)) {
+    // Fixed-size array: [T; N]
+    TypePtr element = parse_type();
+    expect(TokenType::SEMICOLON, "Expected ';' after array element type");
+    Token& size_token = expect(TokenType::INTEGER_LITERAL, "Expected array length");
+    auto text = size_token.text;
+    size_t size = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), size);
+    if (ec != std::errc() || size == 0) {
+      throw error(size_token, "Expected a positive array length");
+    }
+    expect(TokenType::RBRACKET, "Expected ']' after array length");
+    base_type = ArrayType::get(element, size);
+  } else if (match(TokenType::INT)) {
     base_type = get_int32_type();
   } else if (match(TokenType::I8)) {
     base_type = get_int8_type();
@@ -563,11 +824,13 @@ TypePtr Parser::parse_type() {
   } else if (match(TokenType::VOID)) {
     base_type = get_void_type();
   } else if (match(TokenType::IDENTIFIER)) {
-    // Could be a struct type
+    // A vector type such as f32x4, a scalar alias such as double, or a struct type, which may
+    // be declared further down
     std::string name(previous().text);
-    // For now, return int32 as placeholder for struct types
-    // In a full implementation, we'd look up the struct in a symbol table
-    base_type = get_int32_type();
+    base_type = tuz::parse_type(name);
+    if (!base_type) {
+      base_type = context_->struct_type(name);
+    }
   } else {
     throw error("Expected type");
   }
@@ -590,6 +853,7 @@ std::vector<Param> Parser::parse_param_list() {
       expect(TokenType::COLON, "Expected ':' after parameter name");
       TypePtr type = parse_type();
       params.emplace_back(name, type);
+      params.back().symbol = intern(name);
     } while (match(TokenType::COMMA));
   }
 
@@ -628,20 +892,35 @@ std::vector<Field> Parser::parse_field_list() {
 // Helpers
 // =============================================================================
 
+Token& Parser::token_at(size_t index) {
+  // Reads past the end keep returning the EOF token
+  if (!lexer_) {
+    return tokens_[std::min(index, tokens_.size() - 1)];
+  }
+
+  while (filled_ <= index && !lexed_eof_) {
+    auto& slot = tokens_[filled_ & (LookaheadCapacity - 1)];
+    slot = lexer_->next_token();
+    lexed_eof_ = slot.is(TokenType::END_OF_FILE);
+    filled_++;
+  }
+
+  index = std::min(index, filled_ - 1);
+  assert(index + LookaheadCapacity >= filled_ && "token fell out of the lookahead window");
+  return tokens_[index & (LookaheadCapacity - 1)];
+}
+
 Token& Parser::current() {
-  return tokens_[position_];
+  return token_at(position_);
 }
 
 Token& Parser::peek(size_t offset) {
-  size_t idx = position_ + offset;
-  if (idx >= tokens_.size()) {
-    return tokens_.back();
-  }
-  return tokens_[idx];
+  assert(offset + 2 <= LookaheadCapacity && "peek beyond the lookahead window");
+  return token_at(position_ + offset);
 }
 
 Token& Parser::previous() {
-  return tokens_[position_ - 1];
+  return token_at(position_ - 1);
 }
 
 bool Parser::is_at_end() {
@@ -683,6 +962,10 @@ bool Parser::check(TokenType type) {
   return current().type == type;
 }
 
+Symbol Parser::intern(std::string_view name) {
+  return context_->symbols().intern(name);
+}
+
 ParseError Parser::error(const std::string& message) {
   return ParseError(message, current().line, current().column);
 }
@@ -705,6 +988,7 @@ void Parser::synchronize() {
     case TokenType::IF:
     case TokenType::WHILE:
     case TokenType::RETURN:
+    case TokenType::BECOME:
     case TokenType::STRUCT:
       return;
     default:
@@ -0,0 +1,293 @@
+#include "tuz/repl.h"
+
+#include "tuz/consteval.h"
+#include "tuz/diagnostic.h"
+#include "tuz/lexer.h"
+#include "tuz/parser.h"
+#include "tuz/resolver.h"
+
+#include <cstdint>
+#include <istream>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <ostream>
+#include <sstream>
+#include <utility>
+
+namespace tuz {
+
+// =============================================================================
+// Inputs
+// =============================================================================
+
+// Whether an input declares something rather than running statements: its first token after
+// any attributes starts a top-level declaration. A let on its own declares a global, so it
+// lives on in later inputs; one followed by further statements is a local of those.
+static bool is_declaration(const std::vector<Token>& tokens) {
+  size_t i = 0;
+  while (i + 1 < tokens.size() && tokens[i].is(TokenType::AT)) {
+    i += 2; // '@' and the attribute name
+    if (i < tokens.size() && tokens[i].is(TokenType::LPAREN)) {
+      while (i < tokens.size() && !tokens[i].is(TokenType::RPAREN)) {
+        ++i;
+      }
+      ++i;
+    }
+  }
+  if (i >= tokens.size()) {
+    return false;
+  }
+  if (tokens[i].is(TokenType::LET)) {
+    // The let ends at the first semicolon outside brackets; only the end of input may follow
+    int depth = 0;
+    for (; i < tokens.size(); ++i) {
+      if (tokens[i].is_one_of(TokenType::LPAREN, TokenType::LBRACE, TokenType::LBRACKET)) {
+        ++depth;
+      } else if (tokens[i].is_one_of(TokenType::RPAREN, TokenType::RBRACE, TokenType::RBRACKET)) {
+        --depth;
+      } else if (depth == 0 && tokens[i].is(TokenType::SEMICOLON)) {
+        break;
+      }
+    }
+    return i + 1 >= tokens.size() || tokens[i + 1].is(TokenType::END_OF_FILE);
+  }
+  return tokens[i].is_one_of(TokenType::FN, TokenType::STRUCT, TokenType::EXTERN,
+                             TokenType::EXPORT, TokenType::INLINE);
+}
+
+// Brackets opened and not yet closed in text
+static int open_brackets(std::string_view text) {
+  Lexer lexer(text);
+  int depth = 0;
+  for (const Token& token : lexer.tokenize()) {
+    if (token.is_one_of(TokenType::LPAREN, TokenType::LBRACE, TokenType::LBRACKET)) {
+      ++depth;
+    } else if (token.is_one_of(TokenType::RPAREN, TokenType::RBRACE, TokenType::RBRACKET)) {
+      --depth;
+    }
+  }
+  return depth;
+}
+
+// =============================================================================
+// Results
+// =============================================================================
+
+static bool is_printable(const Type& type) {
+  return type.is_integer() || type.is_floating_point() || type.is_boolean() || type.is_pointer();
+}
+
+template <typename T> static T call(void* address) {
+  return reinterpret_cast<T (*)()>(address)();
+}
+
+// Run the wrapper of an input, returning its value as text
+static std::string run_wrapper(const Type& type, void* address) {
+  std::ostringstream text;
+  switch (type.kind) {
+  case TypeKind::Int8:
+    text << static_cast<int>(call<int8_t>(address));
+    break;
+  case TypeKind::Int16:
+    text << call<int16_t>(address);
+    break;
+  case TypeKind::Int32:
+    text << call<int32_t>(address);
+    break;
+  case TypeKind::Int64:
+    text << call<int64_t>(address);
+    break;
+  case TypeKind::UInt8:
+    text << static_cast<unsigned>(call<uint8_t>(address));
+    break;
+  case TypeKind::UInt16:
+    text << call<uint16_t>(address);
+    break;
+  case TypeKind::UInt32:
+    text << call<uint32_t>(address);
+    break;
+  case TypeKind::UInt64:
+    text << call<uint64_t>(address);
+    break;
+  case TypeKind::Float32:
+    text << call<float>(address);
+    break;
+  case TypeKind::Float64:
+    text << call<double>(address);
+    break;
+  case TypeKind::Bool:
+    text << (call<bool>(address) ? "true" : "false");
+    break;
+  case TypeKind::Pointer:
+    text << call<void*>(address);
+    break;
+  default:
+    call<void>(address);
+    break;
+  }
+  return text.str();
+}
+
+// =============================================================================
+// REPL
+// =============================================================================
+
+Repl::Repl(CodeGenOptions options)
+    : options_(std::move(options)), ast_(std::make_shared<ASTContext>()),
+      resolver_(std::make_unique<Resolver>(ast_->symbols())),
+      constants_(std::make_shared<ConstEvaluator>(std::vector<GlobalDecl*>{},
+                                                  std::vector<FunctionDecl*>{})),
+      context_(std::make_unique<llvm::orc::ThreadSafeContext>(
+          std::make_unique<llvm::LLVMContext>())) {
+  program_.context = ast_;
+}
+
+Repl::~Repl() = default;
+
+std::string Repl::evaluate(std::string_view input) {
+  // The AST copies what it keeps of the text, so the input need not outlive this call
+  Lexer lexer(input);
+  std::vector<Token> tokens = lexer.tokenize();
+  if (tokens.size() <= 1) {
+    return {};
+  }
+
+  size_t first_new = program_.declarations.size();
+  try {
+    if (is_declaration(tokens)) {
+      Parser parser(std::move(tokens), ast_);
+      Program parsed = parser.parse_program();
+      program_.declarations.insert(program_.declarations.end(), parsed.declarations.begin(),
+                                   parsed.declarations.end());
+      resolver_->resolve(program_, first_new);
+      add_module(first_new);
+      return {};
+    }
+
+    // A trailing expression may leave out its semicolon
+    const Token& last = tokens[tokens.size() - 2];
+    if (!last.is_one_of(TokenType::SEMICOLON, TokenType::RBRACE)) {
+      tokens.insert(tokens.end() - 1, Token(TokenType::SEMICOLON, ";", last.line, last.column));
+    }
+
+    // Statements run in a function of their own, called once
+    Parser parser(std::move(tokens), ast_);
+    std::vector<StmtPtr> statements = parser.parse_statements();
+    std::string name = "__repl_" + std::to_string(evaluated_++);
+    auto* body = ast_->create<BlockStmt>(std::move(statements), 1, 1);
+    auto* wrapper = ast_->create<FunctionDecl>(name, std::vector<Param>{}, get_void_type(), body,
+                                               false, 1, 1);
+    wrapper->symbol = ast_->symbols().intern(name);
+    program_.declarations.push_back(wrapper);
+    resolver_->resolve(program_, first_new);
+
+    // The wrapper returns the value of a trailing expression, whose type is known only now.
+    // Returning a value of the function's own type needs no further checks.
+    if (!body->statements.empty() && body->statements.back()->kind == StmtKind::Expr) {
+      StmtPtr& stmt = body->statements.back();
+      ExprPtr value = static_cast<ExprStmt&>(*stmt).expr;
+      if (is_printable(*value->type)) {
+        stmt = ast_->create<ReturnStmt>(value, stmt->line, stmt->column);
+        wrapper->return_type = value->type;
+      }
+    }
+
+    add_module(first_new);
+    void* address = lookup(name);
+    // Nothing can call the wrapper again, so later inputs need not declare it
+    resolver_->forget(program_, first_new);
+    program_.declarations.pop_back();
+    return run_wrapper(*wrapper->return_type, address);
+  } catch (...) {
+    resolver_->forget(program_, first_new);
+    program_.declarations.resize(first_new);
+    throw;
+  }
+}
+
+void Repl::add_module(size_t first_new) {
+  CodeGenOptions options = options_;
+  options.incremental = true;
+  options.first_new_declaration = first_new;
+
+  std::unique_ptr<llvm::Module> module;
+  {
+    auto lock = context_->getLock();
+    CodeGenerator codegen(options, *context_->getContext());
+    codegen.share_constants(constants_);
+    codegen.generate(program_);
+    codegen.optimize();
+    module = codegen.get_module();
+  }
+
+  if (!jit_) {
+    llvm::orc::LLLazyJITBuilder builder;
+    configure_jit(builder, options_);
+    auto jit = builder.create();
+    if (!jit) {
+      throw CodeGenError("could not create JIT: " + llvm::toString(jit.takeError()));
+    }
+    jit_ = std::move(*jit);
+
+    // Resolve extern functions (puts, malloc, ...) against the host process
+    auto process_symbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        jit_->getDataLayout().getGlobalPrefix());
+    if (!process_symbols) {
+      throw CodeGenError(llvm::toString(process_symbols.takeError()));
+    }
+    jit_->getMainJITDylib().addGenerator(std::move(*process_symbols));
+  }
+
+  // Function bodies are compiled when first called, so inputs that only declare cost no codegen
+  llvm::orc::ThreadSafeModule lazy_module(std::move(module), *context_);
+  if (auto err = jit_->addLazyIRModule(std::move(lazy_module))) {
+    throw CodeGenError(llvm::toString(std::move(err)));
+  }
+}
+
+void* Repl::lookup(const std::string& name) {
+  auto symbol = jit_->lookup(name);
+  if (!symbol) {
+    throw CodeGenError(llvm::toString(symbol.takeError()));
+  }
+  return symbol->toPtr<void*>();
+}
+
+int Repl::run(std::istream& in, std::ostream& out, std::ostream& err) {
+  std::string input;
+  std::string line;
+  out << "tuz> " << std::flush;
+  while (std::getline(in, line)) {
+    if (input.empty() && (line == ":quit" || line == ":q")) {
+      break;
+    }
+    input += line;
+    input += '\n';
+    if (open_brackets(input) > 0) {
+      out << "...> " << std::flush;
+      continue;
+    }
+
+    try {
+      std::string value = evaluate(input);
+      if (!value.empty()) {
+        out << value << std::endl;
+      }
+    } catch (const ParseError& e) {
+      err << e.line << ":" << e.column << ": error: " << e.what() << std::endl;
+    } catch (const CodeGenError& e) {
+      if (e.has_location()) {
+        err << e.location().line << ":" << e.location().column << ": ";
+      }
+      err << "error: " << e.what() << std::endl;
+    }
+    input.clear();
+    out << "tuz> " << std::flush;
+  }
+  return 0;
+}
+
+} // namespace tuz
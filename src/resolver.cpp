@@ -0,0 +1,797 @@
+#include "tuz/resolver.h"
+
+#include "tuz/diagnostic.h"
+
+#include <algorithm>
+
+namespace tuz {
+
+static SourceLocation location_of(const VariableExpr& expr) {
+  return SourceLocation(expr.line, expr.column, static_cast<uint32_t>(expr.name.length()));
+}
+
+static bool is_aggregate(const TypePtr& type) {
+  return type->is_struct() || type->is_array();
+}
+
+// Types that convert only to themselves: no lane or field conversions exist
+static bool needs_exact_type(const TypePtr& type) {
+  return is_aggregate(type) || type->is_vector();
+}
+
+// Whether a place lies in the current function's frame: a local, or a field or element of one
+static bool is_local_place(const Expr& expr) {
+  switch (expr.kind) {
+  case ExprKind::Variable:
+    return static_cast<const VariableExpr&>(expr).binding.kind == BindingKind::Local;
+  case ExprKind::FieldAccess: {
+    const auto& access = static_cast<const FieldAccessExpr&>(expr);
+    return !access.object->type->is_pointer() && is_local_place(*access.object);
+  }
+  case ExprKind::Index: {
+    const auto& index = static_cast<const IndexExpr&>(expr);
+    return !index.array->type->is_pointer() && is_local_place(*index.array);
+  }
+  default:
+    return false;
+  }
+}
+
+Resolver::Resolver(SymbolTable& symbols) : symbols_(symbols) {
+}
+
+void Resolver::resolve(Program& program) {
+  undo_log_.clear();
+  scope_marks_.clear();
+  functions_.clear();
+  globals_.clear();
+  variables_.assign(symbols_.size(), {});
+  function_symbols_.assign(symbols_.size(), nullptr);
+  struct_symbols_.assign(symbols_.size(), nullptr);
+  resolve(program, 0);
+}
+
+void Resolver::resolve(Program& program, size_t first_new) {
+  // Symbols interned since the last call have no binding yet
+  variables_.resize(symbols_.size());
+  function_symbols_.resize(symbols_.size(), nullptr);
+  struct_symbols_.resize(symbols_.size(), nullptr);
+  try {
+    std::vector<StructDecl*> structs;
+    std::vector<GlobalDecl*> globals;
+    std::vector<FunctionDecl*> functions;
+
+    // Top-level names are visible everywhere, regardless of declaration order
+    for (size_t i = first_new; i < program.declarations.size(); ++i) {
+      Decl* decl = program.declarations[i];
+      if (decl->kind == DeclKind::Function) {
+        auto& fn = static_cast<FunctionDecl&>(*decl);
+        if (function_symbols_[fn.symbol]) {
+          throw CodeGenError("redefinition of function '" + fn.name + "'",
+                             SourceLocation(fn.line, fn.column));
+        }
+        fn.index = static_cast<uint32_t>(functions_.size());
+        functions_.push_back(&fn);
+        functions.push_back(&fn);
+        function_symbols_[fn.symbol] = &fn;
+      } else if (decl->kind == DeclKind::Global) {
+        auto& global = static_cast<GlobalDecl&>(*decl);
+        if (variables_[global.symbol].binding.kind == BindingKind::Global) {
+          throw CodeGenError("redefinition of global '" + global.name + "'",
+                             SourceLocation(global.line, global.column));
+        }
+        global.index = static_cast<uint32_t>(globals_.size());
+        globals_.push_back(&global);
+        globals.push_back(&global);
+        variables_[global.symbol] = {{BindingKind::Global, global.index}, global.type,
+                                     global.is_mutable};
+      } else if (decl->kind == DeclKind::Struct) {
+        // Fields are filled in up front, so every use of the type sees them
+        auto& st = static_cast<StructDecl&>(*decl);
+        if (struct_symbols_[st.symbol]) {
+          throw CodeGenError("redefinition of struct '" + st.name + "'",
+                             SourceLocation(st.line, st.column));
+        }
+        struct_symbols_[st.symbol] = &st;
+        structs.push_back(&st);
+        if (!st.type) {
+          st.type = program.context->struct_type(st.name);
+        }
+        std::vector<std::pair<std::string, TypePtr>> fields;
+        for (const auto& field : st.fields) {
+          fields.emplace_back(field.name, field.type);
+        }
+        st.type->define(std::move(fields), st.soa);
+      }
+    }
+
+    for (auto* st : structs) {
+      visit(*st);
+    }
+
+    // Globals first, so function bodies see their inferred types
+    for (auto* global : globals) {
+      visit(*global);
+    }
+    for (auto* fn : functions) {
+      visit(*fn);
+    }
+  } catch (...) {
+    // Leave the scopes the error was thrown in, then drop the new top-level names
+    while (!scope_marks_.empty()) {
+      exit_scope();
+    }
+    forget(program, first_new);
+    throw;
+  }
+
+  program.is_resolved = true;
+}
+
+void Resolver::forget(const Program& program, size_t first) {
+  // Backwards, so each function and global dropped is the last one numbered
+  for (size_t i = program.declarations.size(); i-- > first;) {
+    const Decl* decl = program.declarations[i];
+    if (decl->kind == DeclKind::Function) {
+      const auto& fn = static_cast<const FunctionDecl&>(*decl);
+      if (fn.symbol < function_symbols_.size() && function_symbols_[fn.symbol] == &fn) {
+        function_symbols_[fn.symbol] = nullptr;
+        functions_.resize(fn.index);
+      }
+    } else if (decl->kind == DeclKind::Global) {
+      const auto& global = static_cast<const GlobalDecl&>(*decl);
+      if (global.index < globals_.size() && globals_[global.index] == &global) {
+        variables_[global.symbol] = {};
+        globals_.resize(global.index);
+      }
+    } else if (decl->kind == DeclKind::Struct) {
+      const auto& st = static_cast<const StructDecl&>(*decl);
+      if (st.symbol < struct_symbols_.size() && struct_symbols_[st.symbol] == &st) {
+        struct_symbols_[st.symbol] = nullptr;
+      }
+    }
+  }
+}
+
+// =============================================================================
+// Scopes
+// =============================================================================
+
+void Resolver::enter_scope() {
+  scope_marks_.push_back(undo_log_.size());
+}
+
+void Resolver::exit_scope() {
+  size_t mark = scope_marks_.back();
+  scope_marks_.pop_back();
+  while (undo_log_.size() > mark) {
+    auto& entry = undo_log_.back();
+    variables_[entry.symbol] = std::move(entry.previous);
+    undo_log_.pop_back();
+  }
+}
+
+uint32_t Resolver::bind_local(Symbol symbol, TypePtr type, bool is_mutable) {
+  uint32_t slot = current_function_->local_count++;
+  undo_log_.push_back({symbol, std::move(variables_[symbol])});
+  variables_[symbol] = {{BindingKind::Local, slot}, std::move(type), is_mutable};
+  return slot;
+}
+
+const Resolver::VariableBinding& Resolver::lookup_variable(const VariableExpr& expr) {
+  if (expr.symbol >= variables_.size() ||
+      variables_[expr.symbol].binding.kind == BindingKind::Unresolved) {
+    throw CodeGenError("unknown variable: '" + expr.name + "'", location_of(expr));
+  }
+  return variables_[expr.symbol];
+}
+
+void Resolver::resolve_expr(Expr& expr) {
+  visit_expr(*this, expr);
+}
+
+void Resolver::resolve_stmt(Stmt& stmt) {
+  visit_stmt(*this, stmt);
+}
+
+// =============================================================================
+// Type checks
+// =============================================================================
+
+void Resolver::require_defined(const TypePtr& type, uint32_t line, uint32_t column) {
+  const Type* base = type.get();
+  while (base->is_pointer() || base->is_array()) {
+    base = base->is_pointer() ? static_cast<const PointerType*>(base)->pointee.get()
+                              : static_cast<const ArrayType*>(base)->element_type.get();
+  }
+  if (base->is_struct() && !static_cast<const StructType*>(base)->is_defined) {
+    throw CodeGenError("unknown type '" + static_cast<const StructType*>(base)->name + "'",
+                       SourceLocation(line, column));
+  }
+}
+
+void Resolver::check_conversion(const TypePtr& from, const TypePtr& to, uint32_t line,
+                                uint32_t column) {
+  if ((needs_exact_type(from) || needs_exact_type(to)) && !from->equals(*to)) {
+    throw CodeGenError("cannot convert '" + from->to_string() + "' to '" + to->to_string() + "'",
+                       SourceLocation(line, column));
+  }
+}
+
+// A struct cannot hold itself by value, directly or through the structs and arrays it holds
+void Resolver::check_recursion(const Type& type, const StructDecl& decl,
+                               std::vector<const StructType*>& open) {
+  if (type.is_array()) {
+    check_recursion(*static_cast<const ArrayType&>(type).element_type, decl, open);
+    return;
+  }
+  if (!type.is_struct()) {
+    return;
+  }
+  const auto& st = static_cast<const StructType&>(type);
+  if (std::find(open.begin(), open.end(), &st) != open.end()) {
+    throw CodeGenError("struct '" + st.name + "' contains itself",
+                       SourceLocation(decl.line, decl.column));
+  }
+  open.push_back(&st);
+  for (const auto& field : st.fields) {
+    check_recursion(*field.second, decl, open);
+  }
+  open.pop_back();
+}
+
+// Writes go through a pointer, or into a mutable variable or a part of one
+void Resolver::check_assignable(const Expr& target, const Stmt& stmt) {
+  const Expr* place = &target;
+  while (true) {
+    switch (place->kind) {
+    case ExprKind::Variable: {
+      auto& var = static_cast<const VariableExpr&>(*place);
+      if (!lookup_variable(var).is_mutable) {
+        throw CodeGenError("cannot assign to immutable variable '" + var.name + "'",
+                           location_of(var));
+      }
+      return;
+    }
+    case ExprKind::Index: {
+      auto& index = static_cast<const IndexExpr&>(*place);
+      if (index.array->type->is_pointer()) {
+        return;
+      }
+      place = index.array;
+      break;
+    }
+    case ExprKind::FieldAccess: {
+      auto& field = static_cast<const FieldAccessExpr&>(*place);
+      if (field.object->type->is_pointer()) {
+        return;
+      }
+      place = field.object;
+      break;
+    }
+    case ExprKind::UnaryOp:
+      if (static_cast<const UnaryOpExpr&>(*place).op == UnaryOp::Deref) {
+        return;
+      }
+      [[fallthrough]];
+    default:
+      throw CodeGenError("cannot assign to this expression",
+                         SourceLocation(stmt.line, stmt.column));
+    }
+  }
+}
+
+// =============================================================================
+// Expressions
+// =============================================================================
+
+void Resolver::visit(IntegerLiteralExpr& expr) {
+  if (!expr.type)
+    expr.type = get_int32_type();
+}
+
+void Resolver::visit(FloatLiteralExpr& expr) {
+  if (!expr.type)
+    expr.type = get_float64_type();
+}
+
+void Resolver::visit(BoolLiteralExpr& expr) {
+  expr.type = get_bool_type();
+}
+
+void Resolver::visit(StringLiteralExpr& expr) {
+  expr.type = PointerType::get(get_uint8_type());
+}
+
+void Resolver::visit(VariableExpr& expr) {
+  const auto& variable = lookup_variable(expr);
+  expr.binding = variable.binding;
+  expr.type = variable.type ? variable.type : get_int32_type();
+}
+
+void Resolver::visit(BinaryOpExpr& expr) {
+  resolve_expr(*expr.left);
+  resolve_expr(*expr.right);
+
+  // Vectors combine only with a vector of the same type or a scalar splat to it
+  auto common = common_type(expr.left->type, expr.right->type);
+  bool has_vector = expr.left->type->is_vector() || expr.right->type->is_vector();
+  if (is_aggregate(expr.left->type) || is_aggregate(expr.right->type) || (has_vector && !common)) {
+    throw CodeGenError("invalid operands of type '" + expr.left->type->to_string() + "' and '" +
+                           expr.right->type->to_string() + "'",
+                       SourceLocation(expr.line, expr.column));
+  }
+
+  switch (expr.op) {
+  case BinaryOp::Eq:
+  case BinaryOp::Neq:
+  case BinaryOp::Lt:
+  case BinaryOp::Gt:
+  case BinaryOp::Leq:
+  case BinaryOp::Geq:
+  case BinaryOp::And:
+  case BinaryOp::Or: {
+    // Lanewise on vectors, giving a vector of booleans
+    if (common && common->is_vector()) {
+      expr.type = VectorType::get(get_bool_type(), static_cast<const VectorType&>(*common).lanes);
+    } else {
+      expr.type = get_bool_type();
+    }
+    break;
+  }
+  default:
+    expr.type = common ? common : expr.left->type;
+    break;
+  }
+}
+
+void Resolver::visit(UnaryOpExpr& expr) {
+  resolve_expr(*expr.operand);
+  const auto& operand_type = expr.operand->type;
+
+  switch (expr.op) {
+  case UnaryOp::Neg:
+  case UnaryOp::Not:
+    if (is_aggregate(operand_type)) {
+      throw CodeGenError("invalid operand of type '" + operand_type->to_string() + "'",
+                         SourceLocation(expr.line, expr.column));
+    }
+    expr.type = operand_type;
+    break;
+  case UnaryOp::Deref:
+    if (!operand_type->is_pointer()) {
+      throw CodeGenError("cannot dereference a value of type '" + operand_type->to_string() + "'",
+                         SourceLocation(expr.line, expr.column));
+    }
+    expr.type = static_cast<const PointerType&>(*operand_type).pointee;
+    break;
+  case UnaryOp::AddrOf: {
+    // Variables, fields and elements have addresses; lanes and temporaries do not
+    const Expr& operand = *expr.operand;
+    bool is_place = operand.kind == ExprKind::Variable ||
+                    operand.kind == ExprKind::FieldAccess ||
+                    (operand.kind == ExprKind::UnaryOp &&
+                     static_cast<const UnaryOpExpr&>(operand).op == UnaryOp::Deref);
+    if (operand.kind == ExprKind::Index) {
+      const auto& base = static_cast<const IndexExpr&>(operand).array->type;
+      if (base->is_array() && static_cast<const ArrayType&>(*base).is_soa()) {
+        throw CodeGenError("an element of a @soa array has no address",
+                           SourceLocation(expr.line, expr.column));
+      }
+      is_place = !base->is_vector();
+    }
+    if (!is_place) {
+      throw CodeGenError("can only take the address of a variable, field or element",
+                         SourceLocation(expr.line, expr.column));
+    }
+    local_address_taken_ |= is_local_place(operand);
+    if (operand.kind == ExprKind::Variable) {
+      const auto& binding = static_cast<const VariableExpr&>(operand).binding;
+      if (binding.kind == BindingKind::Local) {
+        if (binding.index >= slot_address_taken_.size()) {
+          slot_address_taken_.resize(binding.index + 1);
+        }
+        slot_address_taken_[binding.index] = true;
+      }
+    }
+    expr.type = PointerType::get(operand_type);
+    break;
+  }
+  }
+}
+
+void Resolver::visit(CallExpr& expr) {
+  if (expr.callee->kind != ExprKind::Variable) {
+    throw CodeGenError("callee must be a function name", SourceLocation(expr.line, expr.column));
+  }
+
+  auto& callee = static_cast<VariableExpr&>(*expr.callee);
+  FunctionDecl* fn =
+      callee.symbol < function_symbols_.size() ? function_symbols_[callee.symbol] : nullptr;
+  if (!fn && resolve_builtin(expr, callee)) {
+    return;
+  }
+  if (!fn) {
+    throw CodeGenError("unknown function: '" + callee.name + "'",
+                       SourceLocation(expr.line, expr.column, callee.name.length()));
+  }
+
+  if (expr.arguments.size() != fn->params.size()) {
+    throw CodeGenError("function '" + fn->name + "' expects " +
+                           std::to_string(fn->params.size()) + " argument(s), got " +
+                           std::to_string(expr.arguments.size()),
+                       SourceLocation(expr.line, expr.column, callee.name.length()));
+  }
+
+  for (size_t i = 0; i < expr.arguments.size(); ++i) {
+    auto& arg = *expr.arguments[i];
+    resolve_expr(arg);
+    check_conversion(arg.type, fn->params[i].type, arg.line, arg.column);
+  }
+
+  callee.binding = {BindingKind::Function, fn->index};
+  expr.type = fn->return_type;
+}
+
+void Resolver::visit(IndexExpr& expr) {
+  resolve_expr(*expr.array);
+  resolve_expr(*expr.index);
+
+  const auto& array_type = expr.array->type;
+  if (array_type->is_array()) {
+    expr.type = static_cast<const ArrayType&>(*array_type).element_type;
+  } else if (array_type->is_vector()) {
+    expr.type = static_cast<const VectorType&>(*array_type).element_type;
+  } else if (array_type->is_pointer()) {
+    expr.type = static_cast<const PointerType&>(*array_type).pointee;
+  } else {
+    throw CodeGenError("cannot index a value of type '" + array_type->to_string() + "'",
+                       SourceLocation(expr.line, expr.column));
+  }
+  if (!expr.index->type->is_integer()) {
+    throw CodeGenError("index must be an integer, not '" + expr.index->type->to_string() + "'",
+                       SourceLocation(expr.index->line, expr.index->column));
+  }
+}
+
+void Resolver::visit(FieldAccessExpr& expr) {
+  resolve_expr(*expr.object);
+
+  // Fields are reached the same way on a struct and through a pointer to one
+  TypePtr type = expr.object->type;
+  if (type->is_pointer()) {
+    type = static_cast<const PointerType&>(*type).pointee;
+  }
+  if (!type->is_struct()) {
+    throw CodeGenError("type '" + expr.object->type->to_string() + "' has no fields",
+                       SourceLocation(expr.line, expr.column));
+  }
+  const auto& st = static_cast<const StructType&>(*type);
+  auto index = st.get_field_index(expr.field);
+  if (!index) {
+    throw CodeGenError("struct '" + st.name + "' has no field '" + expr.field + "'",
+                       SourceLocation(expr.line, expr.column));
+  }
+  expr.field_index = static_cast<uint32_t>(*index);
+  expr.type = st.fields[*index].second;
+}
+
+void Resolver::visit(CastExpr& expr) {
+  resolve_expr(*expr.expr);
+  expr.type = expr.target_type;
+}
+
+// Builtins are named like vector types (construction) or by the table below
+bool Resolver::resolve_builtin(CallExpr& expr, const VariableExpr& callee) {
+  static constexpr std::pair<std::string_view, Builtin> names[] = {
+      {"shuffle", Builtin::Shuffle},       {"select", Builtin::Select},
+      {"reduce_add", Builtin::ReduceAdd},  {"reduce_mul", Builtin::ReduceMul},
+      {"reduce_min", Builtin::ReduceMin},  {"reduce_max", Builtin::ReduceMax},
+  };
+
+  Builtin builtin = Builtin::None;
+  StructDecl* st =
+      callee.symbol < struct_symbols_.size() ? struct_symbols_[callee.symbol] : nullptr;
+  TypePtr constructed = parse_type(callee.name);
+  if (st) {
+    builtin = Builtin::StructConstruct;
+  } else if (constructed && constructed->is_vector()) {
+    builtin = Builtin::VectorConstruct;
+  } else {
+    for (const auto& [name, kind] : names) {
+      if (callee.name == name)
+        builtin = kind;
+    }
+  }
+  if (builtin == Builtin::None) {
+    return false;
+  }
+
+  for (auto& arg : expr.arguments) {
+    resolve_expr(*arg);
+  }
+
+  auto& args = expr.arguments;
+  auto fail = [&](const std::string& message) {
+    return CodeGenError("'" + callee.name + "' " + message,
+                        SourceLocation(expr.line, expr.column, callee.name.length()));
+  };
+  auto vector_arg = [&](size_t i) -> const VectorType& {
+    if (i >= args.size() || !args[i]->type->is_vector()) {
+      throw fail("expects a vector as argument " + std::to_string(i + 1));
+    }
+    return static_cast<const VectorType&>(*args[i]->type);
+  };
+
+  switch (builtin) {
+  case Builtin::StructConstruct: {
+    const auto& fields = st->type->fields;
+    if (!args.empty() && args.size() != fields.size()) {
+      throw fail("expects 0 or " + std::to_string(fields.size()) + " argument(s), got " +
+                 std::to_string(args.size()));
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+      check_conversion(args[i]->type, fields[i].second, args[i]->line, args[i]->column);
+    }
+    expr.type = st->type;
+    break;
+  }
+  case Builtin::VectorConstruct: {
+    size_t lanes = static_cast<const VectorType&>(*constructed).lanes;
+    if (args.size() != 1 && args.size() != lanes) {
+      throw fail("expects 1 or " + std::to_string(lanes) + " argument(s), got " +
+                 std::to_string(args.size()));
+    }
+    for (auto& arg : args) {
+      if (arg->type->is_vector() || !common_type(constructed, arg->type)) {
+        throw fail("cannot build lanes from a value of type '" + arg->type->to_string() + "'");
+      }
+    }
+    expr.type = constructed;
+    break;
+  }
+  case Builtin::Shuffle: {
+    const auto& first = vector_arg(0);
+    const auto& second = vector_arg(1);
+    if (!first.equals(second)) {
+      throw fail("expects two vectors of the same type");
+    }
+    if (args.size() < 4) {
+      throw fail("expects at least two lane indices");
+    }
+    for (size_t i = 2; i < args.size(); ++i) {
+      auto* index = args[i]->kind == ExprKind::IntegerLiteral
+                        ? static_cast<IntegerLiteralExpr*>(args[i])
+                        : nullptr;
+      if (!index || index->value < 0 || static_cast<size_t>(index->value) >= 2 * first.lanes) {
+        throw fail("lane indices must be integer literals below " +
+                   std::to_string(2 * first.lanes));
+      }
+    }
+    expr.type = VectorType::get(first.element_type, args.size() - 2);
+    break;
+  }
+  case Builtin::Select: {
+    if (args.size() != 3) {
+      throw fail("expects a mask and two values");
+    }
+    const auto& mask = vector_arg(0);
+    auto values = common_type(args[1]->type, args[2]->type);
+    if (!mask.element_type->is_boolean() || !values || !values->is_vector() ||
+        static_cast<const VectorType&>(*values).lanes != mask.lanes) {
+      throw fail("expects a boolean mask and values with as many lanes");
+    }
+    expr.type = values;
+    break;
+  }
+  default: {
+    if (args.size() != 1) {
+      throw fail("expects one vector");
+    }
+    const auto& vector = vector_arg(0);
+    if (!vector.element_type->is_numeric()) {
+      throw fail("expects a vector of numbers");
+    }
+    expr.type = vector.element_type;
+    break;
+  }
+  }
+
+  expr.builtin = builtin;
+  return true;
+}
+
+// =============================================================================
+// Statements
+// =============================================================================
+
+void Resolver::visit(ExprStmt& stmt) {
+  resolve_expr(*stmt.expr);
+}
+
+void Resolver::visit(LetStmt& stmt) {
+  // The initializer only sees bindings made before this one
+  if (stmt.initializer) {
+    resolve_expr(*stmt.initializer);
+  }
+
+  TypePtr type = stmt.declared_type;
+  if (type) {
+    require_defined(type, stmt.line, stmt.column);
+    if (stmt.initializer) {
+      check_conversion(stmt.initializer->type, type, stmt.initializer->line,
+                       stmt.initializer->column);
+    }
+  } else if (stmt.initializer) {
+    type = stmt.initializer->type;
+  }
+  stmt.slot = bind_local(stmt.symbol, type ? type : get_int32_type(), stmt.is_mutable);
+}
+
+void Resolver::visit(AssignStmt& stmt) {
+  resolve_expr(*stmt.value);
+
+  if (stmt.target->kind == ExprKind::Variable) {
+    auto& var = static_cast<VariableExpr&>(*stmt.target);
+    const auto& variable = lookup_variable(var);
+    var.binding = variable.binding;
+    var.type = variable.type ? variable.type : get_int32_type();
+  } else {
+    resolve_expr(*stmt.target);
+  }
+
+  check_assignable(*stmt.target, stmt);
+  check_conversion(stmt.value->type, stmt.target->type, stmt.value->line, stmt.value->column);
+}
+
+void Resolver::visit(BlockStmt& stmt) {
+  enter_scope();
+  for (auto& s : stmt.statements) {
+    resolve_stmt(*s);
+  }
+  exit_scope();
+}
+
+// Branches test one scalar bool; a vector of them has no single truth value
+void Resolver::resolve_condition(Expr& condition) {
+  resolve_expr(condition);
+  if (!condition.type->is_boolean()) {
+    throw CodeGenError("condition must be 'bool', not '" + condition.type->to_string() + "'",
+                       SourceLocation(condition.line, condition.column));
+  }
+}
+
+void Resolver::visit(IfStmt& stmt) {
+  resolve_condition(*stmt.condition);
+  resolve_stmt(*stmt.then_branch);
+  if (stmt.else_branch) {
+    resolve_stmt(*stmt.else_branch);
+  }
+}
+
+void Resolver::visit(WhileStmt& stmt) {
+  resolve_condition(*stmt.condition);
+  resolve_stmt(*stmt.body);
+}
+
+void Resolver::visit(ForStmt& stmt) {
+  // The range is evaluated before the loop variable comes into scope
+  resolve_expr(*stmt.range_start);
+  resolve_expr(*stmt.range_end);
+
+  // The loop variable counts in the common integer type of the range, so 64-bit trip counts
+  // do not wrap; anything else counts in int
+  TypePtr var_type = common_type(stmt.range_start->type, stmt.range_end->type);
+  stmt.var_type = var_type && var_type->is_integer() ? var_type : get_int32_type();
+
+  enter_scope();
+  stmt.slot = bind_local(stmt.var_symbol, stmt.var_type, false);
+  resolve_stmt(*stmt.body);
+  stmt.var_address_taken =
+      stmt.slot < slot_address_taken_.size() && slot_address_taken_[stmt.slot];
+  exit_scope();
+}
+
+void Resolver::visit(ReturnStmt& stmt) {
+  if (stmt.value) {
+    resolve_expr(*stmt.value);
+    check_conversion(stmt.value->type, current_function_->return_type, stmt.value->line,
+                     stmt.value->column);
+  }
+  if (stmt.is_tail_call) {
+    check_tail_call(stmt);
+  }
+}
+
+void Resolver::check_tail_call(const ReturnStmt& stmt) {
+  const auto& call = static_cast<const CallExpr&>(*stmt.value);
+  if (call.builtin != Builtin::None) {
+    throw CodeGenError("'become' needs a call to a function, not a builtin",
+                       SourceLocation(call.line, call.column));
+  }
+
+  // LLVM guarantees the tail call only when caller and callee take and return the same types
+  const auto& callee = *function_symbols_[static_cast<const VariableExpr&>(*call.callee).symbol];
+  const FunctionDecl& caller = *current_function_;
+  bool same_signature = callee.return_type->equals(*caller.return_type) &&
+                        callee.params.size() == caller.params.size();
+  for (size_t i = 0; same_signature && i < callee.params.size(); ++i) {
+    same_signature = callee.params[i].type->equals(*caller.params[i].type);
+  }
+  if (!same_signature) {
+    throw CodeGenError("'become' needs '" + callee.name + "' to have the same signature as '" +
+                           caller.name + "'",
+                       SourceLocation(call.line, call.column));
+  }
+  tail_calls_.push_back(&stmt);
+}
+
+// =============================================================================
+// Declarations
+// =============================================================================
+
+void Resolver::visit(FunctionDecl& decl) {
+  current_function_ = &decl;
+  decl.local_count = 0;
+  tail_calls_.clear();
+  local_address_taken_ = false;
+  slot_address_taken_.clear();
+
+  enter_scope();
+
+  require_defined(decl.return_type, decl.line, decl.column);
+
+  // Parameters take the first slots, in order
+  for (auto& param : decl.params) {
+    require_defined(param.type, decl.line, decl.column);
+    bind_local(param.symbol, param.type, false);
+  }
+
+  if (decl.body && decl.body->kind == StmtKind::Block) {
+    for (auto& stmt : static_cast<BlockStmt&>(*decl.body).statements) {
+      resolve_stmt(*stmt);
+    }
+  }
+  if (local_address_taken_ && !tail_calls_.empty()) {
+    throw CodeGenError("'become' cannot be used in '" + decl.name +
+                           "', which takes the address of a local",
+                       SourceLocation(tail_calls_.front()->line, tail_calls_.front()->column));
+  }
+
+  exit_scope();
+  current_function_ = nullptr;
+}
+
+void Resolver::visit(StructDecl& decl) {
+  for (size_t i = 0; i < decl.fields.size(); ++i) {
+    const auto& field = decl.fields[i];
+    for (size_t j = 0; j < i; ++j) {
+      if (decl.fields[j].name == field.name) {
+        throw CodeGenError("duplicate field '" + field.name + "' in struct '" + decl.name + "'",
+                           SourceLocation(decl.line, decl.column));
+      }
+    }
+    require_defined(field.type, decl.line, decl.column);
+  }
+
+  std::vector<const StructType*> open;
+  check_recursion(*decl.type, decl, open);
+}
+
+void Resolver::visit(GlobalDecl& decl) {
+  if (decl.type) {
+    require_defined(decl.type, decl.line, decl.column);
+  }
+  if (!decl.initializer)
+    return;
+
+  resolve_expr(*decl.initializer);
+  if (decl.type) {
+    check_conversion(decl.initializer->type, decl.type, decl.initializer->line,
+                     decl.initializer->column);
+  } else {
+    variables_[decl.symbol].type = decl.initializer->type;
+  }
+}
+
+} // namespace tuz
@@ -0,0 +1,323 @@
+#include "tuz/server.h"
+
+#include "tuz/driver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace tuz {
+
+// =============================================================================
+// Wire format
+// =============================================================================
+//
+// A request is a count followed by that many strings: the working directory, then the
+// arguments. The response is the exit code followed by the output and error text. Counts,
+// lengths and the exit code are 32-bit in host byte order, as both ends run on one machine.
+
+// Requests larger than this are rejected rather than buffered
+static constexpr uint32_t MaxStringSize = 16u << 20;
+static constexpr uint32_t MaxArguments = 1u << 16;
+static constexpr size_t MaxRequestSize = 64u << 20; // All strings of a request together
+
+using Clock = std::chrono::steady_clock;
+static constexpr Clock::time_point NoDeadline = Clock::time_point::max();
+
+static bool write_all(int fd, const void* data, size_t size) {
+  auto* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    // MSG_NOSIGNAL: a client that went away must not kill the server with SIGPIPE
+    ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    bytes += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+// Wait until fd has data to read; false once the deadline has passed
+static bool wait_readable(int fd, Clock::time_point deadline) {
+  for (;;) {
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    if (left <= 0) {
+      return false;
+    }
+    pollfd request{fd, POLLIN, 0};
+    int ready = poll(&request, 1, static_cast<int>(std::min<int64_t>(left, INT_MAX)));
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    return ready > 0;
+  }
+}
+
+static bool read_all(int fd, void* data, size_t size, Clock::time_point deadline) {
+  auto* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    if (deadline != NoDeadline && !wait_readable(fd, deadline)) {
+      return false;
+    }
+    ssize_t count = recv(fd, bytes, size, 0);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    bytes += count;
+    size -= static_cast<size_t>(count);
+  }
+  return true;
+}
+
+static bool write_u32(int fd, uint32_t value) {
+  return write_all(fd, &value, sizeof(value));
+}
+
+static bool read_u32(int fd, uint32_t& value, Clock::time_point deadline = NoDeadline) {
+  return read_all(fd, &value, sizeof(value), deadline);
+}
+
+static bool write_string(int fd, const std::string& text) {
+  return text.size() <= MaxStringSize && write_u32(fd, static_cast<uint32_t>(text.size())) &&
+         write_all(fd, text.data(), text.size());
+}
+
+// Read a string of at most MaxStringSize bytes, and at most budget, which it is taken from
+static bool read_string(int fd, std::string& text, size_t& budget,
+                        Clock::time_point deadline = NoDeadline) {
+  uint32_t size = 0;
+  if (!read_u32(fd, size, deadline) || size > MaxStringSize || size > budget) {
+    return false;
+  }
+  budget -= size;
+  text.resize(size);
+  return read_all(fd, text.data(), size, deadline);
+}
+
+static bool read_string(int fd, std::string& text) {
+  size_t budget = MaxStringSize;
+  return read_string(fd, text, budget);
+}
+
+// Fill in a socket address; false if the path does not fit
+static bool make_address(const std::string& path, sockaddr_un& address) {
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  std::memcpy(address.sun_path, path.data(), path.size());
+  return true;
+}
+
+// Connect to the socket at path; -1 if nothing is listening there
+static int connect_to(const std::string& path) {
+  sockaddr_un address;
+  if (!make_address(path, address)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// =============================================================================
+// Compile Server
+// =============================================================================
+
+CompileServer::CompileServer(std::string socket_path, unsigned workers,
+                             std::chrono::milliseconds request_timeout)
+    : socket_path_(std::move(socket_path)), workers_(std::max(workers, 1u)),
+      request_timeout_(request_timeout) {
+}
+
+CompileServer::~CompileServer() {
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+  }
+}
+
+bool CompileServer::listen(std::ostream& err) {
+  sockaddr_un address;
+  if (!make_address(socket_path_, address)) {
+    err << "Error: Invalid socket path: " << socket_path_ << std::endl;
+    return false;
+  }
+
+  // A socket file nobody answers on is left over from a server that did not shut down
+  struct stat info;
+  if (lstat(socket_path_.c_str(), &info) == 0) {
+    if (!S_ISSOCK(info.st_mode)) {
+      err << "Error: " << socket_path_ << " exists and is not a socket" << std::endl;
+      return false;
+    }
+    int fd = connect_to(socket_path_);
+    if (fd >= 0) {
+      close(fd);
+      err << "Error: A compile server is already listening on " << socket_path_ << std::endl;
+      return false;
+    }
+    unlink(socket_path_.c_str());
+  }
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0 ||
+      bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      ::listen(listen_fd_, SOMAXCONN) != 0) {
+    err << "Error: Could not listen on " << socket_path_ << ": " << std::strerror(errno)
+        << std::endl;
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+      listen_fd_ = -1;
+    }
+    return false;
+  }
+  return true;
+}
+
+void CompileServer::serve() {
+  std::vector<std::thread> pool;
+  for (unsigned i = 0; i < workers_; ++i) {
+    pool.emplace_back([this] {
+      for (;;) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_ready_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty()) {
+          return; // Stopping, and every accepted request is answered
+        }
+        int fd = pending_.front();
+        pending_.pop_front();
+        lock.unlock();
+        handle(fd);
+      }
+    });
+  }
+
+  while (!stopping_) {
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break; // stop() shut the socket down
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.push_back(fd);
+    }
+    pending_ready_.notify_one();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  pending_ready_.notify_all();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+}
+
+void CompileServer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  pending_ready_.notify_all();
+  // Wakes serve() from accept
+  if (listen_fd_ >= 0) {
+    shutdown(listen_fd_, SHUT_RDWR);
+  }
+}
+
+void CompileServer::handle(int fd) {
+  // A client that stalls or sends too much is dropped, so it cannot hold on to the worker
+  auto deadline = Clock::now() + request_timeout_;
+  size_t budget = MaxRequestSize;
+  uint32_t count = 0;
+  std::string cwd;
+  std::vector<std::string> args;
+  bool valid = read_u32(fd, count, deadline) && count > 0 && count <= MaxArguments &&
+               read_string(fd, cwd, budget, deadline);
+  for (uint32_t i = 1; valid && i < count; ++i) {
+    valid = read_string(fd, args.emplace_back(), budget, deadline);
+  }
+  if (!valid) {
+    close(fd);
+    return;
+  }
+
+  std::ostringstream output;
+  std::ostringstream errors;
+  int exit_code = 1;
+  try {
+    exit_code = Driver::run_request(args, cwd, output, errors);
+  } catch (const std::exception& e) {
+    errors << "Error: " << e.what() << std::endl;
+  }
+
+  // A client that went away gets no answer
+  if (write_u32(fd, static_cast<uint32_t>(exit_code)) && write_string(fd, output.str())) {
+    write_string(fd, errors.str());
+  }
+  close(fd);
+}
+
+// =============================================================================
+// Client
+// =============================================================================
+
+std::optional<int> send_compile_request(const std::string& socket_path, const std::string& cwd,
+                                        const std::vector<std::string>& args, std::ostream& out,
+                                        std::ostream& err) {
+  int fd = connect_to(socket_path);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+
+  bool sent = write_u32(fd, static_cast<uint32_t>(args.size() + 1)) && write_string(fd, cwd);
+  for (size_t i = 0; sent && i < args.size(); ++i) {
+    sent = write_string(fd, args[i]);
+  }
+
+  uint32_t exit_code = 0;
+  std::string output;
+  std::string errors;
+  bool answered = sent && read_u32(fd, exit_code) && read_string(fd, output) &&
+                  read_string(fd, errors);
+  close(fd);
+  if (!answered) {
+    return std::nullopt;
+  }
+
+  out << output << std::flush;
+  err << errors << std::flush;
+  return static_cast<int>(exit_code);
+}
+
+} // namespace tuz
@@ -0,0 +1,119 @@
+#include "tuz/session.h"
+
+#include "tuz/diagnostic.h"
+#include "tuz/lexer.h"
+#include "tuz/parser.h"
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <utility>
+
+namespace tuz {
+
+// =============================================================================
+// JIT Module
+// =============================================================================
+
+JitModule::JitModule(JitModule&& other) noexcept : jit_(other.jit_), dylib_(other.dylib_) {
+  other.dylib_ = nullptr;
+}
+
+JitModule& JitModule::operator=(JitModule&& other) noexcept {
+  // other unloads what this held when it is destroyed
+  std::swap(jit_, other.jit_);
+  std::swap(dylib_, other.dylib_);
+  return *this;
+}
+
+JitModule::~JitModule() {
+  if (dylib_) {
+    // Frees the program's code; nothing is left to report a failure to
+    llvm::consumeError(jit_->getExecutionSession().removeJITDylib(*dylib_));
+  }
+}
+
+void* JitModule::lookup(const std::string& name) const {
+  if (!dylib_) {
+    throw CodeGenError("module has been moved from");
+  }
+  auto symbol = jit_->lookup(*dylib_, name);
+  if (!symbol) {
+    throw CodeGenError(llvm::toString(symbol.takeError()));
+  }
+  return symbol->toPtr<void*>();
+}
+
+// =============================================================================
+// Compilation Session
+// =============================================================================
+
+CompilationSession::CompilationSession(CodeGenOptions options)
+    : options_(std::move(options)),
+      context_(std::make_unique<llvm::orc::ThreadSafeContext>(
+          std::make_unique<llvm::LLVMContext>())) {
+}
+
+CompilationSession::~CompilationSession() = default;
+
+void CompilationSession::generate(std::string_view source, CodeGenerator& codegen) {
+  Lexer lexer(source);
+  Parser parser(lexer);
+  Program program = parser.parse_program();
+  codegen.generate(program);
+  codegen.optimize();
+}
+
+std::vector<char> CompilationSession::compile_object(std::string_view source) {
+  auto lock = context_->getLock();
+  CodeGenerator codegen(options_, *context_->getContext());
+  generate(source, codegen);
+
+  llvm::SmallVector<char, 0> object;
+  codegen.compile_to_buffer(object);
+  return std::vector<char>(object.begin(), object.end());
+}
+
+JitModule CompilationSession::load(std::string_view source) {
+  if (!jit_) {
+    llvm::orc::LLJITBuilder builder;
+    configure_jit(builder, options_);
+    auto jit = builder.create();
+    if (!jit) {
+      throw CodeGenError("could not create JIT: " + llvm::toString(jit.takeError()));
+    }
+    jit_ = std::move(*jit);
+  }
+
+  std::unique_ptr<llvm::Module> module;
+  {
+    auto lock = context_->getLock();
+    CodeGenerator codegen(options_, *context_->getContext());
+    generate(source, codegen);
+    module = codegen.get_module();
+  }
+
+  auto dylib = jit_->createJITDylib("program" + std::to_string(loaded_++));
+  if (!dylib) {
+    throw CodeGenError(llvm::toString(dylib.takeError()));
+  }
+  JitModule loaded(*jit_, *dylib);
+
+  // Resolve extern functions (puts, malloc, ...) against the host process
+  auto process_symbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      jit_->getDataLayout().getGlobalPrefix());
+  if (!process_symbols) {
+    throw CodeGenError(llvm::toString(process_symbols.takeError()));
+  }
+  dylib->addGenerator(std::move(*process_symbols));
+
+  if (auto err = jit_->addIRModule(*dylib, llvm::orc::ThreadSafeModule(std::move(module),
+                                                                          *context_))) {
+    throw CodeGenError(llvm::toString(std::move(err)));
+  }
+  return loaded;
+}
+
+} // namespace tuz
@@ -0,0 +1,203 @@
+#include "tuz/stats.h"
+
+#include "json.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sys/resource.h>
+
+namespace tuz {
+
+CompileStats::Phase::Phase(CompileStats* stats, std::string name, std::string input)
+    : stats_(stats) {
+  if (stats_) {
+    record_.name = std::move(name);
+    record_.input = std::move(input);
+    index_ = stats_->phase_count();
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+CompileStats::Phase::Phase(const Phase& section, std::string name, std::string input)
+    : Phase(section.stats_, std::move(name), std::move(input)) {
+  record_.parent = section.record_.name;
+}
+
+CompileStats::Phase::~Phase() {
+  if (!stats_) {
+    return;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start_;
+  record_.wall_ms = std::chrono::duration<double, std::milli>(elapsed).count();
+  record_.peak_rss_kb = peak_rss_kb();
+  stats_->add_phase(std::move(record_), index_);
+}
+
+void CompileStats::Phase::set(std::string name, uint64_t value) {
+  if (stats_) {
+    record_.counters.emplace_back(std::move(name), value);
+  }
+}
+
+size_t CompileStats::phase_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return phases_.size();
+}
+
+// A phase ends after the phases nested in it, so it goes back to where it started, ahead of them
+void CompileStats::add_phase(PhaseRecord record, size_t index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  phases_.insert(phases_.begin() + static_cast<ptrdiff_t>(index), std::move(record));
+}
+
+void CompileStats::record_pass(std::string_view name, double wall_ms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = std::find_if(passes_.begin(), passes_.end(),
+                         [&](const PassRecord& pass) { return pass.name == name; });
+  if (it == passes_.end()) {
+    passes_.push_back({std::string(name), 0, 0});
+    it = passes_.end() - 1;
+  }
+  it->wall_ms += wall_ms;
+  it->runs++;
+}
+
+void CompileStats::add_llvm_report(const std::string& report) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  llvm_report_ += report;
+}
+
+std::vector<CompileStats::PhaseRecord> CompileStats::phases() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return phases_;
+}
+
+std::vector<CompileStats::PassRecord> CompileStats::passes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Most expensive first
+  auto passes = passes_;
+  std::stable_sort(passes.begin(), passes.end(),
+                   [](const PassRecord& a, const PassRecord& b) { return a.wall_ms > b.wall_ms; });
+  return passes;
+}
+
+uint64_t CompileStats::peak_rss_kb() {
+  struct rusage usage {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<uint64_t>(usage.ru_maxrss) / 1024; // Bytes on macOS
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+}
+
+// =============================================================================
+// Reports
+// =============================================================================
+
+// Nested phases overlap their section and each other, so only the top level adds up
+static double top_level_ms(const std::vector<CompileStats::PhaseRecord>& phases) {
+  double total = 0;
+  for (const auto& phase : phases) {
+    if (phase.parent.empty()) {
+      total += phase.wall_ms;
+    }
+  }
+  return total;
+}
+
+void CompileStats::print_text(std::ostream& out) const {
+  auto phases = this->phases();
+  auto passes = this->passes();
+
+  double total_ms = top_level_ms(phases);
+
+  auto saved_flags = out.flags();
+  out << std::fixed << std::setprecision(3);
+
+  out << "===-------------------------------------------------------------------------===\n";
+  out << "                          tuz compile time report\n";
+  out << "===-------------------------------------------------------------------------===\n";
+  out << "  " << std::left << std::setw(12) << "Phase" << std::setw(22) << "Input" << std::right
+      << std::setw(12) << "Wall (ms)" << std::setw(16) << "Peak RSS (KiB)" << "  Counters\n";
+  for (const auto& phase : phases) {
+    std::string label = phase.parent.empty() ? phase.name : "  " + phase.name;
+    out << "  " << std::left << std::setw(12) << label << std::setw(22) << phase.input
+        << std::right << std::setw(12) << phase.wall_ms << std::setw(16) << phase.peak_rss_kb;
+    const char* separator = "  ";
+    for (const auto& [name, value] : phase.counters) {
+      out << separator << name << "=" << value;
+      separator = " ";
+    }
+    out << "\n";
+  }
+  out << "  " << std::left << std::setw(34) << "Total" << std::right << std::setw(12) << total_ms
+      << std::setw(16) << peak_rss_kb() << "\n";
+
+  if (!passes.empty()) {
+    out << "\n  LLVM passes (exclusive wall time)\n";
+    for (const auto& pass : passes) {
+      out << "  " << std::setw(12) << pass.wall_ms << " ms  " << std::setw(5) << pass.runs
+          << "x  " << pass.name << "\n";
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!llvm_report_.empty()) {
+    out << "\n" << llvm_report_;
+  }
+  out.flags(saved_flags);
+}
+
+static void write_json_string(std::ostream& out, std::string_view text) {
+  std::string quoted;
+  append_json_string(quoted, text);
+  out << quoted;
+}
+
+void CompileStats::print_json(std::ostream& out) const {
+  auto phases = this->phases();
+  auto passes = this->passes();
+
+  double total_ms = top_level_ms(phases);
+
+  auto saved_flags = out.flags();
+  out << std::fixed << std::setprecision(3);
+
+  out << "{\"phases\":[";
+  for (size_t i = 0; i < phases.size(); ++i) {
+    const auto& phase = phases[i];
+    out << (i ? "," : "") << "{\"name\":";
+    write_json_string(out, phase.name);
+    if (!phase.parent.empty()) {
+      out << ",\"parent\":";
+      write_json_string(out, phase.parent);
+    }
+    out << ",\"input\":";
+    write_json_string(out, phase.input);
+    out << ",\"wall_ms\":" << phase.wall_ms << ",\"peak_rss_kb\":" << phase.peak_rss_kb;
+    for (const auto& [name, value] : phase.counters) {
+      out << ",";
+      write_json_string(out, name);
+      out << ":" << value;
+    }
+    out << "}";
+  }
+  out << "],\"passes\":[";
+  for (size_t i = 0; i < passes.size(); ++i) {
+    out << (i ? "," : "") << "{\"name\":";
+    write_json_string(out, passes[i].name);
+    out << ",\"wall_ms\":" << passes[i].wall_ms << ",\"runs\":" << passes[i].runs << "}";
+  }
+  out << "],\"total_wall_ms\":" << total_ms << ",\"peak_rss_kb\":" << peak_rss_kb();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  out << ",\"llvm_report\":";
+  write_json_string(out, llvm_report_);
+  out << "}\n";
+  out.flags(saved_flags);
+}
+
+} // namespace tuz
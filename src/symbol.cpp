@@ -0,0 +1,23 @@
+#include "tuz/symbol.h"
+
+namespace tuz {
+
+Symbol SymbolTable::intern(std::string_view name) {
+  auto it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  auto stored = storage_.copy_string(name);
+  auto symbol = static_cast<Symbol>(names_.size());
+  names_.push_back(stored);
+  ids_.emplace(stored, symbol);
+  return symbol;
+}
+
+Symbol SymbolTable::lookup(std::string_view name) const {
+  auto it = ids_.find(name);
+  return it != ids_.end() ? it->second : InvalidSymbol;
+}
+
+} // namespace tuz
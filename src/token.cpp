@@ -1,52 +1,79 @@
 #include "tuz/token.h"
 
+#include <array>
+
 namespace tuz {
 
-const std::vector<TokenDefinition> Keywords = {
-    {TokenType::FN, "fn"},         {TokenType::LET, "let"},       {TokenType::MUT, "mut"},
-    {TokenType::IF, "if"},         {TokenType::ELSE, "else"},     {TokenType::WHILE, "while"},
-    {TokenType::FOR, "for"},       {TokenType::RETURN, "return"}, {TokenType::STRUCT, "struct"},
-    {TokenType::EXTERN, "extern"}, {TokenType::TRUE, "true"},     {TokenType::FALSE, "false"},
-    {TokenType::INT, "int"},       {TokenType::FLOAT, "float"},   {TokenType::BOOL, "bool"},
-    {TokenType::VOID, "void"},     {TokenType::I8, "i8"},         {TokenType::I16, "i16"},
-    {TokenType::I32, "i32"},       {TokenType::I64, "i64"},       {TokenType::U8, "u8"},
-    {TokenType::U16, "u16"},       {TokenType::U32, "u32"},       {TokenType::U64, "u64"},
-    {TokenType::F32, "f32"},       {TokenType::F64, "f64"},
-};
+// =============================================================================
+// Keyword perfect hash
+// =============================================================================
 
-const std::vector<TokenDefinition> Tokens = {
-    // Double char
-    {TokenType::EQ, "=="},
-    {TokenType::NEQ, "!="},
-    {TokenType::LEQ, "<="},
-    {TokenType::GEQ, ">="},
-    {TokenType::AND, "&&"},
-    {TokenType::OR, "||"},
-    {TokenType::ARROW, "->"},
-
-    // Single char
-    {TokenType::NOT, "!"},
-    {TokenType::AMPERSAND, "&"},
-    {TokenType::LT, "<"},
-    {TokenType::GT, ">"},
-    {TokenType::PLUS, "+"},
-    {TokenType::MINUS, "-"},
-    {TokenType::STAR, "*"},
-    {TokenType::SLASH, "/"},
-    {TokenType::PERCENT, "%"},
-    {TokenType::ASSIGN, "="},
-    {TokenType::LPAREN, "("},
-    {TokenType::RPAREN, ")"},
-    {TokenType::LBRACE, "{"},
-    {TokenType::RBRACE, "}"},
-    {TokenType::LBRACKET, "["},
-    {TokenType::SEMICOLON, ";"},
-    {TokenType::RBRACKET, "]"},
-    {TokenType::SEMICOLON, ";"},
-    {TokenType::COLON, ":"},
-    {TokenType::COMMA, ","},
-    {TokenType::DOT, "."},
-};
+// Keywords are looked up through a collision-free hash whose seed is searched at compile
+// time, so each identifier costs one hash and at most one string comparison.
+namespace {
+
+constexpr size_t KeywordSlotCount = 64;
+
+constexpr uint32_t keyword_hash(std::string_view text, uint32_t seed) {
+  uint32_t hash = seed;
+  for (char c : text) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  // Fold the well-mixed high bits into the low bits used for the slot index
+  return hash ^ (hash >> 16);
+}
+
+constexpr bool is_perfect_seed(uint32_t seed) {
+  bool used[KeywordSlotCount] = {};
+  for (const auto& keyword : KeywordDefinitions) {
+    auto slot = keyword_hash(keyword.value, seed) % KeywordSlotCount;
+    if (used[slot])
+      return false;
+    used[slot] = true;
+  }
+  return true;
+}
+
+constexpr uint32_t find_keyword_seed() {
+  for (uint32_t seed = 1; seed < 10000; ++seed) {
+    if (is_perfect_seed(seed))
+      return seed;
+  }
+  return 0;
+}
+
+constexpr uint32_t KeywordSeed = find_keyword_seed();
+static_assert(KeywordSeed != 0, "no collision-free keyword hash seed; grow KeywordSlotCount");
+
+constexpr auto build_keyword_slots() {
+  std::array<int8_t, KeywordSlotCount> slots{};
+  slots.fill(-1);
+  for (size_t i = 0; i < std::size(KeywordDefinitions); ++i) {
+    slots[keyword_hash(KeywordDefinitions[i].value, KeywordSeed) % KeywordSlotCount] =
+        static_cast<int8_t>(i);
+  }
+  return slots;
+}
+
+constexpr auto KeywordSlots = build_keyword_slots();
+
+constexpr size_t max_keyword_length() {
+  size_t length = 0;
+  for (const auto& keyword : KeywordDefinitions) {
+    length = keyword.value.size() > length ? keyword.value.size() : length;
+  }
+  return length;
+}
+
+constexpr size_t MaxKeywordLength = max_keyword_length();
+
+} // namespace
+
+const std::vector<TokenDefinition> Keywords(std::begin(KeywordDefinitions),
+                                            std::end(KeywordDefinitions));
+
+const std::vector<TokenDefinition> Tokens(std::begin(OperatorDefinitions),
+                                          std::end(OperatorDefinitions));
 
 const std::vector<TokenDefinition> SpecialTokens = {
     {TokenType::END_OF_FILE, "EOF"},
@@ -70,6 +97,9 @@ TokenGroup get_token_group(TokenType type) {
   case TokenType::RETURN:
   case TokenType::STRUCT:
   case TokenType::EXTERN:
+  case TokenType::EXPORT:
+  case TokenType::INLINE:
+  case TokenType::BECOME:
   case TokenType::TRUE:
   case TokenType::FALSE:
     return TokenGroup::KEYWORD;
@@ -122,6 +152,7 @@ TokenGroup get_token_group(TokenType type) {
   case TokenType::COLON:
   case TokenType::COMMA:
   case TokenType::DOT:
+  case TokenType::AT:
     return TokenGroup::DELIMITER;
 
   // Literals
@@ -154,16 +185,7 @@ auto create_token_type_map() {
   return map;
 }
 
-auto create_keyword_to_token_type_map() {
-  std::unordered_map<std::string_view, TokenType> map;
-  for (const auto& token : Keywords) {
-    map[token.value] = token.type;
-  }
-  return map;
-}
-
 static const auto TokenTypeMap = create_token_type_map();
-static const auto KeywordToTokenTypeMap = create_keyword_to_token_type_map();
 
 const char* token_type_to_string(TokenType type) {
   auto it = TokenTypeMap.find(type);
@@ -174,10 +196,13 @@ const char* token_type_to_string(TokenType type) {
 }
 
 std::optional<TokenType> get_keyword_token_type(std::string_view token) {
-  auto it = KeywordToTokenTypeMap.find(token);
-  return it != KeywordToTokenTypeMap.end()
-      ? std::optional{it->second}
-      : std::nullopt;
+  if (token.size() > MaxKeywordLength)
+    return std::nullopt;
+
+  auto index = KeywordSlots[keyword_hash(token, KeywordSeed) % KeywordSlotCount];
+  if (index < 0 || KeywordDefinitions[index].value != token)
+    return std::nullopt;
+  return KeywordDefinitions[index].type;
 }
 
 } // namespace tuz
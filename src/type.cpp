@@ -1,6 +1,8 @@
 #include "tuz/type.h"
 
 #include <algorithm>
+#include <charconv>
+#include <iterator>
 
 namespace tuz {
 
@@ -54,6 +56,10 @@ bool Type::is_array() const {
   return kind == TypeKind::Array;
 }
 
+bool Type::is_vector() const {
+  return kind == TypeKind::Vector;
+}
+
 bool Type::is_function() const {
   return kind == TypeKind::Function;
 }
@@ -98,6 +104,8 @@ std::string Type::to_string() const {
 }
 
 bool Type::equals(const Type& other) const {
+  if (this == &other)
+    return true;
   if (kind != other.kind)
     return false;
   return true; // Base types are equal if kinds match
@@ -144,6 +152,9 @@ std::string PointerType::to_string() const {
 }
 
 bool PointerType::equals(const Type& other) const {
+  // Interned types are unique, so identity settles most comparisons
+  if (this == &other)
+    return true;
   if (other.kind != TypeKind::Pointer)
     return false;
   const auto& other_ptr = static_cast<const PointerType&>(other);
@@ -151,7 +162,7 @@ bool PointerType::equals(const Type& other) const {
 }
 
 TypePtr PointerType::get(TypePtr pointee) {
-  return std::make_shared<PointerType>(pointee);
+  return get_type_context().get_pointer_type(pointee);
 }
 
 // ArrayType
@@ -160,6 +171,8 @@ std::string ArrayType::to_string() const {
 }
 
 bool ArrayType::equals(const Type& other) const {
+  if (this == &other)
+    return true;
   if (other.kind != TypeKind::Array)
     return false;
   const auto& other_arr = static_cast<const ArrayType&>(other);
@@ -167,7 +180,43 @@ bool ArrayType::equals(const Type& other) const {
 }
 
 size_t ArrayType::size() const {
-  return element_type->size() * size_val;
+  if (!is_soa()) {
+    return element_type->size() * size_val;
+  }
+  // One array per field, each aligned for its element
+  size_t total = 0;
+  for (const auto& [name, type] : static_cast<const StructType&>(*element_type).fields) {
+    size_t align = type->alignment();
+    total += (align - (total % align)) % align + type->size() * size_val;
+  }
+  size_t align = alignment();
+  return total + (align - (total % align)) % align;
+}
+
+bool ArrayType::is_soa() const {
+  return element_type->is_struct() && static_cast<const StructType&>(*element_type).soa;
+}
+
+TypePtr ArrayType::get(TypePtr element, size_t size) {
+  return get_type_context().get_array_type(element, size);
+}
+
+// VectorType
+std::string VectorType::to_string() const {
+  return element_type->to_string() + "x" + std::to_string(lanes);
+}
+
+bool VectorType::equals(const Type& other) const {
+  if (this == &other)
+    return true;
+  if (other.kind != TypeKind::Vector)
+    return false;
+  const auto& other_vec = static_cast<const VectorType&>(other);
+  return lanes == other_vec.lanes && element_type->equals(*other_vec.element_type);
+}
+
+TypePtr VectorType::get(TypePtr element, size_t lanes) {
+  return get_type_context().get_vector_type(element, lanes);
 }
 
 // FunctionType
@@ -183,6 +232,8 @@ std::string FunctionType::to_string() const {
 }
 
 bool FunctionType::equals(const Type& other) const {
+  if (this == &other)
+    return true;
   if (other.kind != TypeKind::Function)
     return false;
   const auto& other_fn = static_cast<const FunctionType&>(other);
@@ -197,12 +248,18 @@ bool FunctionType::equals(const Type& other) const {
   return true;
 }
 
+TypePtr FunctionType::get(std::vector<TypePtr> params, TypePtr ret) {
+  return get_type_context().get_function_type(params, ret);
+}
+
 // StructType
 std::string StructType::to_string() const {
   return "struct " + name;
 }
 
 bool StructType::equals(const Type& other) const {
+  if (this == &other)
+    return true;
   if (other.kind != TypeKind::Struct)
     return false;
   const auto& other_struct = static_cast<const StructType&>(other);
@@ -257,6 +314,15 @@ std::optional<size_t> StructType::get_field_offset(const std::string& field_name
   return std::nullopt;
 }
 
+std::optional<size_t> StructType::get_field_index(const std::string& field_name) const {
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (fields[i].first == field_name) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
 TypePtr StructType::get_field_type(const std::string& field_name) const {
   for (const auto& [name, type] : fields) {
     if (name == field_name) {
@@ -266,18 +332,114 @@ TypePtr StructType::get_field_type(const std::string& field_name) const {
   return nullptr;
 }
 
+void StructType::define(std::vector<std::pair<std::string, TypePtr>> new_fields, bool is_soa) {
+  fields = std::move(new_fields);
+  soa = is_soa;
+  is_defined = true;
+  cached_size.reset();
+  cached_alignment.reset();
+}
+
 // ReferenceType
 std::string ReferenceType::to_string() const {
   return std::string(is_mutable ? "&mut " : "&") + referent->to_string();
 }
 
 bool ReferenceType::equals(const Type& other) const {
+  if (this == &other)
+    return true;
   if (other.kind != TypeKind::Reference)
     return false;
   const auto& other_ref = static_cast<const ReferenceType&>(other);
   return is_mutable == other_ref.is_mutable && referent->equals(*other_ref.referent);
 }
 
+TypePtr ReferenceType::get(TypePtr referent, bool is_mutable) {
+  return get_type_context().get_reference_type(referent, is_mutable);
+}
+
+// =============================================================================
+// TypeContext
+// =============================================================================
+
+size_t TypeContext::KeyHash::operator()(const Type* key) const {
+  return std::hash<const Type*>()(key);
+}
+
+size_t TypeContext::KeyHash::operator()(const std::pair<const Type*, size_t>& key) const {
+  return std::hash<const Type*>()(key.first) * 31 + key.second;
+}
+
+size_t TypeContext::KeyHash::operator()(const std::vector<const Type*>& key) const {
+  size_t hash = key.size();
+  for (const Type* type : key) {
+    hash = hash * 31 + std::hash<const Type*>()(type);
+  }
+  return hash;
+}
+
+// A key names the types a live entry holds on to, so its address cannot be reused while the
+// entry lives; an expired entry is simply replaced.
+template <typename Key, typename Make>
+TypePtr TypeContext::intern(Map<Key>& map, std::type_identity_t<Key> key, Make make) {
+  auto [it, inserted] = map.try_emplace(std::move(key));
+  if (TypePtr type = it->second.lock()) {
+    return type;
+  }
+  TypePtr type = make();
+  it->second = type;
+
+  // Sweep dead entries each time the map doubles, so a long-running process (the compile
+  // server, a session, the REPL) keeps only the types still in use
+  if (inserted && map.size() >= 64 && (map.size() & (map.size() - 1)) == 0) {
+    for (auto entry = map.begin(); entry != map.end();) {
+      entry = entry->second.expired() ? map.erase(entry) : std::next(entry);
+    }
+  }
+  return type;
+}
+
+TypePtr TypeContext::get_pointer_type(const TypePtr& pointee) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return intern(pointers_, pointee.get(), [&] { return std::make_shared<PointerType>(pointee); });
+}
+
+TypePtr TypeContext::get_array_type(const TypePtr& element, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return intern(arrays_, {element.get(), size},
+                [&] { return std::make_shared<ArrayType>(element, size); });
+}
+
+TypePtr TypeContext::get_vector_type(const TypePtr& element, size_t lanes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return intern(vectors_, {element.get(), lanes},
+                [&] { return std::make_shared<VectorType>(element, lanes); });
+}
+
+TypePtr TypeContext::get_function_type(const std::vector<TypePtr>& params, const TypePtr& ret) {
+  std::vector<const Type*> key;
+  key.reserve(params.size() + 1);
+  key.push_back(ret.get());
+  for (const auto& param : params) {
+    key.push_back(param.get());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  return intern(functions_, std::move(key),
+                [&] { return std::make_shared<FunctionType>(params, ret); });
+}
+
+TypePtr TypeContext::get_reference_type(const TypePtr& referent, bool is_mutable) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return intern(references_, {referent.get(), is_mutable ? 1u : 0u},
+                [&] { return std::make_shared<ReferenceType>(referent, is_mutable); });
+}
+
+TypeContext& get_type_context() {
+  static TypeContext context;
+  return context;
+}
+
 // Type factories
 TypePtr get_void_type() {
   return void_type;
@@ -341,11 +503,24 @@ TypePtr parse_type(std::string_view name) {
     return get_float64_type();
   if (name == "bool")
     return get_bool_type();
+
+  // <element>x<lanes> with a power-of-two lane count from 2 to 64
+  auto x = name.rfind('x');
+  if (x != std::string_view::npos && x > 0) {
+    size_t lanes = 0;
+    auto digits = name.substr(x + 1);
+    auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), lanes);
+    TypePtr element = parse_type(name.substr(0, x));
+    if (ec == std::errc() && ptr == digits.data() + digits.size() && lanes >= 2 && lanes <= 64 &&
+        (lanes & (lanes - 1)) == 0 && element && (element->is_numeric() || element->is_boolean())) {
+      return VectorType::get(element, lanes);
+    }
+  }
   return nullptr;
 }
 
-bool is_implicitly_convertible(TypePtr from, TypePtr to) {
-  if (from->equals(*to))
+bool is_implicitly_convertible(const TypePtr& from, const TypePtr& to) {
+  if (from == to || from->equals(*to))
     return true;
 
   // Numeric conversions
@@ -365,10 +540,23 @@ bool is_implicitly_convertible(TypePtr from, TypePtr to) {
   return false;
 }
 
-TypePtr common_type(TypePtr a, TypePtr b) {
-  if (a->equals(*b))
+TypePtr common_type(const TypePtr& a, const TypePtr& b) {
+  if (a == b || a->equals(*b))
     return a;
 
+  // A scalar operand is splat across the lanes of a vector operand
+  if (a->is_vector() || b->is_vector()) {
+    if (a->is_vector() && b->is_vector())
+      return nullptr;
+    const TypePtr& vector = a->is_vector() ? a : b;
+    const TypePtr& scalar = a->is_vector() ? b : a;
+    const auto& element = static_cast<const VectorType&>(*vector).element_type;
+    if ((scalar->is_numeric() && element->is_numeric()) ||
+        (scalar->is_boolean() && element->is_boolean()))
+      return vector;
+    return nullptr;
+  }
+
   if (a->is_floating_point() || b->is_floating_point()) {
     // Return the larger float type
     if (a->kind == TypeKind::Float64 || b->kind == TypeKind::Float64) {
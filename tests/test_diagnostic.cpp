@@ -92,6 +92,22 @@ TEST(source_file_content) {
   TEST_ASSERT_EQ(content, file.content());
 }
 
+TEST(source_file_lines_across_chunks) {
+  // Line lengths around the 16 bytes scanned at a time, including newlines at chunk edges
+  std::string content;
+  std::vector<std::string> lines;
+  for (size_t length = 0; length < 40; ++length) {
+    lines.push_back(std::string(length, static_cast<char>('a' + length % 26)));
+    content += lines.back() + "\n";
+  }
+  SourceFile file("test.tz", content);
+
+  TEST_ASSERT_EQ(lines.size() + 1, file.line_count());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    TEST_ASSERT_EQ(lines[i], file.get_line(static_cast<uint32_t>(i + 1)));
+  }
+}
+
 // =============================================================================
 // SourceManager Tests
 // =============================================================================
@@ -121,6 +137,23 @@ TEST(source_manager_load_and_get) {
   remove(temp_file);
 }
 
+TEST(source_manager_load_empty_file) {
+  const char* temp_file = "/tmp/tuz_test_empty.tz";
+  {
+    FILE* f = fopen(temp_file, "w");
+    fclose(f);
+  }
+
+  SourceManager manager;
+  auto file = manager.load_file(temp_file);
+
+  TEST_ASSERT_TRUE(file != nullptr);
+  TEST_ASSERT_EQ(0u, file->content().size());
+  TEST_ASSERT_EQ(1u, file->line_count());
+
+  remove(temp_file);
+}
+
 TEST(source_manager_load_nonexistent_file) {
   SourceManager manager;
   auto file = manager.load_file("/nonexistent/path/file.tz");
@@ -336,6 +369,66 @@ TEST(global_diagnostics_singleton) {
   TEST_ASSERT_EQ(&diag1, &diag2);
 }
 
+TEST(diagnostic_scope_redirects_global_diagnostics) {
+  DiagnosticEngine engine;
+  {
+    DiagnosticScope scope(engine);
+    TEST_ASSERT_EQ(&engine, &get_global_diagnostics());
+  }
+  TEST_ASSERT_TRUE(&engine != &get_global_diagnostics());
+}
+
+// =============================================================================
+// Buffered and JSON Consumer Tests
+// =============================================================================
+
+TEST(flush_diagnostics_orders_by_file_then_line) {
+  auto a = std::make_shared<SourceFile>("a.tz", "1\n2\n3\n");
+  auto b = std::make_shared<SourceFile>("b.tz", "1\n2\n3\n");
+  BufferedDiagnosticConsumer first;
+  BufferedDiagnosticConsumer second;
+  first.consume(DiagnosticMessage(DiagnosticLevel::Error, "b3", SourceLocation(3, 1), b));
+  first.consume(DiagnosticMessage(DiagnosticLevel::Warning, "a2 first", SourceLocation(2, 1), a));
+  second.consume(DiagnosticMessage(DiagnosticLevel::Error, "a2 second", SourceLocation(2, 1), a));
+  second.consume(DiagnosticMessage(DiagnosticLevel::Error, "a1", SourceLocation(1, 1), a));
+  TEST_ASSERT_TRUE(first.has_errors());
+
+  BufferedDiagnosticConsumer target;
+  flush_diagnostics({&first, &second}, target);
+
+  const auto& merged = target.diagnostics();
+  TEST_ASSERT_EQ(4u, merged.size());
+  TEST_ASSERT_EQ(std::string("a1"), merged[0].message);
+  TEST_ASSERT_EQ(std::string("a2 first"), merged[1].message);
+  TEST_ASSERT_EQ(std::string("a2 second"), merged[2].message);
+  TEST_ASSERT_EQ(std::string("b3"), merged[3].message);
+  TEST_ASSERT_TRUE(target.has_errors());
+  TEST_ASSERT_TRUE(first.diagnostics().empty());
+  TEST_ASSERT_FALSE(second.has_errors());
+}
+
+TEST(json_consumer_writes_one_object_per_line) {
+  std::stringstream out;
+  JsonDiagnosticConsumer consumer(out);
+  auto file = std::make_shared<SourceFile>("dir/a.tz", "fn main() {}");
+
+  DiagnosticMessage diagnostic(DiagnosticLevel::Error, "bad \"name\"", SourceLocation(1, 4, 4),
+                               file);
+  diagnostic.notes.emplace_back(DiagnosticLevel::Note, "see\there");
+  consumer.consume(diagnostic);
+  consumer.consume(DiagnosticMessage(DiagnosticLevel::Warning, "no location"));
+
+  TEST_ASSERT_TRUE(consumer.has_errors());
+  TEST_ASSERT_EQ(std::string("{\"level\":\"error\",\"file\":\"dir/a.tz\",\"line\":1,\"column\":4,"
+                             "\"length\":4,\"message\":\"bad \\\"name\\\"\",\"notes\":["
+                             "{\"level\":\"note\",\"message\":\"see\\there\"}]}\n"
+                             "{\"level\":\"warning\",\"message\":\"no location\"}\n"),
+                 out.str());
+
+  consumer.reset();
+  TEST_ASSERT_FALSE(consumer.has_errors());
+}
+
 // =============================================================================
 // CodeGenError Tests
 // =============================================================================
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <charconv>
 #include <cmath>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace tuz {
@@ -19,6 +24,10 @@ struct TestResult {
   int line;
 };
 
+// Runs the registered tests, sharded across worker threads. Each test runs on one thread and
+// records its assertions there, so tests must keep their own compiler state (contexts, JITs,
+// files); tests that share process-wide state are registered serial and run alone afterwards.
+// Reports are printed in registration order.
 class TestRunner {
 public:
   static TestRunner& instance() {
@@ -27,58 +36,44 @@ public:
   }
 
   void register_test(const std::string& name, std::function<void()> test_func,
-                     const std::string& file, int line) {
-    tests_.push_back({name, test_func, file, line});
+                     const std::string& file, int line, bool serial = false) {
+    tests_.push_back({name, test_func, file, line, serial});
   }
 
-  int run_all() {
-    int passed = 0;
-    int failed = 0;
-
+  int run_all(unsigned jobs = 1) {
     std::cout << "\n=== Running Tests ===\n\n";
 
-    for (auto& test : tests_) {
-      current_test_name_ = test.name;
-      test_results_.clear();
-
-      try {
-        test.func();
-
-        if (test_results_.empty()) {
-          std::cout << "[PASS] " << test.name << "\n";
-          passed++;
-        } else {
-          bool all_passed = true;
-          for (auto& result : test_results_) {
-            if (!result.passed) {
-              all_passed = false;
-              break;
-            }
-          }
+    reports_.assign(tests_.size(), {});
+    passed_.assign(tests_.size(), false);
+    finished_.assign(tests_.size(), false);
+    next_report_ = 0;
 
-          if (all_passed) {
-            std::cout << "[PASS] " << test.name << "\n";
-            passed++;
-          } else {
-            std::cout << "[FAIL] " << test.name << "\n";
-            failed++;
-            for (auto& result : test_results_) {
-              if (!result.passed) {
-                std::cout << "       " << result.message << "\n";
-                std::cout << "       at " << result.file << ":" << result.line << "\n";
-              }
-            }
-          }
+    std::atomic<size_t> next_test{0};
+    auto work = [&] {
+      for (size_t i; (i = next_test++) < tests_.size();) {
+        if (!tests_[i].serial) {
+          run_test(i);
         }
-      } catch (const std::exception& e) {
-        std::cout << "[FAIL] " << test.name << " (exception: " << e.what() << ")\n";
-        std::cout << "       at " << test.file << ":" << test.line << "\n";
-        failed++;
-      } catch (...) {
-        std::cout << "[FAIL] " << test.name << " (unknown exception)\n";
-        std::cout << "       at " << test.file << ":" << test.line << "\n";
-        failed++;
       }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < jobs; ++i) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    for (size_t i = 0; i < tests_.size(); ++i) {
+      if (tests_[i].serial) {
+        run_test(i);
+      }
+    }
+
+    int passed = 0;
+    int failed = 0;
+    for (bool test_passed : passed_) {
+      (test_passed ? passed : failed)++;
     }
 
     std::cout << "\n=== Results ===\n";
@@ -90,7 +85,33 @@ public:
   }
 
   void add_result(bool passed, const std::string& message, const std::string& file, int line) {
-    test_results_.push_back({current_test_name_, passed, message, file, line});
+    current().results.push_back({current().name, passed, message, file, line});
+  }
+
+  // Worker threads for run_all: -j N, -jN or --jobs=N on the command line, otherwise one per
+  // hardware thread. A count of 0 runs on one; a missing or non-numeric count exits with usage.
+  static unsigned parse_jobs(int argc, char** argv) {
+    unsigned jobs = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      std::string value;
+      if (arg == "-j") {
+        value = i + 1 < argc ? argv[++i] : "";
+      } else if (arg.rfind("--jobs=", 0) == 0) {
+        value = arg.substr(7);
+      } else if (arg.rfind("-j", 0) == 0) {
+        value = arg.substr(2);
+      } else {
+        continue;
+      }
+      unsigned parsed = 0;
+      auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+      if (value.empty() || error != std::errc() || end != value.data() + value.size()) {
+        usage(argv[0], "invalid job count '" + value + "'");
+      }
+      jobs = parsed;
+    }
+    return jobs > 0 ? jobs : 1;
   }
 
 private:
@@ -99,18 +120,82 @@ private:
     std::function<void()> func;
     std::string file;
     int line;
+    bool serial;
+  };
+
+  // The test running on this thread
+  struct Current {
+    std::string name;
+    std::vector<TestResult> results;
   };
 
+  [[noreturn]] static void usage(const char* program, const std::string& error) {
+    std::cerr << program << ": " << error << "\nusage: " << program << " [-j N | -jN | --jobs=N]\n";
+    std::exit(2);
+  }
+
+  static Current& current() {
+    thread_local Current test;
+    return test;
+  }
+
+  void run_test(size_t index) {
+    const Test& test = tests_[index];
+    current().name = test.name;
+    current().results.clear();
+
+    std::ostringstream report;
+    bool passed = false;
+    try {
+      test.func();
+
+      passed = true;
+      for (auto& result : current().results) {
+        passed &= result.passed;
+      }
+      if (passed) {
+        report << "[PASS] " << test.name << "\n";
+      } else {
+        report << "[FAIL] " << test.name << "\n";
+        for (auto& result : current().results) {
+          if (!result.passed) {
+            report << "       " << result.message << "\n";
+            report << "       at " << result.file << ":" << result.line << "\n";
+          }
+        }
+      }
+    } catch (const std::exception& e) {
+      report << "[FAIL] " << test.name << " (exception: " << e.what() << ")\n";
+      report << "       at " << test.file << ":" << test.line << "\n";
+    } catch (...) {
+      report << "[FAIL] " << test.name << " (unknown exception)\n";
+      report << "       at " << test.file << ":" << test.line << "\n";
+    }
+
+    // Print every finished report that no unfinished test comes before
+    std::lock_guard<std::mutex> lock(mutex_);
+    reports_[index] = report.str();
+    passed_[index] = passed;
+    finished_[index] = true;
+    while (next_report_ < tests_.size() && finished_[next_report_]) {
+      std::cout << reports_[next_report_++] << std::flush;
+    }
+  }
+
   std::vector<Test> tests_;
-  std::vector<TestResult> test_results_;
-  std::string current_test_name_;
+
+  std::mutex mutex_; // Guards the fields below while tests run
+  std::vector<std::string> reports_;
+  std::vector<bool> passed_;
+  std::vector<bool> finished_;
+  size_t next_report_ = 0;
 };
 
 // Test registration helper
 struct TestRegistrar {
   TestRegistrar(const std::string& name, std::function<void()> func, const std::string& file,
-                int line) {
-    TestRunner::instance().register_test(name, func, file, line);
+                int line, bool serial = false) {
+    TestRunner::instance().register_test(name, func, file, line, serial);
   }
 };
 
@@ -189,11 +274,20 @@ struct TestRegistrar {
   static tuz::test::TestRegistrar registrar_##name(#name, test_##name, __FILE__, __LINE__);        \
   void test_##name()
 
+// A test that shares process-wide state, such as the global diagnostic engine, and so runs
+// after the others, alone
+#define TEST_SERIAL(name)                                                                          \
+  void test_##name();                                                                              \
+  static tuz::test::TestRegistrar registrar_##name(#name, test_##name, __FILE__, __LINE__,         \
+                                                   true);                                          \
+  void test_##name()
+
 } // namespace test
 } // namespace tuz
 
 // Main entry point
 #define TEST_MAIN()                                                                                \
-  int main() {                                                                                     \
-    return tuz::test::TestRunner::instance().run_all();                                            \
+  int main(int argc, char** argv) {                                                                \
+    auto& runner = tuz::test::TestRunner::instance();                                              \
+    return runner.run_all(tuz::test::TestRunner::parse_jobs(argc, argv));                          \
   }
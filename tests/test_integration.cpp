@@ -1,21 +1,60 @@
 #include "test_framework.h"
+#include "tuz/cache.h"
 #include "tuz/codegen.h"
 #include "tuz/diagnostic.h"
 #include "tuz/driver.h"
 #include "tuz/lexer.h"
+#include "tuz/lto.h"
 #include "tuz/parser.h"
+#include "tuz/repl.h"
+#include "tuz/server.h"
+#include "tuz/session.h"
+#include "tuz/stats.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/BinaryFormat/Magic.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/TargetParser/Host.h>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace tuz;
 using namespace tuz::test;
 
-// Helper to create temp files
+// Helper to create temp files. Names are made unique by creating the file, so tests running at
+// the same time, in this process or another, never share one.
 class TempFile {
 public:
   TempFile(const std::string& content) {
-    filename_ = "/tmp/tuz_test_" + std::to_string(rand()) + ".tz";
+    llvm::SmallString<128> path;
+    if (auto err = llvm::sys::fs::createTemporaryFile("tuz_test", "tz", path)) {
+      throw std::runtime_error("could not create a temporary file: " + err.message());
+    }
+    filename_ = path.str().str();
     std::ofstream f(filename_);
     f << content;
   }
@@ -28,6 +67,20 @@ private:
   std::string filename_;
 };
 
+// Compile source in memory and run main through the JIT. Each test thread keeps a session per
+// optimization level, so its programs share one context and JIT instead of each creating them.
+static int32_t run_program(const std::string& source, int opt_level = 0) {
+  thread_local std::map<int, std::unique_ptr<CompilationSession>> sessions;
+  auto& session = sessions[opt_level];
+  if (!session) {
+    CodeGenOptions options;
+    options.opt_level = opt_level;
+    session = std::make_unique<CompilationSession>(options);
+  }
+  JitModule program = session->load(source);
+  return program.function<int32_t()>("main")();
+}
+
 // =============================================================================
 // Lexer Integration Tests
 // =============================================================================
@@ -55,6 +108,28 @@ TEST(lexer_handles_operators) {
   TEST_ASSERT_TRUE(tokens.size() >= 13);
 }
 
+TEST(lexer_classifies_keywords_and_operators) {
+  for (const auto& keyword : KeywordDefinitions) {
+    Lexer lexer(keyword.value);
+    TEST_ASSERT_TRUE(lexer.next_token().type == keyword.type);
+  }
+
+  std::string source = "fnx i128 returns _if -> - > != ! && & ||";
+  Lexer lexer(source);
+  auto tokens = lexer.tokenize();
+
+  TokenType expected[] = {TokenType::IDENTIFIER, TokenType::IDENTIFIER, TokenType::IDENTIFIER,
+                          TokenType::IDENTIFIER, TokenType::ARROW,      TokenType::MINUS,
+                          TokenType::GT,         TokenType::NEQ,        TokenType::NOT,
+                          TokenType::AND,        TokenType::AMPERSAND,  TokenType::OR,
+                          TokenType::END_OF_FILE};
+  TEST_ASSERT_EQ(std::size(expected), tokens.size());
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    TEST_ASSERT_TRUE(tokens[i].type == expected[i]);
+  }
+  TEST_ASSERT_EQ(22u, tokens[4].column);
+}
+
 TEST(lexer_handles_comments) {
   std::string source = "// this is a comment\nfn main() {}";
   Lexer lexer(source);
@@ -77,6 +152,28 @@ TEST(lexer_tracks_line_numbers) {
   TEST_ASSERT_EQ(3u, tokens[2].line);
 }
 
+TEST(lexer_tokens_reference_source) {
+  std::string source = "let name = \"plain\"; \"a\\tb\\\"c\"";
+  Lexer lexer(source);
+
+  auto tokens = lexer.tokenize();
+  auto in_source = [&](std::string_view text) {
+    return text.data() >= source.data() && text.data() < source.data() + source.size();
+  };
+
+  // Identifiers and unescaped literals are slices of the source
+  TEST_ASSERT_TRUE(tokens[1].type == TokenType::IDENTIFIER);
+  TEST_ASSERT_TRUE(tokens[1].text == "name");
+  TEST_ASSERT_TRUE(in_source(tokens[1].text));
+  TEST_ASSERT_TRUE(tokens[3].text == "plain");
+  TEST_ASSERT_TRUE(in_source(tokens[3].text));
+
+  // Escaped literals are decoded into the lexer's arena
+  TEST_ASSERT_TRUE(tokens[5].type == TokenType::STRING_LITERAL);
+  TEST_ASSERT_TRUE(tokens[5].text == "a\tb\"c");
+  TEST_ASSERT_FALSE(in_source(tokens[5].text));
+}
+
 // =============================================================================
 // Parser Integration Tests
 // =============================================================================
@@ -151,6 +248,84 @@ TEST(parser_parses_for_loop) {
   TEST_ASSERT_EQ(1u, program.declarations.size());
 }
 
+TEST(parser_reads_loop_hints) {
+  std::string source = R"(
+        fn main() -> int {
+            @vectorize(width=8, interleave=2) @unroll(4)
+            for i = 0, 10 { }
+            @parallel @unroll(full)
+            while false { }
+            return 0;
+        }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  auto& main_fn = static_cast<FunctionDecl&>(*program.declarations[0]);
+  auto& body = static_cast<BlockStmt&>(*main_fn.body);
+  auto& for_hints = static_cast<ForStmt&>(*body.statements[0]).hints;
+  TEST_ASSERT_TRUE(for_hints.vectorize.value_or(false));
+  TEST_ASSERT_EQ(8u, for_hints.vectorize_width);
+  TEST_ASSERT_EQ(2u, for_hints.interleave_count);
+  TEST_ASSERT_EQ(4u, for_hints.unroll_count);
+  TEST_ASSERT_FALSE(for_hints.parallel);
+
+  auto& while_hints = static_cast<WhileStmt&>(*body.statements[1]).hints;
+  TEST_ASSERT_TRUE(while_hints.parallel);
+  TEST_ASSERT_TRUE(while_hints.unroll_full);
+  TEST_ASSERT_FALSE(while_hints.vectorize.has_value());
+}
+
+TEST(parser_rejects_bad_loop_hints) {
+  std::vector<std::string> sources = {
+      "fn main() -> int { @fast for i = 0, 1 { } return 0; }",
+      "fn main() -> int { @unroll(0) for i = 0, 1 { } return 0; }",
+      "fn main() -> int { @vectorize(depth=2) for i = 0, 1 { } return 0; }",
+      "fn main() -> int { @parallel let x = 1; return x; }",
+  };
+  for (const auto& source : sources) {
+    Lexer lexer(source);
+    Parser parser(lexer);
+    TEST_ASSERT_THROW(parser.parse_program(), ParseError);
+  }
+}
+
+TEST(parser_reads_function_qualifiers) {
+  std::string source = R"(
+        export fn api() -> int { return 1; }
+        inline fn small() -> int { return 2; }
+        @noinline export fn big() -> int { return 3; }
+        fn plain() -> int { return 4; }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  TEST_ASSERT_EQ(4u, program.declarations.size());
+
+  auto function = [&](size_t i) -> FunctionDecl& {
+    return static_cast<FunctionDecl&>(*program.declarations[i]);
+  };
+  TEST_ASSERT_TRUE(function(0).is_export);
+  TEST_ASSERT_TRUE(function(1).inline_hint == InlineHint::Inline);
+  TEST_ASSERT_FALSE(function(1).is_export);
+  TEST_ASSERT_TRUE(function(2).is_export);
+  TEST_ASSERT_TRUE(function(2).inline_hint == InlineHint::NoInline);
+  TEST_ASSERT_FALSE(function(3).is_export);
+  TEST_ASSERT_TRUE(function(3).inline_hint == InlineHint::None);
+
+  std::vector<std::string> bad_sources = {
+      "@noinline inline fn f() { }", "@soa fn f() { }",
+      "@noinline struct S { x: int }", "@noinline(1) fn f() { }",
+      "export struct S { x: int }", "inline export fn f() { }",
+  };
+  for (const auto& bad : bad_sources) {
+    Lexer bad_lexer(bad);
+    Parser bad_parser(bad_lexer);
+    TEST_ASSERT_THROW(bad_parser.parse_program(), ParseError);
+  }
+}
+
 TEST(parser_parses_extern_function) {
   std::string source = "extern fn puts(s: *u8) -> i32;";
   Lexer lexer(source);
@@ -182,6 +357,62 @@ TEST(parser_throws_on_unexpected_token) {
   TEST_ASSERT_THROW(parser.parse_program(), ParseError);
 }
 
+TEST(parser_allocates_nodes_in_context) {
+  std::string source = "fn main() -> int { let x = 1 + 2; return x; }";
+  Program program;
+  {
+    Lexer lexer(source);
+    Parser parser(lexer);
+    program = parser.parse_program();
+    TEST_ASSERT_TRUE(program.context == parser.context());
+  }
+
+  // The program keeps its nodes alive after the parser is gone
+  TEST_ASSERT_TRUE(program.context != nullptr);
+  TEST_ASSERT_TRUE(program.context->bytes_allocated() > 0);
+  auto& func = static_cast<FunctionDecl&>(*program.declarations[0]);
+  TEST_ASSERT_EQ(std::string("main"), func.name);
+  auto& body = static_cast<BlockStmt&>(*func.body);
+  TEST_ASSERT_EQ(2u, body.statements.size());
+}
+
+TEST(parser_streams_tokens_from_lexer) {
+  std::string source;
+  for (int i = 0; i < 200; ++i) {
+    source += "fn fn_" + std::to_string(i) + "(a: int, b: int) -> int { let x = a * (b + " +
+              std::to_string(i) + "); if x > 10 { return x; } return a; }\n";
+  }
+
+  Lexer token_lexer(source);
+  auto tokens = token_lexer.tokenize();
+  auto token_count = tokens.size();
+  Parser buffered(std::move(tokens));
+  auto expected = buffered.parse_program();
+
+  Lexer lexer(source);
+  Parser streaming(lexer);
+  auto program = streaming.parse_program();
+
+  TEST_ASSERT_EQ(expected.declarations.size(), program.declarations.size());
+  TEST_ASSERT_EQ(token_count, streaming.token_count());
+  auto& last = static_cast<FunctionDecl&>(*program.declarations.back());
+  TEST_ASSERT_EQ(std::string("fn_199"), last.name);
+}
+
+TEST(parser_streaming_error_has_location) {
+  std::string source = "fn main() -> int {\n  let\n}";
+  Lexer lexer(source);
+  Parser parser(lexer);
+
+  try {
+    parser.parse_program();
+    TEST_ASSERT_FALSE(true); // Should have thrown
+  } catch (const ParseError& e) {
+    TEST_ASSERT_EQ(3u, e.line);
+    TEST_ASSERT_EQ(1u, e.column);
+  }
+}
+
 TEST(parser_error_has_location) {
   std::string source = "fn main() -> int { let }";
   Lexer lexer(source);
@@ -197,6 +428,64 @@ TEST(parser_error_has_location) {
   }
 }
 
+// =============================================================================
+// Type Tests
+// =============================================================================
+
+TEST(types_are_interned) {
+  auto int_ptr = PointerType::get(get_int32_type());
+  TEST_ASSERT_TRUE(int_ptr == PointerType::get(get_int32_type()));
+  TEST_ASSERT_TRUE(int_ptr != PointerType::get(get_int64_type()));
+  TEST_ASSERT_TRUE(PointerType::get(int_ptr) ==
+                   PointerType::get(PointerType::get(get_int32_type())));
+
+  TEST_ASSERT_TRUE(ArrayType::get(get_uint8_type(), 4) == ArrayType::get(get_uint8_type(), 4));
+  TEST_ASSERT_TRUE(ArrayType::get(get_uint8_type(), 4) != ArrayType::get(get_uint8_type(), 8));
+
+  auto fn = FunctionType::get({get_int32_type(), int_ptr}, get_void_type());
+  TEST_ASSERT_TRUE(fn == FunctionType::get({get_int32_type(), int_ptr}, get_void_type()));
+  TEST_ASSERT_TRUE(fn != FunctionType::get({int_ptr, get_int32_type()}, get_void_type()));
+
+  TEST_ASSERT_TRUE(ReferenceType::get(get_bool_type(), true) !=
+                   ReferenceType::get(get_bool_type(), false));
+
+  TEST_ASSERT_TRUE(common_type(int_ptr, PointerType::get(get_int32_type())) == int_ptr);
+  TEST_ASSERT_TRUE(is_implicitly_convertible(int_ptr, PointerType::get(get_uint8_type())));
+}
+
+TEST(types_of_a_program_die_with_it) {
+  // Interning *Node and [Node; 4] must not keep the program's struct alive
+  std::weak_ptr<StructType> node;
+  {
+    std::string source = R"(
+          struct Node { value: i32, next: *Node }
+          fn main() -> int { let mut nodes: [Node; 4]; let p = &nodes[0]; return p.value; }
+      )";
+    Lexer lexer(source);
+    Parser parser(lexer);
+    auto program = parser.parse_program();
+    node = program.context->struct_type("Node");
+    CodeGenerator codegen;
+    codegen.generate(program);
+  }
+  TEST_ASSERT_TRUE(node.expired());
+}
+
+TEST(types_parse_vector_names) {
+  auto f32x4 = parse_type("f32x4");
+  TEST_ASSERT_TRUE(f32x4 == VectorType::get(get_float32_type(), 4));
+  TEST_ASSERT_EQ(std::string("f32x4"), f32x4->to_string());
+  TEST_ASSERT_EQ(16u, f32x4->size());
+  TEST_ASSERT_TRUE(parse_type("u8x16") == VectorType::get(get_uint8_type(), 16));
+  TEST_ASSERT_TRUE(parse_type("f32x3") == nullptr);
+  TEST_ASSERT_TRUE(parse_type("i32x128") == nullptr);
+  TEST_ASSERT_TRUE(parse_type("x4") == nullptr);
+
+  // Scalars splat across the lanes of the other operand
+  TEST_ASSERT_TRUE(common_type(f32x4, get_int32_type()) == f32x4);
+  TEST_ASSERT_TRUE(common_type(f32x4, parse_type("f32x8")) == nullptr);
+}
+
 // =============================================================================
 // CodeGen Integration Tests
 // =============================================================================
@@ -384,6 +673,391 @@ TEST(codegen_error_includes_name_in_message) {
   }
 }
 
+TEST(codegen_rejects_assignment_to_immutable) {
+  std::string source = "fn main() -> int { let x = 1; x = 2; return x; }";
+  Lexer lexer(source);
+  Parser parser(lexer.tokenize());
+  auto program = parser.parse_program();
+
+  CodeGenerator codegen;
+  TEST_ASSERT_THROW(codegen.generate(program), CodeGenError);
+}
+
+TEST(codegen_rejects_wrong_argument_count) {
+  std::string source = R"(
+        fn add(a: int, b: int) -> int { return a + b; }
+        fn main() -> int { return add(1); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer.tokenize());
+  auto program = parser.parse_program();
+
+  CodeGenerator codegen;
+  TEST_ASSERT_THROW(codegen.generate(program), CodeGenError);
+}
+
+TEST(codegen_optimize_promotes_allocas) {
+  std::string source = R"(
+        fn fib_iter(n: int) -> int {
+            let mut a = 0;
+            let mut b = 1;
+            let mut i = 0;
+            while i < n {
+                let temp = a + b;
+                a = b;
+                b = temp;
+                i = i + 1;
+            }
+            return a;
+        }
+    )";
+  Lexer lexer(source);
+  auto tokens = lexer.tokenize();
+  Parser parser(tokens);
+  auto program = parser.parse_program();
+
+  CodeGenOptions options;
+  options.opt_level = 2;
+  CodeGenerator codegen(options);
+  codegen.generate(program);
+  TEST_ASSERT_NO_THROW(codegen.optimize());
+
+  auto module = codegen.get_module();
+  size_t allocas = 0;
+  for (auto& function : *module) {
+    for (auto& block : function) {
+      for (auto& inst : block) {
+        if (llvm::isa<llvm::AllocaInst>(inst))
+          allocas++;
+      }
+    }
+  }
+  TEST_ASSERT_EQ(0u, allocas);
+}
+
+TEST(codegen_applies_native_cpu_attributes) {
+  std::string source = "fn main() -> int { return 0; }";
+  Lexer lexer(source);
+  auto tokens = lexer.tokenize();
+  Parser parser(tokens);
+  auto program = parser.parse_program();
+
+  CodeGenOptions options;
+  options.cpu = "native";
+  CodeGenerator codegen(options);
+  codegen.generate(program);
+  TEST_ASSERT_NO_THROW(codegen.optimize());
+
+  auto module = codegen.get_module();
+  llvm::Function* main_fn = module->getFunction("main");
+  TEST_ASSERT_TRUE(main_fn->hasFnAttribute("target-cpu"));
+  TEST_ASSERT_EQ(llvm::sys::getHostCPUName().str(),
+                 main_fn->getFnAttribute("target-cpu").getValueAsString().str());
+}
+
+TEST(codegen_rejects_unknown_target) {
+  CodeGenOptions options;
+  options.target_triple = "nonexistent-unknown-none";
+  CodeGenerator codegen(options);
+  TEST_ASSERT_THROW(codegen.optimize(), CodeGenError);
+}
+
+TEST(codegen_lowers_loop_hints_to_metadata) {
+  std::string source = R"(
+        fn sum(n: i64) -> i64 {
+            let mut total: i64 = 0;
+            @vectorize(width=4) @unroll(2) @parallel
+            for i = 0, n { total = total + i; }
+            return total;
+        }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+
+  llvm::Function* sum = module->getFunction("sum");
+  llvm::MDNode* loop_id = nullptr;
+  for (auto& block : *sum) {
+    if (auto* md = block.getTerminator()->getMetadata(llvm::LLVMContext::MD_loop))
+      loop_id = md;
+  }
+  TEST_ASSERT_TRUE(loop_id != nullptr);
+  TEST_ASSERT_TRUE(loop_id->getOperand(0) == loop_id);
+
+  std::vector<std::string> properties;
+  for (unsigned i = 1; i < loop_id->getNumOperands(); ++i) {
+    auto* property = llvm::cast<llvm::MDNode>(loop_id->getOperand(i));
+    properties.push_back(llvm::cast<llvm::MDString>(property->getOperand(0))->getString().str());
+  }
+  std::vector<std::string> expected = {"llvm.loop.vectorize.enable", "llvm.loop.vectorize.width",
+                                       "llvm.loop.unroll.count", "llvm.loop.parallel_accesses"};
+  TEST_ASSERT_TRUE(properties == expected);
+
+  // The loop's accumulator updates are in the parallel access group; the loop variable is i64
+  size_t grouped = 0;
+  for (auto& block : *sum) {
+    for (auto& inst : block) {
+      if (inst.getMetadata(llvm::LLVMContext::MD_access_group))
+        grouped++;
+      if (auto* alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst)) {
+        if (alloca->getName() == "i")
+          TEST_ASSERT_TRUE(alloca->getAllocatedType()->isIntegerTy(64));
+      }
+    }
+  }
+  TEST_ASSERT_TRUE(grouped > 0);
+}
+
+TEST(codegen_partitions_function_bodies) {
+  std::string source = R"(
+        let mut counter: int = 7;
+        fn a() -> int { return counter; }
+        fn b() -> int { return a() + 1; }
+        fn c() -> int { return b() + 1; }
+        fn main() -> int { return c(); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  // Every unit shares one resolved program and defines a disjoint share of the bodies
+  std::vector<std::string> defined;
+  for (unsigned unit = 0; unit < 3; ++unit) {
+    CodeGenOptions options;
+    options.unit_index = unit;
+    options.unit_count = 3;
+    CodeGenerator codegen(options);
+    codegen.generate(program);
+    TEST_ASSERT_TRUE(program.is_resolved);
+    TEST_ASSERT_NO_THROW(codegen.optimize());
+
+    auto module = codegen.get_module();
+    for (auto& function : *module) {
+      if (!function.isDeclaration())
+        defined.push_back(function.getName().str());
+    }
+    TEST_ASSERT_TRUE(module->getFunction("main") != nullptr);
+    TEST_ASSERT_EQ(unit == 0, !module->getGlobalVariable("counter")->isDeclaration());
+  }
+
+  std::vector<std::string> expected = {"a", "b", "c", "main"};
+  TEST_ASSERT_TRUE(defined == expected);
+}
+
+TEST(codegen_instruments_for_profiles) {
+  std::string source = R"(
+        fn pick(x: int) -> int {
+            if x > 10 { return 1; }
+            return 2;
+        }
+        fn main() -> int { return pick(3); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  // Counters are inserted and lowered at every level, unoptimized builds included
+  for (int opt_level : {0, 2}) {
+    CodeGenOptions options;
+    options.opt_level = opt_level;
+    options.profile_generate = true;
+    options.profile_output = "/tmp/tuz-%m.profraw";
+    CodeGenerator codegen(options);
+    codegen.generate(program);
+    TEST_ASSERT_NO_THROW(codegen.optimize());
+
+    auto module = codegen.get_module();
+    bool counters = false;
+    for (auto& global : module->globals()) {
+      counters |= global.getName().starts_with("__profc_");
+    }
+    TEST_ASSERT_TRUE(counters);
+    TEST_ASSERT_TRUE(module->getGlobalVariable("__llvm_profile_filename") != nullptr);
+  }
+
+  // A profile that cannot be read is an error rather than a silent static build
+  CodeGenOptions options;
+  options.opt_level = 2;
+  options.profile_use = "/nonexistent/tuz.profdata";
+  CodeGenerator codegen(options);
+  codegen.generate(program);
+  TEST_ASSERT_THROW(codegen.optimize(), CodeGenError);
+}
+
+TEST(codegen_sets_linkage_and_function_attributes) {
+  std::string source = R"(
+        extern fn abs(x: i32) -> i32;
+        fn helper(x: int) -> int { return abs(x) + 1; }
+        export fn api(x: int) -> int { return helper(x); }
+        inline fn small(x: int) -> int { return x * 2; }
+        @noinline fn big(x: int) -> int { return x * 3; }
+        fn main() -> int { return api(1) + small(2) + big(3); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+
+  // Only exported functions, main and externs are visible outside the module
+  TEST_ASSERT_TRUE(module->getFunction("helper")->hasInternalLinkage());
+  TEST_ASSERT_TRUE(module->getFunction("small")->hasInternalLinkage());
+  TEST_ASSERT_TRUE(module->getFunction("api")->hasExternalLinkage());
+  TEST_ASSERT_TRUE(module->getFunction("main")->hasExternalLinkage());
+  TEST_ASSERT_TRUE(module->getFunction("abs")->hasExternalLinkage());
+
+  TEST_ASSERT_TRUE(module->getFunction("small")->hasFnAttribute(llvm::Attribute::InlineHint));
+  TEST_ASSERT_TRUE(module->getFunction("big")->hasFnAttribute(llvm::Attribute::NoInline));
+  for (auto& function : *module) {
+    if (!function.isIntrinsic()) {
+      TEST_ASSERT_TRUE(function.doesNotThrow());
+    }
+  }
+
+  // Split units reach into each other, so local functions stay external but hidden
+  CodeGenOptions split;
+  split.unit_count = 2;
+  CodeGenerator unit(split);
+  unit.generate(program);
+  auto unit_module = unit.get_module();
+  auto* helper = unit_module->getFunction("helper");
+  TEST_ASSERT_TRUE(helper->hasExternalLinkage());
+  TEST_ASSERT_TRUE(helper->hasHiddenVisibility());
+  TEST_ASSERT_FALSE(unit_module->getFunction("api")->hasHiddenVisibility());
+}
+
+TEST(codegen_drops_unused_local_functions) {
+  std::string source = R"(
+        fn unused(x: int) -> int { return x + 1; }
+        export fn kept(x: int) -> int { return x + 2; }
+        fn main() -> int { return 0; }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  CodeGenOptions options;
+  options.opt_level = 2;
+  CodeGenerator codegen(options);
+  codegen.generate(program);
+  codegen.optimize();
+  auto module = codegen.get_module();
+  TEST_ASSERT_TRUE(module->getFunction("unused") == nullptr);
+  TEST_ASSERT_TRUE(module->getFunction("kept") != nullptr);
+}
+
+// =============================================================================
+// Constant Evaluation Tests
+// =============================================================================
+
+TEST(codegen_evaluates_global_initializers) {
+  std::string source = R"(
+        let K = 1024 * 4;
+        let FLAG = !true;
+        let HALF = 7.0 / 2.0;
+        let mut total: i64 = square(12) + K;
+        fn square(x: int) -> int {
+            let mut r = 0;
+            for i = 0, x { r = r + x; }
+            return r;
+        }
+        fn main() -> int { return K / 8 + square(3); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+
+  auto initializer = [&](const char* name) {
+    return module->getGlobalVariable(name, true)->getInitializer();
+  };
+  TEST_ASSERT_EQ(4096, llvm::cast<llvm::ConstantInt>(initializer("K"))->getSExtValue());
+  TEST_ASSERT_TRUE(llvm::cast<llvm::ConstantInt>(initializer("FLAG"))->isZero());
+  TEST_ASSERT_TRUE(llvm::cast<llvm::ConstantFP>(initializer("HALF"))->isExactlyValue(3.5));
+  TEST_ASSERT_EQ(4240, llvm::cast<llvm::ConstantInt>(initializer("total"))->getSExtValue());
+
+  // Without optimization, main returns the folded value: 4096 / 8 + 9
+  llvm::Constant* returned = nullptr;
+  for (auto& block : *module->getFunction("main")) {
+    if (auto* ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator()))
+      returned = llvm::dyn_cast<llvm::Constant>(ret->getReturnValue());
+  }
+  TEST_ASSERT_TRUE(returned != nullptr);
+  TEST_ASSERT_EQ(521, llvm::cast<llvm::ConstantInt>(returned)->getSExtValue());
+}
+
+TEST(codegen_interprets_each_distinct_call_once) {
+  // fib(40) recursing naively takes 10^8 calls; remembered calls make it 41. The calls to spin
+  // run out of steps, and after the first fails the others are not interpreted again.
+  std::string source = R"(
+        fn fib(n: int) -> int {
+            if n < 2 { return n; }
+            return fib(n - 1) + fib(n - 2);
+        }
+        fn spin(n: int) -> int {
+            let mut i = n;
+            while i >= 0 { i = i + 1; }
+            return i;
+        }
+        fn main() -> int {
+            let a = fib(40);
+            return a + spin(1) + spin(1) + spin(1) + spin(1) + spin(1) + spin(1) + spin(1);
+        }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+  size_t fib_calls = 0;
+  size_t spin_calls = 0;
+  for (auto& inst : llvm::instructions(*module->getFunction("main"))) {
+    if (auto* call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+      fib_calls += call->getCalledFunction()->getName() == "fib";
+      spin_calls += call->getCalledFunction()->getName() == "spin";
+    }
+  }
+  TEST_ASSERT_EQ(0u, fib_calls);
+  TEST_ASSERT_EQ(7u, spin_calls);
+}
+
+TEST(codegen_folds_with_generated_code_semantics) {
+  // Narrow types wrap, and reads of mutable globals are left to run time
+  std::string source = R"(
+        let BYTE: u8 = 200 + 100;
+        let mut scale = 3;
+        fn scaled(x: int) -> int { return x * scale; }
+        fn main() -> int { return BYTE + scaled(2); }
+    )";
+  TEST_ASSERT_EQ(50, run_program(source));
+}
+
+TEST(codegen_rejects_non_constant_global_initializers) {
+  std::vector<std::string> sources = {
+      "extern fn rand() -> int; let SEED = rand(); fn main() -> int { return SEED; }",
+      "let mut m = 1; let n = m; fn main() -> int { return n; }",
+      "let a = b + 1; let b = a; fn main() -> int { return a; }",
+      "let z = 0; let q = 1 / z; fn main() -> int { return q; }",
+  };
+  for (const auto& source : sources) {
+    Lexer lexer(source);
+    Parser parser(lexer);
+    auto program = parser.parse_program();
+    CodeGenerator codegen;
+    TEST_ASSERT_THROW(codegen.generate(program), CodeGenError);
+  }
+}
+
 // =============================================================================
 // Full Pipeline Tests
 // =============================================================================
@@ -447,4 +1121,1111 @@ TEST(full_pipeline_extern) {
   TEST_ASSERT_NO_THROW(codegen.generate(program));
 }
 
+TEST_SERIAL(full_pipeline_caches_objects_per_input) {
+  TempFile lib("export fn helper() -> int { return 41; }");
+  TempFile main_file("extern fn helper() -> int;\nfn main() -> int { return helper() + 1; }");
+  TempFile cache_marker("");
+  std::string cache_dir = cache_marker.path() + ".cache";
+
+  CompileOptions options;
+  options.input_files = {lib.path(), main_file.path()};
+  options.emit_object = true;
+  options.cache_dir = cache_dir;
+  TEST_ASSERT_TRUE(Driver::compile(options));
+
+  // One object per input, written next to it, and one cache entry per input
+  std::vector<std::string> objects;
+  for (const auto& input : options.input_files) {
+    objects.push_back(input.substr(0, input.size() - 3) + ".o");
+    TEST_ASSERT_TRUE(llvm::sys::fs::exists(objects.back()));
+    std::remove(objects.back().c_str());
+  }
+
+  ObjectCache cache(cache_dir);
+  auto key =
+      ObjectCache::compute_key("export fn helper() -> int { return 41; }", CodeGenOptions{}, false);
+  auto cached = cache.lookup(key);
+  TEST_ASSERT_TRUE(cached.has_value());
+  TEST_ASSERT_EQ(1u, cached->size());
+  TEST_ASSERT_EQ(1u, cache.hits());
+
+  // A second build is served from the cache
+  TEST_ASSERT_TRUE(Driver::compile(options));
+  for (const auto& object : objects) {
+    TEST_ASSERT_TRUE(llvm::sys::fs::exists(object));
+    std::remove(object.c_str());
+  }
+
+  llvm::sys::fs::remove_directories(cache_dir);
+}
+
+TEST_SERIAL(full_pipeline_thin_lto_inlines_across_files) {
+  TempFile lib("let mut scale: int = 3;\n"
+               "export fn helper(x: int) -> int { return x * scale; }\n"
+               "export fn api(x: int) -> int { return x + scale; }");
+  TempFile main_file("extern fn helper(x: int) -> int;\nfn main() -> int { return helper(14); }");
+
+  // -c -flto=thin writes bitcode with a module summary in place of each object
+  CompileOptions options;
+  options.input_files = {lib.path(), main_file.path()};
+  options.emit_object = true;
+  options.thin_lto = true;
+  options.optimize = true;
+  options.opt_level = 2;
+  TEST_ASSERT_TRUE(Driver::compile(options));
+
+  std::vector<std::string> bitcode;
+  for (const auto& input : options.input_files) {
+    bitcode.push_back(input.substr(0, input.size() - 3) + ".o");
+    auto buffer = llvm::MemoryBuffer::getFile(bitcode.back());
+    TEST_ASSERT_TRUE(buffer && llvm::identify_magic((*buffer)->getBuffer()) ==
+                                   llvm::file_magic::bitcode);
+  }
+
+  CodeGenOptions codegen_options;
+  codegen_options.opt_level = 2;
+  codegen_options.thin_lto = true;
+  std::vector<std::string> objects;
+  TEST_ASSERT_NO_THROW(run_thin_lto(bitcode, codegen_options, ThinLinkOptions{}, objects));
+  TEST_ASSERT_EQ(2u, objects.size());
+
+  // helper is imported into main's module and inlined, so no object refers to it any more.
+  // Exported functions stay defined for other objects, even when nothing in the link calls
+  // them; the global is internalized.
+  bool refers_to_helper = false;
+  bool defines_api = false;
+  bool exports_scale = false;
+  for (const auto& path : objects) {
+    auto object = llvm::object::ObjectFile::createObjectFile(path);
+    TEST_ASSERT_TRUE(static_cast<bool>(object));
+    if (!object) {
+      llvm::consumeError(object.takeError());
+      continue;
+    }
+    for (const auto& symbol : object->getBinary()->symbols()) {
+      auto name = symbol.getName();
+      auto flags = symbol.getFlags();
+      if (!name || !flags) {
+        continue;
+      }
+      if (*flags & llvm::object::SymbolRef::SF_Undefined) {
+        refers_to_helper |= *name == "helper";
+      } else if (*flags & llvm::object::SymbolRef::SF_Global) {
+        defines_api |= *name == "api";
+        exports_scale |= *name == "scale";
+      }
+    }
+  }
+  TEST_ASSERT_FALSE(refers_to_helper);
+  TEST_ASSERT_TRUE(defines_api);
+  TEST_ASSERT_FALSE(exports_scale);
+  for (const auto& file : bitcode) {
+    std::remove(file.c_str());
+  }
+  for (const auto& file : objects) {
+    std::remove(file.c_str());
+  }
+}
+
+#ifdef TUZ_HAVE_LLD
+TEST(lld_links_programs_that_run) {
+  TempFile source("extern fn puts(s: *u8) -> i32;\n"
+                  "fn main() -> int { puts(\"linked in process\"); return 42; }");
+  std::string program = source.path() + ".out";
+  std::string cwd = llvm::sys::path::parent_path(source.path()).str();
+  std::ostringstream out;
+  std::ostringstream err;
+  TEST_ASSERT_EQ(0, Driver::run_request({"-v", "-fuse-ld=lld", source.path(), "-o", program}, cwd,
+                                        out, err));
+
+  // Without a C runtime to hand to lld the driver falls back to clang, leaving nothing to check
+  std::string log = out.str();
+  if (log.find("Linking in process") != std::string::npos) {
+    TEST_ASSERT_TRUE(log.find("crtbeginS.o") != std::string::npos);
+    TEST_ASSERT_TRUE(log.find("-lgcc") != std::string::npos);
+    TEST_ASSERT_EQ(42, llvm::sys::ExecuteAndWait(program, {program}));
+  }
+  std::remove(program.c_str());
+}
+#endif
+
+TEST(globals_of_different_files_do_not_clash) {
+  // Each file's count is its own, so the link sees no duplicate symbol
+  TempFile lib("let count: int = 40;\nexport fn forty() -> int { return count; }");
+  TempFile main_file("extern fn forty() -> int;\nlet mut count: int = 2;\n"
+                     "fn main() -> int { return forty() + count; }");
+  std::string program = main_file.path() + ".out";
+  std::string cwd = llvm::sys::path::parent_path(main_file.path()).str();
+  std::ostringstream out;
+  std::ostringstream err;
+  TEST_ASSERT_EQ(0, Driver::run_request({lib.path(), main_file.path(), "-o", program}, cwd, out,
+                                        err));
+  TEST_ASSERT_EQ(42, llvm::sys::ExecuteAndWait(program, {program}));
+  std::remove(program.c_str());
+}
+
+TEST(parallel_codegen_reports_each_error_once) {
+  // Four bodies make four codegen units; only the one defining globals checks them
+  TempFile source(R"(
+        extern fn rand() -> int;
+        let seed = rand();
+        fn a() -> int { return 1; }
+        fn b() -> int { return 2; }
+        fn c() -> int { return 3; }
+        fn main() -> int { return a() + b() + c(); }
+    )");
+  std::string cwd = llvm::sys::path::parent_path(source.path()).str();
+  std::ostringstream out;
+  std::ostringstream err;
+  // Only builds that link are split; the error stops this one before it links
+  TEST_ASSERT_EQ(1, Driver::run_request({"-j4", source.path(), "-o", source.path() + ".out"}, cwd,
+                                        out, err));
+
+  std::string errors = err.str();
+  size_t reports = 0;
+  for (size_t at = errors.find("is not a constant expression"); at != std::string::npos;
+       at = errors.find("is not a constant expression", at + 1)) {
+    ++reports;
+  }
+  TEST_ASSERT_EQ(1u, reports);
+}
+
+TEST(output_errors_go_to_the_request_error_stream) {
+  TempFile source("fn main() -> int { return 0; }");
+  std::string cwd = llvm::sys::path::parent_path(source.path()).str();
+  std::string missing = source.path() + ".missing/out";
+  for (const char* mode : {"-S", "-emit-bc"}) {
+    std::ostringstream out;
+    std::ostringstream err;
+    TEST_ASSERT_EQ(1, Driver::run_request({mode, source.path(), "-o", missing}, cwd, out, err));
+    TEST_ASSERT_TRUE(err.str().find("could not open file") != std::string::npos);
+  }
+}
+
+TEST(compile_server_answers_concurrent_requests) {
+  TempFile good("fn main() -> int { return 7; }");
+  TempFile bad("fn main() -> int {\n    return missing;\n}");
+  std::string socket_path = good.path() + ".sock";
+
+  CompileServer server(socket_path, 2);
+  std::ostringstream listen_errors;
+  TEST_ASSERT_TRUE(server.listen(listen_errors));
+  std::thread serving([&] { server.serve(); });
+
+  // Paths are relative to the client's directory, so the server must not resolve them itself
+  std::string cwd = llvm::sys::path::parent_path(good.path()).str();
+  std::string input = llvm::sys::path::filename(good.path()).str();
+  std::vector<std::optional<int>> results(4);
+  std::vector<std::thread> clients;
+  for (size_t i = 0; i < results.size(); ++i) {
+    clients.emplace_back([&, i] {
+      std::ostringstream out;
+      std::ostringstream err;
+      results[i] = send_compile_request(socket_path, cwd,
+                                        {"-c", "-O2", input, "-o", input + std::to_string(i)},
+                                        out, err);
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  for (size_t i = 0; i < results.size(); ++i) {
+    TEST_ASSERT_TRUE(results[i] == 0);
+    std::string object = good.path() + std::to_string(i) + ".o";
+    TEST_ASSERT_TRUE(llvm::sys::fs::exists(object));
+    std::remove(object.c_str());
+  }
+
+  // Diagnostics come back to the client instead of going to the server's stderr
+  std::ostringstream out;
+  std::ostringstream err;
+  auto failed = send_compile_request(socket_path, cwd, {"-c", bad.path()}, out, err);
+  TEST_ASSERT_TRUE(failed == 1);
+  TEST_ASSERT_TRUE(err.str().find("unknown variable: 'missing'") != std::string::npos);
+
+  server.stop();
+  serving.join();
+  TEST_ASSERT_FALSE(send_compile_request(socket_path, cwd, {"-c", input}, out, err));
+}
+
+// Connect to a Unix socket as a client that speaks the wire format by hand; -1 on failure
+static int connect_raw(const std::string& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.data(), std::min(path.size(), sizeof(address.sun_path) - 1));
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+TEST(compile_server_drops_stalled_and_oversized_requests) {
+  TempFile good("fn main() -> int { return 7; }");
+  std::string socket_path = good.path() + ".sock";
+  CompileServer server(socket_path, 1, std::chrono::milliseconds(200));
+  std::ostringstream listen_errors;
+  TEST_ASSERT_TRUE(server.listen(listen_errors));
+  std::thread serving([&] { server.serve(); });
+
+  // A client that sends part of a request and stalls is closed on, freeing the only worker
+  int stalled = connect_raw(socket_path);
+  TEST_ASSERT_TRUE(stalled >= 0);
+  uint32_t count = 2;
+  TEST_ASSERT_EQ(static_cast<ssize_t>(sizeof(count)), send(stalled, &count, sizeof(count), 0));
+  char byte = 0;
+  TEST_ASSERT_EQ(static_cast<ssize_t>(0), recv(stalled, &byte, 1, 0));
+  close(stalled);
+
+  // So is one whose length prefix is larger than any request may be
+  int oversized = connect_raw(socket_path);
+  TEST_ASSERT_TRUE(oversized >= 0);
+  uint32_t header[] = {2, 0xffffffffu};
+  TEST_ASSERT_EQ(static_cast<ssize_t>(sizeof(header)), send(oversized, header, sizeof(header), 0));
+  TEST_ASSERT_EQ(static_cast<ssize_t>(0), recv(oversized, &byte, 1, 0));
+  close(oversized);
+
+  std::string cwd = llvm::sys::path::parent_path(good.path()).str();
+  std::ostringstream out;
+  std::ostringstream err;
+  std::vector<std::string> args = {"-c", good.path(), "-o", good.path() + "s"};
+  TEST_ASSERT_TRUE(send_compile_request(socket_path, cwd, args, out, err) == 0);
+  TEST_ASSERT_TRUE(llvm::sys::fs::exists(good.path() + "s.o"));
+  std::remove((good.path() + "s.o").c_str());
+
+  server.stop();
+  serving.join();
+}
+
+// Bounds-check traps left in a function
+static size_t count_bounds_traps(llvm::Function& function) {
+  size_t traps = 0;
+  for (auto& inst : llvm::instructions(function)) {
+    auto* call = llvm::dyn_cast<llvm::CallInst>(&inst);
+    if (call && call->getIntrinsicID() == llvm::Intrinsic::trap) {
+      ++traps;
+    }
+  }
+  return traps;
+}
+
+TEST(bounds_checks_skip_indexes_proven_in_range) {
+  std::string source = R"(
+        fn fill(n: int) -> int {
+            let mut a: [int; 8];
+            for i = 0, 8 { a[i] = i; }
+            for i = 1, 8 { a[i - 1] = a[i] + a[7 - i]; }
+            for i = 0, n { a[i] = 0; }
+            return a[2];
+        }
+        fn main() -> int { return fill(3); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  CodeGenOptions options;
+  options.bounds_check = true;
+  CodeGenerator codegen(options);
+  codegen.generate(program);
+  auto module = codegen.get_module();
+  TEST_ASSERT_FALSE(llvm::verifyModule(*module, &llvm::errs()));
+
+  // Only a[i] under 'for i = 0, n' is checked at run time; the one trap serves every check
+  llvm::Function* fill = module->getFunction("fill");
+  TEST_ASSERT_EQ(1u, count_bounds_traps(*fill));
+  size_t checks = 0;
+  for (auto& inst : llvm::instructions(*fill)) {
+    auto* branch = llvm::dyn_cast<llvm::BranchInst>(&inst);
+    if (branch && branch->isConditional() && branch->getSuccessor(1)->getName() == "outofbounds") {
+      ++checks;
+    }
+  }
+  TEST_ASSERT_EQ(1u, checks);
+
+  // Checked code computes the same results
+  TEST_ASSERT_EQ(run_program(source, 2), run_program(source, 0));
+  Lexer run_lexer(source);
+  Parser run_parser(run_lexer);
+  auto checked_program = run_parser.parse_program();
+  options.opt_level = 2;
+  CodeGenerator checked(options);
+  checked.generate(checked_program);
+  checked.optimize();
+  TEST_ASSERT_EQ(run_program(source, 0), checked.execute_jit());
+}
+
+TEST(bounds_checks_keep_loop_variables_whose_address_is_taken) {
+  // Writing through &i moves the variable out of the loop's range
+  std::string source = R"(
+        fn poke() -> int {
+            let mut a: [int; 8];
+            for i = 0, 8 { let p = &i; *p = 1000; a[i] = 1; }
+            return 0;
+        }
+        fn main() -> int { return poke(); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  CodeGenOptions options;
+  options.bounds_check = true;
+  CodeGenerator codegen(options);
+  codegen.generate(program);
+  auto module = codegen.get_module();
+  TEST_ASSERT_EQ(1u, count_bounds_traps(*module->getFunction("poke")));
+}
+
+TEST(for_loop_step_wraps_when_the_variable_address_is_taken) {
+  // After *p = 127 the i8 step wraps to -128, which an nsw add would make poison
+  std::string source = R"(
+        fn plain() -> int {
+            let mut count = 0;
+            for i = 0, 10 { count = count + i; }
+            return count;
+        }
+        fn poked() -> int {
+            let lo: i8 = 0;
+            let hi: i8 = 10;
+            let mut count = 0;
+            let mut poked = false;
+            for i = lo, hi {
+                let p = &i;
+                if !poked { *p = 127; poked = true; }
+                count = count + 1;
+            }
+            return count;
+        }
+        fn main() -> int { return poked(); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+
+  auto step_has_no_wrap = [&](const char* name) {
+    for (auto& inst : llvm::instructions(*module->getFunction(name))) {
+      if (inst.getName().starts_with("next")) {
+        return inst.hasNoSignedWrap() || inst.hasNoUnsignedWrap();
+      }
+    }
+    return false;
+  };
+  TEST_ASSERT_TRUE(step_has_no_wrap("plain"));
+  TEST_ASSERT_FALSE(step_has_no_wrap("poked"));
+
+  // 0, then -128 up to 9
+  TEST_ASSERT_EQ(139, run_program(source));
+  TEST_ASSERT_EQ(139, run_program(source, 2));
+}
+
+TEST(debug_info_locates_functions_and_statements) {
+  std::string source = "fn square(x: int) -> int {\n"
+                       "  let y = x * x;\n"
+                       "  return y;\n"
+                       "}\n"
+                       "fn main() -> int { return square(6); }\n";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+
+  CodeGenOptions options;
+  options.debug_info = true;
+  options.source_file = "squares.tz";
+  CodeGenerator codegen(options);
+  codegen.generate(program);
+  TEST_ASSERT_NO_THROW(codegen.optimize());
+
+  auto module = codegen.get_module();
+  TEST_ASSERT_FALSE(llvm::verifyModule(*module, &llvm::errs()));
+  llvm::Function* square = module->getFunction("square");
+  TEST_ASSERT_TRUE(square->getSubprogram() != nullptr);
+  TEST_ASSERT_EQ(1u, square->getSubprogram()->getLine());
+  TEST_ASSERT_EQ(std::string("squares.tz"), square->getSubprogram()->getFilename().str());
+
+  // Every instruction but the entry allocas carries the line it was generated from
+  bool saw_multiply = false;
+  for (auto& inst : llvm::instructions(*square)) {
+    TEST_ASSERT_TRUE(llvm::isa<llvm::AllocaInst>(inst) || inst.getDebugLoc());
+    if (inst.getOpcode() == llvm::Instruction::Mul) {
+      TEST_ASSERT_EQ(2u, inst.getDebugLoc().getLine());
+      saw_multiply = true;
+    }
+  }
+  TEST_ASSERT_TRUE(saw_multiply);
+
+  // Code jitted with debug info is registered with the debugger and still runs
+  Lexer run_lexer(source);
+  Parser run_parser(run_lexer);
+  auto jit_program = run_parser.parse_program();
+  CodeGenerator jit_codegen(options);
+  jit_codegen.generate(jit_program);
+  TEST_ASSERT_EQ(36, jit_codegen.execute_jit());
+}
+
+TEST(session_compiles_from_memory) {
+  CodeGenOptions options;
+  options.opt_level = 2;
+  CompilationSession session(options);
+
+  auto object = session.compile_object("export fn twice(x: int) -> int { return x * 2; }");
+  TEST_ASSERT_TRUE(llvm::identify_magic(llvm::StringRef(object.data(), object.size())) ==
+                   llvm::file_magic::elf_relocatable);
+
+  // Programs loaded into one session may define the same names
+  auto first = session.load("export fn rule(x: int) -> int { return x + 1; }");
+  auto second = session.load("export fn rule(x: int) -> int { return x * 10; }\n"
+                             "fn main() -> int { return rule(4); }");
+  TEST_ASSERT_EQ(6, first.function<int32_t(int32_t)>("rule")(5));
+  TEST_ASSERT_EQ(50, second.function<int32_t(int32_t)>("rule")(5));
+  TEST_ASSERT_EQ(40, second.function<int32_t()>("main")());
+
+  TEST_ASSERT_THROW(first.lookup("main"), CodeGenError);
+  TEST_ASSERT_THROW(session.load("fn main( -> int {}"), ParseError);
+  TEST_ASSERT_THROW(session.compile_object("fn main() -> int { return missing; }"), CodeGenError);
+
+  // The session stays usable after a failed compile
+  auto third = session.load("fn main() -> int { return 3; }");
+  TEST_ASSERT_EQ(3, third.function<int32_t()>("main")());
+}
+
+TEST(repl_keeps_definitions_across_inputs) {
+  Repl repl;
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("fn square(x: int) -> int { return x * x; }"));
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("let mut total: int = 2;"));
+  TEST_ASSERT_EQ(std::string("49"), repl.evaluate("square(7)"));
+
+  // Statements run once; globals they assign keep their values
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("total = total + square(3);"));
+  TEST_ASSERT_EQ(std::string("11"), repl.evaluate("total"));
+  TEST_ASSERT_EQ(std::string("true"), repl.evaluate("total > 10"));
+  TEST_ASSERT_EQ(std::string("2.5"), repl.evaluate("5.0 / 2.0"));
+
+  // A failed input leaves the session as it was
+  TEST_ASSERT_THROW(repl.evaluate("fn square(x: int) -> int { return x; }"), CodeGenError);
+  TEST_ASSERT_THROW(repl.evaluate("square(1"), ParseError);
+  TEST_ASSERT_THROW(repl.evaluate("missing(1)"), CodeGenError);
+  TEST_ASSERT_EQ(std::string("16"), repl.evaluate("square(4)"));
+
+  std::istringstream in("fn add(a: int, b: int) -> int {\n  return a + b;\n}\nadd(2, 3)\n");
+  std::ostringstream out;
+  std::ostringstream err;
+  TEST_ASSERT_EQ(0, repl.run(in, out, err));
+  TEST_ASSERT_EQ(std::string("tuz> ...> ...> tuz> 5\ntuz> "), out.str());
+  TEST_ASSERT_EQ(std::string(), err.str());
+}
+
+TEST(repl_forgets_the_names_of_failed_inputs) {
+  Repl repl;
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("let base: int = 6;"));
+  TEST_ASSERT_EQ(std::string("42"), repl.evaluate("base * 7"));
+
+  // Names an input bound before its error, and locals of the scopes it failed in, are unbound
+  TEST_ASSERT_THROW(repl.evaluate("fn f() -> int { let x = 1; { let y = 2; return z; } }"),
+                    CodeGenError);
+  TEST_ASSERT_THROW(repl.evaluate("x"), CodeGenError);
+  TEST_ASSERT_THROW(repl.evaluate("let g: int = missing;"), CodeGenError);
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("fn f() -> int { return 3; }"));
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("let g: int = base - 2;"));
+
+  // Functions declared after statement inputs are numbered after the earlier declarations only
+  TEST_ASSERT_EQ(std::string("1"), repl.evaluate("g - f()"));
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("fn h() -> int { return f() + g; }"));
+  TEST_ASSERT_EQ(std::string("13"), repl.evaluate("h() + base"));
+}
+
+TEST(repl_runs_a_let_followed_by_statements) {
+  Repl repl;
+  TEST_ASSERT_EQ(std::string("6"), repl.evaluate("let x = 5; x + 1"));
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("extern fn abs(x: i32) -> i32;"));
+  TEST_ASSERT_EQ(std::string("9"), repl.evaluate("let p = abs(-8); p + 1"));
+
+  // The locals end with their input; a let on its own defines a global, which must be constant
+  TEST_ASSERT_THROW(repl.evaluate("x"), CodeGenError);
+  TEST_ASSERT_THROW(repl.evaluate("let q = abs(-8);"), CodeGenError);
+  TEST_ASSERT_EQ(std::string(), repl.evaluate("let y = (2 + 3) * 4;"));
+  TEST_ASSERT_EQ(std::string("20"), repl.evaluate("y"));
+}
+
+// =============================================================================
+// Object Cache Tests
+// =============================================================================
+
+TEST(cache_key_covers_source_and_options) {
+  CodeGenOptions options;
+  std::string key = ObjectCache::compute_key("fn main() -> int { return 0; }", options, false);
+  TEST_ASSERT_EQ(64u, key.size());
+  TEST_ASSERT_EQ(key, ObjectCache::compute_key("fn main() -> int { return 0; }", options, false));
+
+  TEST_ASSERT_NE(key, ObjectCache::compute_key("fn main() -> int { return 1; }", options, false));
+  TEST_ASSERT_NE(key, ObjectCache::compute_key("fn main() -> int { return 0; }", options, true));
+
+  CodeGenOptions optimized;
+  optimized.opt_level = 2;
+  TEST_ASSERT_NE(key, ObjectCache::compute_key("fn main() -> int { return 0; }", optimized, false));
+
+  CodeGenOptions cross;
+  cross.target_triple = "aarch64-unknown-linux-gnu";
+  TEST_ASSERT_NE(key, ObjectCache::compute_key("fn main() -> int { return 0; }", cross, false));
+
+  CodeGenOptions instrumented;
+  instrumented.profile_generate = true;
+  TEST_ASSERT_NE(key,
+                 ObjectCache::compute_key("fn main() -> int { return 0; }", instrumented, false));
+
+  CodeGenOptions checked;
+  checked.bounds_check = true;
+  TEST_ASSERT_NE(key, ObjectCache::compute_key("fn main() -> int { return 0; }", checked, false));
+
+  // Keys follow the profile's contents
+  TempFile first("profile one");
+  TempFile second("profile two");
+  CodeGenOptions profiled;
+  profiled.profile_use = first.path();
+  std::string first_key =
+      ObjectCache::compute_key("fn main() -> int { return 0; }", profiled, false);
+  profiled.profile_use = second.path();
+  TEST_ASSERT_NE(first_key,
+                 ObjectCache::compute_key("fn main() -> int { return 0; }", profiled, false));
+  profiled.profile_use = "/nonexistent/tuz.profdata";
+  TEST_ASSERT_THROW(ObjectCache::compute_key("fn main() -> int { return 0; }", profiled, false),
+                    CodeGenError);
+}
+
+TEST(cache_misses_incomplete_entries) {
+  TempFile marker("");
+  ObjectCache cache(marker.path() + ".cache");
+  TEST_ASSERT_FALSE(cache.lookup("0123").has_value());
+  TEST_ASSERT_EQ(1u, cache.misses());
+
+  // Entries whose objects are missing do not count as hits
+  TempFile object("not really an object");
+  TEST_ASSERT_TRUE(cache.store("0123", {object.path(), object.path()}));
+  TEST_ASSERT_TRUE(cache.lookup("0123").has_value());
+  std::remove((cache.directory() + "/0123.1.o").c_str());
+  TEST_ASSERT_FALSE(cache.lookup("0123").has_value());
+  TEST_ASSERT_EQ(1u, cache.hits());
+  TEST_ASSERT_EQ(2u, cache.misses());
+
+  llvm::sys::fs::remove_directories(cache.directory());
+}
+
+// =============================================================================
+// Stats Tests
+// =============================================================================
+
+TEST(stats_record_phases_and_passes) {
+  CompileStats stats;
+
+  // Phases are measured by the driver; passes come from the code generator
+  CodeGenOptions codegen_options;
+  codegen_options.opt_level = 2;
+  codegen_options.stats = &stats;
+  {
+    CompileStats::Phase phase(&stats, "parse", "square.tz");
+    phase.set("tokens", 7);
+  }
+  Lexer lexer(std::string_view("fn main() -> int { return 3 * 3; }"));
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  CodeGenerator codegen(codegen_options);
+  codegen.generate(program);
+  codegen.optimize();
+
+  auto phases = stats.phases();
+  TEST_ASSERT_EQ(1u, phases.size());
+  TEST_ASSERT_TRUE(phases[0].name == "parse");
+  TEST_ASSERT_TRUE(phases[0].peak_rss_kb > 0);
+  TEST_ASSERT_TRUE(phases[0].counters[0] == std::make_pair(std::string("tokens"), uint64_t(7)));
+  TEST_ASSERT_FALSE(stats.passes().empty());
+
+  std::ostringstream json;
+  stats.print_json(json);
+  TEST_ASSERT_TRUE(json.str().find("\"passes\":[{\"name\":") != std::string::npos);
+  TEST_ASSERT_TRUE(json.str().find("\"tokens\":7") != std::string::npos);
+}
+
+TEST(stats_count_concurrent_phases_once_in_the_total) {
+  CompileStats stats;
+  {
+    CompileStats::Phase section(&stats, "units", "split.tz");
+    auto unit = [&](const char* input) {
+      CompileStats::Phase phase(section, "codegen", input);
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    };
+    std::thread other(unit, "split.tz [unit 1]");
+    unit("split.tz [unit 0]");
+    other.join();
+  }
+
+  // The section is listed ahead of the units it contains
+  auto phases = stats.phases();
+  TEST_ASSERT_EQ(3u, phases.size());
+  TEST_ASSERT_TRUE(phases[0].name == "units" && phases[0].parent.empty());
+  TEST_ASSERT_TRUE(phases[1].parent == "units" && phases[2].parent == "units");
+  TEST_ASSERT_TRUE(phases[1].wall_ms + phases[2].wall_ms > phases[0].wall_ms);
+
+  std::ostringstream section_ms;
+  section_ms << std::fixed << std::setprecision(3) << phases[0].wall_ms;
+  std::ostringstream json;
+  stats.print_json(json);
+  TEST_ASSERT_TRUE(json.str().find("\"name\":\"codegen\",\"parent\":\"units\"") !=
+                   std::string::npos);
+  TEST_ASSERT_TRUE(json.str().find("\"total_wall_ms\":" + section_ms.str() + ",") !=
+                   std::string::npos);
+}
+
+TEST(stats_and_diagnostics_escape_json_strings_alike) {
+  const std::string text = "tab\there \"quoted\" \x01 caf\xc3\xa9";
+  const std::string escaped = "\"tab\\there \\\"quoted\\\" \\u0001 caf\xc3\xa9\"";
+
+  CompileStats stats;
+  { CompileStats::Phase phase(&stats, "parse", text); }
+  std::ostringstream stats_json;
+  stats.print_json(stats_json);
+  TEST_ASSERT_TRUE(stats_json.str().find("\"input\":" + escaped) != std::string::npos);
+
+  std::ostringstream diagnostic_json;
+  JsonDiagnosticConsumer consumer(diagnostic_json);
+  consumer.consume(DiagnosticMessage(DiagnosticLevel::Error, text));
+  TEST_ASSERT_TRUE(diagnostic_json.str().find("\"message\":" + escaped) != std::string::npos);
+}
+
+// =============================================================================
+// JIT Execution Tests
+// =============================================================================
+
+TEST(jit_runs_main) {
+  std::string source = R"(
+        fn main() -> int {
+            return 42;
+        }
+    )";
+
+  TEST_ASSERT_EQ(42, run_program(source));
+}
+
+TEST(jit_runs_recursive_functions) {
+  std::string source = R"(
+        fn fib(n: int) -> int {
+            if n <= 1 {
+                return n;
+            }
+            return fib(n - 1) + fib(n - 2);
+        }
+
+        fn main() -> int {
+            return fib(10);
+        }
+    )";
+
+  TEST_ASSERT_EQ(55, run_program(source));
+  TEST_ASSERT_EQ(55, run_program(source, 2));
+}
+
+TEST(jit_resolves_extern_functions) {
+  std::string source = R"(
+        extern fn abs(x: i32) -> i32;
+
+        fn main() -> int {
+            return abs(0 - 7);
+        }
+    )";
+
+  TEST_ASSERT_EQ(7, run_program(source));
+}
+
+TEST(jit_rejects_missing_entry) {
+  std::string source = "fn helper() -> int { return 1; }";
+  Lexer lexer(source);
+  Parser parser(lexer.tokenize());
+  auto program = parser.parse_program();
+
+  CodeGenerator codegen;
+  codegen.generate(program);
+  TEST_ASSERT_THROW(codegen.execute_jit(), CodeGenError);
+}
+
+TEST(jit_resolves_scopes_and_globals) {
+  std::string source = R"(
+        fn main() -> int {
+            let x = 1;
+            let mut total = 0;
+            if true {
+                let x = 10;
+                total = total + x;
+            }
+            for i = 0, 3 {
+                let x = i;
+                total = total + x;
+            }
+            return total + x + offset;
+        }
+        let offset = 100;
+    )";
+
+  TEST_ASSERT_EQ(114, run_program(source));
+}
+
+TEST(jit_converts_mixed_integer_widths) {
+  std::string source = R"(
+        fn widen(v: i64) -> i64 { return v * 3; }
+        fn main() -> int {
+            let small: u8 = 200;
+            let big: i64 = widen(small) + 1;
+            return big - 500;
+        }
+    )";
+
+  TEST_ASSERT_EQ(101, run_program(source));
+  TEST_ASSERT_EQ(101, run_program(source, 2));
+}
+
+TEST(jit_for_loop_counts_in_range_type) {
+  // Unsigned ranges compare unsigned: the end is above 2^31
+  std::string source = R"(
+        fn main() -> int {
+            let lo: u32 = 2147483640;
+            let hi: u32 = 2147483650;
+            let mut count = 0;
+            @unroll(disable)
+            for i = lo, hi { count = count + 1; }
+            return count;
+        }
+    )";
+
+  TEST_ASSERT_EQ(10, run_program(source));
+  TEST_ASSERT_EQ(10, run_program(source, 2));
+}
+
+TEST(jit_unsigned_arithmetic_above_the_signed_range) {
+  // Signed operations would see these u32 values and 2^63 in u64 as negative
+  std::string source = R"(
+        fn half(x: f64) -> u32 { return x / 2.0; }
+        fn main() -> int {
+            let lo: u32 = 3000000000;
+            let hi: u32 = 3000000002;
+            let mut score = 0;
+            @unroll(disable)
+            for i = lo, hi {
+                if i < hi { score = score + 1; }
+                if i / 1000 == 3000000 { score = score + 10; }
+                if i % 7 == 4 { score = score + 100; }
+                let wide: f64 = i;
+                if wide > 2999999999.0 { score = score + 1000; }
+            }
+            let k: u64 = 65536;
+            let big: u64 = k * k * k * 32768;
+            if big > k && big / k / k / k == 32768 { score = score + 10000; }
+            if half(8000000000.0) / 2 == 2000000000 { score = score + 20000; }
+            return score;
+        }
+    )";
+  TEST_ASSERT_EQ(32122, run_program(source));
+  TEST_ASSERT_EQ(32122, run_program(source, 2));
+}
+
+TEST(codegen_folds_unsigned_arithmetic_above_the_signed_range) {
+  std::string source = R"(
+        let HUGE: u32 = 3000000000;
+        let K: u64 = 65536;
+        let BIG: u64 = K * K * K * 32768;
+        let HALF: u32 = 8000000000.0 / 2.0;
+        let WIDE: f64 = HUGE;
+        fn main() -> int {
+            let mut score = 0;
+            if HUGE < HUGE + 1 { score = score + 1; }
+            if HUGE / 1000 == 3000000 { score = score + 10; }
+            if HUGE % 7 == 4 { score = score + 100; }
+            if WIDE > 2999999999.0 { score = score + 1000; }
+            if BIG > K && BIG / K / K / K == 32768 { score = score + 10000; }
+            if HALF / 2 == 2000000000 { score = score + 20000; }
+            return score;
+        }
+    )";
+  TEST_ASSERT_EQ(31111, run_program(source));
+  TEST_ASSERT_EQ(31111, run_program(source, 2));
+}
+
+TEST(jit_become_runs_in_constant_stack) {
+  // A million frames would overflow the stack; musttail reuses one even unoptimized
+  std::string source = R"(
+        fn is_even(n: i64) -> bool {
+            if n == 0 { return true; }
+            become is_odd(n - 1);
+        }
+        fn is_odd(n: i64) -> bool {
+            if n == 0 { return false; }
+            become is_even(n - 1);
+        }
+        fn main() -> int {
+            if is_even(1000000) { return 7; }
+            return 1;
+        }
+    )";
+  TEST_ASSERT_EQ(7, run_program(source));
+  TEST_ASSERT_EQ(7, run_program(source, 2));
+
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+  size_t must_tail = 0;
+  for (auto& inst : llvm::instructions(*module->getFunction("is_even"))) {
+    auto* call = llvm::dyn_cast<llvm::CallInst>(&inst);
+    must_tail += call && call->isMustTailCall();
+  }
+  TEST_ASSERT_EQ(1u, must_tail);
+}
+
+TEST(codegen_marks_calls_in_tail_position) {
+  std::string source = R"(
+        fn step(n: int) -> int { return n + 1; }
+        fn direct(n: int) -> int { return step(n); }
+        fn widened(n: int) -> i64 { return step(n); }
+        fn escapes(n: int) -> int {
+            let x = n;
+            let p = &x;
+            return step(*p);
+        }
+        fn main() -> int { return direct(1); }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+
+  auto calls_step_in_tail = [&](const char* name) {
+    for (auto& inst : llvm::instructions(*module->getFunction(name))) {
+      auto* call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      if (call && call->getCalledFunction()->getName() == "step") {
+        return call->isTailCall();
+      }
+    }
+    return false;
+  };
+  TEST_ASSERT_TRUE(calls_step_in_tail("direct"));
+  // The result is converted after the call, and a local's address may reach the callee
+  TEST_ASSERT_FALSE(calls_step_in_tail("widened"));
+  TEST_ASSERT_FALSE(calls_step_in_tail("escapes"));
+}
+
+TEST(codegen_rejects_bad_become) {
+  std::vector<std::string> sources = {
+      "fn f(x: int) -> int { return x; } fn g(x: i64) -> int { become f(1); }",
+      "fn f(x: int) -> i64 { return 1; } fn g(x: int) -> int { become f(x); }",
+      "fn f(x: int) -> int { return x; } fn g(x: int, y: int) -> int { become f(x); }",
+      "struct P { x: int } fn g() -> P { become P(1); }",
+      "fn f(p: *int) -> int { return *p; } fn g(p: *int) -> int { let x = 1; become f(&x); }",
+      "fn f(p: *int) -> int { return *p; } "
+      "fn g(p: *int) -> int { become f(p); let x = 1; let q = &x; }",
+  };
+  for (const auto& source : sources) {
+    Lexer lexer(source);
+    Parser parser(lexer);
+    auto program = parser.parse_program();
+    CodeGenerator codegen;
+    TEST_ASSERT_THROW(codegen.generate(program), CodeGenError);
+  }
+
+  std::string not_a_call = "fn g(x: int) -> int { become x + 1; }";
+  Lexer lexer(not_a_call);
+  Parser parser(lexer);
+  TEST_ASSERT_THROW(parser.parse_program(), ParseError);
+}
+
+TEST(jit_computes_with_vector_types) {
+  std::string source = R"(
+        fn dot(a: f32x4, b: f32x4) -> f32 { return reduce_add(a * b); }
+        fn main() -> int {
+            let a = f32x4(1.0, 2.0, 3.0, 4.0);
+            let b = f32x4(2.0);
+            let mut c = a * b + 1.0;
+            c[0] = 10.0;
+            let r = shuffle(a, c, 3, 4, 0, 5);
+            let m = select(a > 2.0, a, 0.0);
+            let floats = dot(a, b) + reduce_max(r) + reduce_min(m) + reduce_add(m) + c[3];
+
+            let v = i32x8(1, 2, 3, 4, 5, 6, 7, 8);
+            let w = v * 2 - 1;
+            let ints = reduce_add(w) + reduce_mul(i32x4(1, 2, 3, 4));
+            let bytes = reduce_max(u8x4(200, 10, 3, 4));
+            return floats + ints + bytes;
+        }
+    )";
+
+  // (20 + 10 + 0 + 7 + 9) + (64 + 24) + 200
+  TEST_ASSERT_EQ(334, run_program(source));
+  TEST_ASSERT_EQ(334, run_program(source, 2));
+}
+
+TEST(codegen_rejects_bad_vector_builtins) {
+  std::vector<std::string> sources = {
+      "fn main() -> int { let v = f32x4(1.0, 2.0); return 0; }",
+      "fn main() -> int { let v = f32x4(1.0); let s = shuffle(v, v, 0, 8); return 0; }",
+      "fn main() -> int { let v = f32x4(1.0); let s = select(v, v, v); return 0; }",
+      "fn main() -> int { return reduce_add(3); }",
+      "fn main() -> int { let v = i32x4(1); v[0] = 2; return 0; }",
+  };
+  for (const auto& source : sources) {
+    Lexer lexer(source);
+    Parser parser(lexer);
+    auto program = parser.parse_program();
+    CodeGenerator codegen;
+    TEST_ASSERT_THROW(codegen.generate(program), CodeGenError);
+  }
+}
+
+TEST(resolver_rejects_mismatched_vector_types) {
+  std::vector<std::string> sources = {
+      "fn main() -> int { let v = f32x4(1.0) + i32x4(1); return 0; }",
+      "fn main() -> int { let v = f32x4(1.0) + f32x8(1.0); return 0; }",
+      "fn main() -> int { let v = f32x4(1.0) < f32x8(1.0); return 0; }",
+      "fn main() -> int { let v: f32x4 = i32x4(1); return 0; }",
+      "fn f(v: f32x4) -> int { return 0; }\nfn main() -> int { return f(f32x8(1.0)); }",
+      "fn main() -> int { let v = i32x4(1); let x: int = v; return x; }",
+      "fn main() -> int { if f32x4(1.0) > 0.0 { return 1; } return 0; }",
+      "fn main() -> int { while i32x4(1) == 1 { } return 0; }",
+      "fn main() -> int { if 1 { return 1; } return 0; }",
+  };
+  for (const auto& source : sources) {
+    Lexer lexer(source);
+    Parser parser(lexer);
+    auto program = parser.parse_program();
+    CodeGenerator codegen;
+    TEST_ASSERT_THROW(codegen.generate(program), CodeGenError);
+  }
+}
+
+TEST(jit_computes_with_structs_and_arrays) {
+  std::string source = R"(
+        struct Vec2 { x: f64, y: f64 }
+        struct Body { pos: Vec2, mass: i32, tag: u8 }
+
+        fn make(x: f64, y: f64, mass: i32) -> Body { return Body(Vec2(x, y), mass, 7); }
+        fn weigh(b: *Body) -> i32 { return b.mass + b.tag; }
+
+        fn main() -> int {
+            let mut bodies: [Body; 4];
+            for i = 0, 4 {
+                bodies[i] = make(i, i * 2, i + 1);
+            }
+            bodies[3].pos.y = 100.0;
+            let mut b = bodies[2];
+            b.mass = b.mass * 10;
+            let p = &bodies[1];
+            p.tag = 0;
+
+            let mut grid: [[i32; 3]; 2];
+            grid[1][2] = 5;
+            let mut total = 0;
+            for i = 0, 4 {
+                total = total + bodies[i].mass;
+            }
+            return total + b.mass + weigh(p) + bodies[3].pos.y + grid[1][2] + Vec2().x;
+        }
+    )";
+
+  // (1 + 2 + 3 + 4) + 30 + 2 + 100 + 5
+  TEST_ASSERT_EQ(147, run_program(source));
+  TEST_ASSERT_EQ(147, run_program(source, 2));
+}
+
+TEST(codegen_lays_out_soa_arrays_by_field) {
+  std::string fields = R"( struct Particle { x: f32, y: f32, vx: f32, vy: f32, id: i64 }
+        let mut particles: [Particle; 64];
+        fn update(dt: f32) {
+            for i = 0, 64 {
+                particles[i].x = particles[i].x + particles[i].vx * dt;
+            }
+        }
+        fn main() -> int {
+            for i = 0, 64 {
+                particles[i] = Particle(i, 0.0, 2.0, 0.0, i);
+            }
+            update(0.5);
+            let p = particles[10];
+            return p.x + p.id + particles[63].x;
+        }
+    )";
+
+  // Each layout gives the same answer: 11 + 10 + 64
+  std::string soa = "@soa" + fields;
+  TEST_ASSERT_EQ(85, run_program(fields));
+  TEST_ASSERT_EQ(85, run_program(soa));
+  TEST_ASSERT_EQ(85, run_program(soa, 2));
+
+  Lexer lexer(soa);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+  auto* particles = module->getGlobalVariable("particles", true);
+  TEST_ASSERT_TRUE(particles != nullptr);
+  auto* layout = llvm::dyn_cast<llvm::StructType>(particles->getValueType());
+  TEST_ASSERT_TRUE(layout != nullptr);
+  TEST_ASSERT_EQ(5u, layout->getNumElements());
+  TEST_ASSERT_TRUE(layout->getElementType(0) ==
+                   llvm::ArrayType::get(llvm::Type::getFloatTy(module->getContext()), 64));
+}
+
+TEST(types_struct_layout_matches_llvm) {
+  std::string source = R"(
+        struct Mixed { a: u8, b: f64, c: i16, d: i32, e: bool, v: f32x4 }
+        fn main() -> int { let m = Mixed(); return 0; }
+    )";
+  Lexer lexer(source);
+  Parser parser(lexer);
+  auto program = parser.parse_program();
+  CodeGenerator codegen;
+  codegen.generate(program);
+  auto module = codegen.get_module();
+
+  const auto& mixed = *static_cast<StructDecl&>(*program.declarations[0]).type;
+  auto* llvm_type = llvm::StructType::getTypeByName(module->getContext(), "Mixed");
+  TEST_ASSERT_TRUE(llvm_type != nullptr);
+  llvm::DataLayout data_layout(
+      "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128");
+  const llvm::StructLayout* layout = data_layout.getStructLayout(llvm_type);
+  for (unsigned i = 0; i < mixed.fields.size(); ++i) {
+    TEST_ASSERT_EQ(layout->getElementOffset(i), *mixed.get_field_offset(mixed.fields[i].first));
+  }
+  TEST_ASSERT_EQ(layout->getSizeInBytes(), mixed.size());
+}
+
+TEST(codegen_rejects_bad_struct_use) {
+  std::vector<std::string> sources = {
+      "struct P { x: i32 } fn main() -> int { let p = P(); return p.z; }",
+      "fn main() -> int { let q: Q; return 0; }",
+      "struct A { b: B } struct B { a: [A; 2] } fn main() -> int { return 0; }",
+      "struct P { x: i32 } fn main() -> int { let p = P(1, 2); return 0; }",
+      "struct P { x: i32 } fn main() -> int { let p = P(1); p.x = 2; return 0; }",
+      "struct P { x: i32 } fn main() -> int { let p = P(1); return p + p; }",
+      "struct P { x: i32 } fn main() -> int { let p: P = 3; return 0; }",
+      "struct P { x: i32, x: i32 } fn main() -> int { return 0; }",
+      "@soa struct P { x: i32 } fn main() -> int { let mut a: [P; 4]; let q = &a[0]; return 0; }",
+      "fn main() -> int { let x = 3; return x[0]; }",
+  };
+  for (const auto& source : sources) {
+    Lexer lexer(source);
+    Parser parser(lexer);
+    auto program = parser.parse_program();
+    CodeGenerator codegen;
+    TEST_ASSERT_THROW(codegen.generate(program), CodeGenError);
+  }
+
+  Lexer lexer("@packed struct P { x: i32 }");
+  Parser parser(lexer);
+  TEST_ASSERT_THROW(parser.parse_program(), ParseError);
+}
+
 TEST_MAIN()